@@ -29,7 +29,15 @@ namespace coda {
         }
       }
 
+      /*!
+       * A blocking client runs on a thread of its own.  A non-blocking one
+       * is driven by its server's workers instead.
+       */
       void default_client::on_connect() {
+        if (is_non_blocking()) {
+          return;
+        }
+
         backgroundThread_ =
             std::make_shared<std::thread>(&default_client::run, this);
       }
@@ -56,7 +64,8 @@ namespace coda {
             break;
           }
 
-          if (!read_to_buffer()) {
+          // closing sends whatever is left for a peer that has finished
+          if (!read_to_buffer() || is_read_closed()) {
             close();
             break;
           }
@@ -0,0 +1,326 @@
+#if defined(COROUTINES_FOUND) && defined(EPOLL_FOUND)
+
+#include "event_loop.h"
+#include "../exception.h"
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <vector>
+
+#define MAXEVENTS 64
+
+namespace coda {
+  namespace net {
+    namespace async {
+      namespace detail {
+        /*!
+         * a coroutine nobody awaits, which frees itself when done
+         */
+        struct detached {
+          struct promise_type {
+            detached get_return_object() const noexcept { return {}; }
+            std::suspend_never initial_suspend() const noexcept { return {}; }
+            std::suspend_never final_suspend() const noexcept { return {}; }
+            void return_void() const noexcept {}
+            void unhandled_exception() const noexcept {}
+          };
+        };
+
+        detached run_detached(task<void> value, std::atomic<size_t> &count) {
+          try {
+            co_await value;
+          } catch (...) {
+            // nobody is left to handle it
+          }
+          count--;
+        }
+      } // namespace detail
+
+      uint32_t event_loop::events_for(const waiter &w) noexcept {
+        uint32_t events = EPOLLONESHOT | EPOLLRDHUP;
+
+        if (w.reader) {
+          events |= EPOLLIN;
+        }
+
+        if (w.writer) {
+          events |= EPOLLOUT;
+        }
+
+        return events;
+      }
+
+      event_loop::readiness::readiness(event_loop &loop, SOCKET sock,
+                                       uint32_t events) noexcept
+          : loop_(loop), sock_(sock), events_(events), watched_(false),
+            handle_(nullptr) {}
+
+      bool event_loop::readiness::await_ready() const noexcept {
+        return sock_ == socket::INVALID;
+      }
+
+      bool
+      event_loop::readiness::await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+
+        watched_ = loop_.watch(sock_, events_, this);
+
+        // carry on straight away if it can never be woken
+        return watched_;
+      }
+
+      bool event_loop::readiness::await_resume() const noexcept {
+        return watched_;
+      }
+
+      event_loop::event_loop()
+          : poller_(epoll_create1(0)), wakeup_(eventfd(0, EFD_NONBLOCK)),
+            waiting_(0), tasks_(0), stopped_(false) {
+        if (poller_ == socket::INVALID || wakeup_ == socket::INVALID) {
+          throw socket_exception(strerror(errno));
+        }
+
+        struct epoll_event event;
+
+        memset(&event, 0, sizeof(epoll_event));
+
+        event.events = EPOLLIN;
+        event.data.fd = wakeup_;
+
+        if (epoll_ctl(poller_, EPOLL_CTL_ADD, wakeup_, &event) ==
+            socket::INVALID) {
+          throw socket_exception(strerror(errno));
+        }
+      }
+
+      event_loop::~event_loop() {
+        if (poller_ != socket::INVALID) {
+          ::close(poller_);
+        }
+
+        if (wakeup_ != socket::INVALID) {
+          ::close(wakeup_);
+        }
+      }
+
+      event_loop::readiness event_loop::readable(SOCKET sock) noexcept {
+        return readiness(*this, sock, static_cast<uint32_t>(EPOLLIN));
+      }
+
+      event_loop::readiness event_loop::writable(SOCKET sock) noexcept {
+        return readiness(*this, sock, static_cast<uint32_t>(EPOLLOUT));
+      }
+
+      void event_loop::spawn(task<void> value) {
+        tasks_++;
+
+        detail::run_detached(std::move(value), tasks_);
+      }
+
+      void event_loop::run() {
+        while (!stopped_ && (tasks_ > 0 || waiting_ > 0)) {
+          poll(-1);
+        }
+
+        stopped_ = false;
+      }
+
+      size_t event_loop::poll(int timeout) {
+        struct epoll_event events[MAXEVENTS];
+
+        std::vector<std::coroutine_handle<>> ready;
+
+        // unwatched coroutines are already due, so don't wait for more
+        ready.swap(unwatched_);
+
+        int n = epoll_wait(poller_, events, MAXEVENTS,
+                           ready.empty() ? timeout : 0);
+
+        if (n == socket::INVALID) {
+          if (errno != EINTR) {
+            unwatched_.swap(ready);
+            throw socket_exception(strerror(errno));
+          }
+          n = 0;
+        }
+
+        for (int i = 0; i < n; i++) {
+          SOCKET sock = events[i].data.fd;
+
+          if (sock == wakeup_) {
+            uint64_t value;
+
+            if (::read(wakeup_, &value, sizeof(value)) < 0) {
+              // already cleared
+            }
+            continue;
+          }
+
+          auto it = waiters_.find(sock);
+
+          if (it == waiters_.end()) {
+            continue;
+          }
+
+          auto &w = it->second;
+
+          uint32_t happened = events[i].events;
+
+          // errors wake everyone, so they find out from their next call
+          bool failed = happened & (EPOLLERR | EPOLLHUP);
+
+          if (w.reader && (failed || (happened & (EPOLLIN | EPOLLRDHUP)))) {
+            ready.push_back(w.reader->handle_);
+            w.reader = nullptr;
+          }
+
+          if (w.writer && (failed || (happened & EPOLLOUT))) {
+            ready.push_back(w.writer->handle_);
+            w.writer = nullptr;
+          }
+
+          // one shot disarmed the descriptor, so watch again for the rest
+          if (w.reader || w.writer) {
+            struct epoll_event event;
+
+            memset(&event, 0, sizeof(epoll_event));
+
+            event.data.fd = sock;
+            event.events = events_for(w);
+
+            epoll_ctl(poller_, EPOLL_CTL_MOD, sock, &event);
+          }
+        }
+
+        waiting_ -= ready.size();
+
+        for (auto handle : ready) {
+          handle.resume();
+        }
+
+        std::vector<std::function<void()>> posted;
+
+        {
+          std::lock_guard<std::mutex> lock(posted_mutex_);
+
+          posted.swap(posted_);
+        }
+
+        for (const auto &value : posted) {
+          value();
+        }
+
+        return ready.size() + posted.size();
+      }
+
+      void event_loop::post(std::function<void()> value) {
+        if (!value) {
+          return;
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(posted_mutex_);
+
+          posted_.push_back(std::move(value));
+        }
+
+        uint64_t signal = 1;
+
+        if (::write(wakeup_, &signal, sizeof(signal)) < 0) {
+          // already signalled
+        }
+      }
+
+      void event_loop::stop() {
+        stopped_ = true;
+
+        uint64_t value = 1;
+
+        if (::write(wakeup_, &value, sizeof(value)) < 0) {
+          // already signalled
+        }
+      }
+
+      size_t event_loop::tasks() const noexcept { return tasks_; }
+
+      void event_loop::unwatch(SOCKET sock) {
+        auto it = waiters_.find(sock);
+
+        if (it == waiters_.end()) {
+          return;
+        }
+
+        auto &w = it->second;
+
+        for (auto awaiter : {w.reader, w.writer}) {
+          if (awaiter) {
+            awaiter->watched_ = false;
+            unwatched_.push_back(awaiter->handle_);
+          }
+        }
+
+        if (w.registered) {
+          epoll_ctl(poller_, EPOLL_CTL_DEL, sock, NULL);
+        }
+
+        waiters_.erase(it);
+      }
+
+      void event_loop::close(socket &sock) {
+        unwatch(sock.raw_socket());
+
+        sock.close();
+      }
+
+      bool event_loop::watch(SOCKET sock, uint32_t events,
+                             readiness *awaiter) {
+        auto &w = waiters_[sock];
+
+        // one reader and one writer per descriptor
+        auto &slot = (events & EPOLLIN) ? w.reader : w.writer;
+
+        if (slot) {
+          return false;
+        }
+
+        slot = awaiter;
+
+        struct epoll_event event;
+
+        memset(&event, 0, sizeof(epoll_event));
+
+        event.data.fd = sock;
+        event.events = events_for(w);
+
+        int status = socket::INVALID;
+
+        // a closed descriptor leaves the set, so its number may come back
+        // unregistered
+        if (w.registered) {
+          status = epoll_ctl(poller_, EPOLL_CTL_MOD, sock, &event);
+        }
+
+        if (status == socket::INVALID) {
+          status = epoll_ctl(poller_, EPOLL_CTL_ADD, sock, &event);
+
+          if (status == socket::INVALID && errno == EEXIST) {
+            status = epoll_ctl(poller_, EPOLL_CTL_MOD, sock, &event);
+          }
+        }
+
+        if (status == socket::INVALID) {
+          slot = nullptr;
+          return false;
+        }
+
+        w.registered = true;
+
+        waiting_++;
+
+        return true;
+      }
+    } // namespace async
+  }   // namespace net
+} // namespace coda
+
+#endif
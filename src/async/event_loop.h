@@ -0,0 +1,156 @@
+#ifndef CODA_NET_SERVER_ASYNC_EVENT_LOOP_H
+#define CODA_NET_SERVER_ASYNC_EVENT_LOOP_H
+
+#if defined(COROUTINES_FOUND) && defined(EPOLL_FOUND)
+
+#include "../socket.h"
+#include "task.h"
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    namespace async {
+      /*!
+       * A single threaded reactor for coroutines.  A coroutine awaiting
+       * readable() or writable() is suspended until epoll reports the
+       * descriptor ready, then resumed on the thread calling run().
+       */
+      class event_loop {
+        public:
+        /*!
+         * suspends a coroutine until a descriptor is ready
+         */
+        class readiness {
+          public:
+          readiness(event_loop &loop, SOCKET sock, uint32_t events) noexcept;
+
+          bool await_ready() const noexcept;
+
+          bool await_suspend(std::coroutine_handle<> handle);
+
+          /*!
+           * @returns false if the descriptor could not be watched, or was
+           * unwatched before it was ready
+           */
+          bool await_resume() const noexcept;
+
+          private:
+          friend class event_loop;
+
+          event_loop &loop_;
+          SOCKET sock_;
+          uint32_t events_;
+          bool watched_;
+          std::coroutine_handle<> handle_;
+        };
+
+        event_loop();
+        event_loop(const event_loop &other) = delete;
+        event_loop(event_loop &&other) = delete;
+        virtual ~event_loop();
+        event_loop &operator=(const event_loop &other) = delete;
+        event_loop &operator=(event_loop &&other) = delete;
+
+        /*!
+         * @returns an awaitable that resumes once the socket can be read
+         */
+        readiness readable(SOCKET sock) noexcept;
+
+        /*!
+         * @returns an awaitable that resumes once the socket can be written
+         */
+        readiness writable(SOCKET sock) noexcept;
+
+        /*!
+         * Stops watching a descriptor, resuming anything waiting on it as
+         * if it could not be watched.  Call before the descriptor is closed.
+         */
+        void unwatch(SOCKET sock);
+
+        /*!
+         * unwatches and closes a socket
+         */
+        void close(socket &sock);
+
+        /*!
+         * Starts a task that the loop owns until it finishes.  An exception
+         * that escapes the task is dropped.
+         */
+        void spawn(task<void> value);
+
+        /*!
+         * Runs a function on the loop's thread during its next poll, can be
+         * called from any thread
+         */
+        void post(std::function<void()> value);
+
+        /*!
+         * Resumes ready coroutines until stopped, or until there are no
+         * tasks and nothing is waiting
+         */
+        void run();
+
+        /*!
+         * Waits once for ready descriptors and resumes their coroutines,
+         * then runs anything posted
+         * @param timeout milliseconds to wait, or -1 for no limit
+         * @returns the number of coroutines resumed and functions run
+         */
+        size_t poll(int timeout);
+
+        /*!
+         * stops run(), can be called from any thread
+         */
+        void stop();
+
+        /*!
+         * @returns the number of spawned tasks still running
+         */
+        size_t tasks() const noexcept;
+
+        private:
+        struct waiter {
+          readiness *reader;
+          readiness *writer;
+          bool registered;
+        };
+
+        bool watch(SOCKET sock, uint32_t events, readiness *awaiter);
+
+        /*!
+         * @returns the epoll events a descriptor's waiters need
+         */
+        static uint32_t events_for(const waiter &w) noexcept;
+
+        SOCKET poller_;
+
+        SOCKET wakeup_;
+
+        std::unordered_map<SOCKET, waiter> waiters_;
+
+        // unwatched coroutines, resumed by the next poll
+        std::vector<std::coroutine_handle<>> unwatched_;
+
+        std::mutex posted_mutex_;
+
+        std::vector<std::function<void()>> posted_;
+
+        size_t waiting_;
+
+        std::atomic<size_t> tasks_;
+
+        std::atomic<bool> stopped_;
+      };
+    } // namespace async
+  }   // namespace net
+} // namespace coda
+
+#endif
+
+#endif
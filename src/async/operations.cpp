@@ -0,0 +1,263 @@
+#if defined(COROUTINES_FOUND) && defined(EPOLL_FOUND)
+
+#include "operations.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+
+namespace coda {
+  namespace net {
+    namespace async {
+      namespace detail {
+        bool would_block() noexcept {
+          return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        void make_non_blocking(socket &sock) {
+          if (!sock.is_non_blocking()) {
+            sock.set_non_blocking(true);
+          }
+        }
+
+        /*!
+         * suspends until the shared resolver answers, resuming on the loop
+         */
+        class resolve_awaiter {
+          public:
+          resolve_awaiter(event_loop &loop, const std::string &host)
+              : loop_(loop), host_(host), error_(0) {}
+
+          bool await_ready() {
+            return resolver::shared().find(host_, error_, endpoints_);
+          }
+
+          void await_suspend(std::coroutine_handle<> handle) {
+            resolver::shared().resolve(
+                host_, [this, handle](int error,
+                                      const resolver::endpoints_type &found) {
+                  error_ = error;
+                  endpoints_ = found;
+                  loop_.post([handle]() { handle.resume(); });
+                });
+          }
+
+          int await_resume() const noexcept { return error_; }
+
+          const resolver::endpoints_type &endpoints() const noexcept {
+            return endpoints_;
+          }
+
+          private:
+          event_loop &loop_;
+          std::string host_;
+          int error_;
+          resolver::endpoints_type endpoints_;
+        };
+      } // namespace detail
+
+      task<int> async_read_some(event_loop &loop, socket &sock, buffer &dest) {
+        detail::make_non_blocking(sock);
+
+        for (;;) {
+          int status = sock.recv_into(dest);
+
+          if (status >= 0 || !detail::would_block()) {
+            co_return status;
+          }
+
+          if (errno == EINTR) {
+            continue;
+          }
+
+          bool ready = co_await loop.readable(sock.raw_socket());
+
+          if (!ready) {
+            co_return socket::INVALID;
+          }
+        }
+      }
+
+      task<size_t> async_read_until(event_loop &loop, socket &sock,
+                                    buffer &dest, const std::string &delim) {
+        if (delim.empty()) {
+          co_return 0;
+        }
+
+        // only search what arrived since the last look
+        size_t searched = 0;
+
+        for (;;) {
+          auto input = dest.readable();
+
+          auto from = input.begin() + std::min(searched, input.size());
+
+          auto it = std::search(from, input.end(), delim.begin(), delim.end());
+
+          if (it != input.end()) {
+            co_return static_cast<size_t>(it - input.begin()) + delim.size();
+          }
+
+          if (input.size() >= delim.size()) {
+            searched = input.size() - delim.size() + 1;
+          }
+
+          int status = co_await async_read_some(loop, sock, dest);
+
+          if (status <= 0) {
+            co_return 0;
+          }
+        }
+      }
+
+      task<bool> async_write_all(event_loop &loop, socket &sock,
+                                 const void *data, size_t size) {
+        detail::make_non_blocking(sock);
+
+        auto bytes = static_cast<const char *>(data);
+
+        while (size > 0) {
+          int status = sock.send(bytes, size);
+
+          if (status > 0) {
+            bytes += status;
+            size -= status;
+            continue;
+          }
+
+          if (status == 0 || !detail::would_block()) {
+            co_return false;
+          }
+
+          if (errno == EINTR) {
+            continue;
+          }
+
+          bool ready = co_await loop.writable(sock.raw_socket());
+
+          if (!ready) {
+            co_return false;
+          }
+        }
+
+        co_return true;
+      }
+
+      task<bool> async_write_all(event_loop &loop, buffered_socket &sock) {
+        detail::make_non_blocking(sock);
+
+        while (sock.has_output()) {
+          if (!sock.write_from_buffer()) {
+            co_return false;
+          }
+
+          if (!sock.has_output()) {
+            break;
+          }
+
+          bool ready = co_await loop.writable(sock.raw_socket());
+
+          if (!ready) {
+            co_return false;
+          }
+        }
+
+        co_return true;
+      }
+
+      task<SOCKET> async_accept(event_loop &loop, socket &listener,
+                                sockaddr_storage &addr) {
+        detail::make_non_blocking(listener);
+
+        for (;;) {
+          SOCKET sock = listener.accept(addr);
+
+          if (sock != socket::INVALID) {
+            co_return sock;
+          }
+
+          if (!detail::would_block()) {
+            co_return socket::INVALID;
+          }
+
+          if (errno == EINTR) {
+            continue;
+          }
+
+          bool ready = co_await loop.readable(listener.raw_socket());
+
+          if (!ready) {
+            co_return socket::INVALID;
+          }
+        }
+      }
+
+      task<int> async_resolve(event_loop &loop, const std::string &host,
+                              resolver::endpoints_type &endpoints) {
+        detail::resolve_awaiter lookup(loop, host);
+
+        int error = co_await lookup;
+
+        endpoints = lookup.endpoints();
+
+        co_return error;
+      }
+
+      task<SOCKET> async_connect(event_loop &loop, const std::string &host,
+                                 int port, sockaddr_storage &addr) {
+        resolver::endpoints_type endpoints;
+
+        int error = co_await async_resolve(loop, host, endpoints);
+
+        if (error != 0 || !endpoints) {
+          co_return socket::INVALID;
+        }
+
+        for (auto candidate : *endpoints) {
+          if (candidate.family == AF_INET) {
+            ((struct sockaddr_in *)&candidate.addr)->sin_port = htons(port);
+          } else if (candidate.family == AF_INET6) {
+            ((struct sockaddr_in6 *)&candidate.addr)->sin6_port = htons(port);
+          }
+
+          SOCKET sock = ::socket(candidate.family, candidate.socktype,
+                                 candidate.protocol);
+
+          if (sock == socket::INVALID) {
+            continue;
+          }
+
+          fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+          int status = ::connect(sock, (const struct sockaddr *)&candidate.addr,
+                                 candidate.length);
+
+          if (status == socket::INVALID && errno == EINPROGRESS) {
+            bool ready = co_await loop.writable(sock);
+
+            int error = 0;
+            socklen_t length = sizeof(error);
+
+            if (ready &&
+                getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length) == 0 &&
+                error == 0) {
+              status = 0;
+            }
+          }
+
+          if (status == 0) {
+            memset(&addr, 0, sizeof(addr));
+            memmove(&addr, &candidate.addr, candidate.length);
+            co_return sock;
+          }
+
+          closesocket(sock);
+        }
+
+        co_return socket::INVALID;
+      }
+    } // namespace async
+  }   // namespace net
+} // namespace coda
+
+#endif
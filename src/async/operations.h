@@ -0,0 +1,72 @@
+#ifndef CODA_NET_SERVER_ASYNC_OPERATIONS_H
+#define CODA_NET_SERVER_ASYNC_OPERATIONS_H
+
+#if defined(COROUTINES_FOUND) && defined(EPOLL_FOUND)
+
+#include "../buffered_socket.h"
+#include "../resolver.h"
+#include "event_loop.h"
+#include "task.h"
+#include <string>
+
+namespace coda {
+  namespace net {
+    namespace async {
+      /*!
+       * Reads whatever is available into a buffer, suspending until there
+       * is something.  The socket is made non-blocking.
+       * @returns the bytes read, zero when the peer has closed, or
+       * negative on error
+       */
+      task<int> async_read_some(event_loop &loop, socket &sock, buffer &dest);
+
+      /*!
+       * Reads into a buffer until it holds the delimiter
+       * @returns the length up to and including the delimiter, or zero if
+       * the connection ended first
+       */
+      task<size_t> async_read_until(event_loop &loop, socket &sock,
+                                    buffer &dest, const std::string &delim);
+
+      /*!
+       * Sends all the data, suspending while the socket is full
+       * @returns false if the connection failed first
+       */
+      task<bool> async_write_all(event_loop &loop, socket &sock,
+                                 const void *data, size_t size);
+
+      /*!
+       * Flushes a buffered socket's output queue
+       * @returns false if the connection failed first
+       */
+      task<bool> async_write_all(event_loop &loop, buffered_socket &sock);
+
+      /*!
+       * Accepts a connection, suspending until one arrives
+       * @returns the new descriptor, or INVALID on error
+       */
+      task<SOCKET> async_accept(event_loop &loop, socket &listener,
+                                sockaddr_storage &addr);
+
+      /*!
+       * Resolves a host with the shared resolver, suspending while it is
+       * looked up on a resolver thread
+       * @returns zero or a getaddrinfo error code
+       */
+      task<int> async_resolve(event_loop &loop, const std::string &host,
+                              resolver::endpoints_type &endpoints);
+
+      /*!
+       * Resolves a host, then connects to each of its addresses in turn,
+       * suspending while each attempt is in progress
+       * @returns a connected non-blocking descriptor, or INVALID
+       */
+      task<SOCKET> async_connect(event_loop &loop, const std::string &host,
+                                 int port, sockaddr_storage &addr);
+    } // namespace async
+  }   // namespace net
+} // namespace coda
+
+#endif
+
+#endif
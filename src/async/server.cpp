@@ -6,23 +6,246 @@
 #include <cstring>
 #include <memory>
 
+#ifdef EPOLL_FOUND
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#define MAXEVENTS 64
+
+#ifdef EPOLL_FOUND
+// one shot, so only one worker can be serving a connection at a time
+#define CLIENT_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLONESHOT)
+#endif
+
 namespace coda {
   namespace net {
     namespace async {
-      server::server(const factory_type &factory) : socket_server(factory) {}
+      namespace detail {
+        /*!
+         * stops watching a pooled connection when it is closed
+         */
+        class connection_listener : public buffered_socket_listener {
+          private:
+          server &server_;
+
+          public:
+          connection_listener(server &server) : server_(server) {}
+
+          void on_close(const buffered_socket_listener::socket_type &socket) {
+            if (!socket || !socket->is_valid()) {
+              return;
+            }
+
+            server_.remove_socket(socket->raw_socket(), socket);
+          }
+
+          void on_connect(const buffered_socket_listener::socket_type &sock) {}
+
+          void on_will_read(const buffered_socket_listener::socket_type &sock) {
+          }
+
+          void on_did_read(const buffered_socket_listener::socket_type &sock) {}
+
+          void on_will_write(const buffered_socket_listener::socket_type &sock) {
+          }
+
+          void on_did_write(const buffered_socket_listener::socket_type &sock) {
+          }
+        };
+      } // namespace detail
+
+      server::server(const factory_type &factory)
+          : socket_server(factory), legacy_(false), threads_(0),
+            poller_(INVALID), wakeup_(INVALID) {}
 
-      server::server(server &&other) : socket_server(std::move(other)) {}
+      server::server(server &&other)
+          : socket_server(std::move(other)), legacy_(other.legacy_),
+            threads_(other.threads_), poller_(INVALID), wakeup_(INVALID) {}
 
-      server::~server() {}
+      // stop here, the run loop uses members that are gone by the base
+      server::~server() { stop(); }
 
       server &server::operator=(server &&other) {
-        server::operator=(std::move(other));
+        socket_server::operator=(std::move(other));
+        legacy_ = other.legacy_;
+        threads_ = other.threads_;
         return *this;
       }
 
-      void server::on_start() { socket_server::set_non_blocking(false); }
+      void server::set_threads(unsigned value) { threads_ = value; }
+
+      unsigned server::threads() const noexcept {
+        return pool_ ? pool_->threads() : threads_;
+      }
+
+      void server::set_legacy(bool value) { legacy_ = value; }
+
+      bool server::is_legacy() const noexcept { return legacy_; }
+
+      size_t server::connections() const {
+        std::lock_guard<std::mutex> lock(sockets_mutex_);
+
+        return sockets_.size();
+      }
+
+      void server::on_start() {
+#ifdef EPOLL_FOUND
+        if (!legacy_) {
+          socket_server::set_non_blocking(true);
+
+          poller_ = epoll_create1(0);
+
+          wakeup_ = eventfd(0, EFD_NONBLOCK);
+
+          struct epoll_event event;
+
+          memset(&event, 0, sizeof(epoll_event));
+
+          event.events = EPOLLIN;
+          event.data.fd = raw_socket();
+
+          bool ready = poller_ != INVALID && wakeup_ != INVALID &&
+                       epoll_ctl(poller_, EPOLL_CTL_ADD, raw_socket(),
+                                 &event) != INVALID;
+
+          event.data.fd = wakeup_;
+
+          if (ready && epoll_ctl(poller_, EPOLL_CTL_ADD, wakeup_, &event) !=
+                           INVALID) {
+            pool_ = std::make_shared<thread_pool>(threads_);
+            return;
+          }
+
+          // fall back to a thread per connection
+          if (poller_ != INVALID) {
+            ::close(poller_);
+            poller_ = INVALID;
+          }
+
+          if (wakeup_ != INVALID) {
+            ::close(wakeup_);
+            wakeup_ = INVALID;
+          }
+        }
+#endif
+        socket_server::set_non_blocking(false);
+      }
+
+      void server::on_stop() {
+#ifdef EPOLL_FOUND
+        // the poll loop sees the server is no longer valid once woken
+        if (wakeup_ != INVALID) {
+          uint64_t value = 1;
+
+          if (::write(wakeup_, &value, sizeof(value)) < 0) {
+            // already signalled
+          }
+        }
+#endif
+      }
+
+      server::socket_type server::on_accept(SOCKET sock,
+                                            sockaddr_storage addr) {
+        auto socket = socket_server::on_accept(sock, addr);
+
+#ifdef EPOLL_FOUND
+        if (!pool_ || !socket || !socket->is_valid()) {
+          return socket;
+        }
+
+        // the listener is non-blocking with a pool, and so the connection
+        // already is, as workers must never block on it
+        socket->add_listener(
+            std::make_shared<detail::connection_listener>(*this));
+
+        {
+          std::lock_guard<std::mutex> lock(sockets_mutex_);
+
+          sockets_[socket->raw_socket()] = socket;
+        }
+
+        if (!arm(socket, EPOLL_CTL_ADD)) {
+          remove_socket(socket->raw_socket(), socket.get());
+        }
+#endif
+
+        return socket;
+      }
 
       void server::run() {
+#ifdef EPOLL_FOUND
+        if (pool_) {
+          struct epoll_event events[MAXEVENTS];
+
+          while (is_valid()) {
+            int n = epoll_wait(poller_, events, MAXEVENTS, -1);
+
+            if (n == INVALID) {
+              if (errno == EINTR) {
+                continue;
+              }
+              break;
+            }
+
+            for (int i = 0; i < n; i++) {
+              if (events[i].data.fd == wakeup_) {
+                continue;
+              }
+
+              if (events[i].data.fd == raw_socket()) {
+                sockaddr_storage addr;
+
+                for (SOCKET infd = accept(addr); infd != INVALID;
+                     infd = accept(addr)) {
+                  on_accept(infd, addr);
+                }
+                continue;
+              }
+
+              socket_type sock;
+
+              {
+                std::lock_guard<std::mutex> lock(sockets_mutex_);
+
+                auto it = sockets_.find(events[i].data.fd);
+
+                if (it == sockets_.end()) {
+                  continue;
+                }
+
+                sock = it->second;
+              }
+
+              uint32_t ready = events[i].events;
+
+              // waits while the pool is full, which slows accepting too
+              if (!pool_->submit([this, sock, ready]() { serve(sock, ready); })) {
+                sock->close();
+              }
+            }
+          }
+
+          pool_->stop();
+          pool_ = nullptr;
+
+          ::close(poller_);
+          poller_ = INVALID;
+
+          ::close(wakeup_);
+          wakeup_ = INVALID;
+
+          std::lock_guard<std::mutex> lock(sockets_mutex_);
+
+          sockets_.clear();
+          return;
+        }
+#endif
+        run_legacy();
+      }
+
+      void server::run_legacy() {
         while (is_valid()) {
           sockaddr_storage addr;
 
@@ -35,6 +258,98 @@ namespace coda {
           on_accept(sys_sock, addr);
         }
       }
+
+      bool server::arm(const socket_type &sock, int op) {
+#ifdef EPOLL_FOUND
+        if (!sock->is_valid()) {
+          return false;
+        }
+
+        struct epoll_event event;
+
+        memset(&event, 0, sizeof(epoll_event));
+
+        event.data.fd = sock->raw_socket();
+
+        // readability stays level triggered, so a peer that has finished
+        // sending is only written to
+        event.events = sock->is_read_closed() ? EPOLLONESHOT : CLIENT_EVENTS;
+
+        // only ask for writability while something is waiting on it
+        if (sock->needs_writable()) {
+          event.events |= EPOLLOUT;
+        }
+
+        return epoll_ctl(poller_, op, sock->raw_socket(), &event) != INVALID;
+#else
+        return false;
+#endif
+      }
+
+      void server::serve(const socket_type &c, uint32_t events) {
+#ifdef EPOLL_FOUND
+        if (!c->is_valid()) {
+          return;
+        }
+
+        if (events & (EPOLLERR | EPOLLHUP)) {
+          c->close();
+          return;
+        }
+
+        // reads until the socket would block, or resumes a secure read or
+        // handshake that was waiting to write
+        if (((events & EPOLLIN) || c->wants_write()) && !c->is_read_closed()) {
+          if (!c->read_to_buffer()) {
+            c->close();
+            return;
+          }
+        }
+
+        // flush new output straight away, or resume a blocked write
+        if (c->has_output() &&
+            (!c->is_write_blocked() || (events & EPOLLOUT))) {
+          if (!c->write_from_buffer()) {
+            c->close();
+            return;
+          }
+        }
+
+        // the peer has finished sending, but may still be waiting on
+        // output queued behind a blocked write
+        if (events & EPOLLRDHUP) {
+          c->stop_reading();
+        }
+
+        if (c->is_finished()) {
+          c->close();
+          return;
+        }
+
+        if (!arm(c, EPOLL_CTL_MOD) && c->is_valid()) {
+          c->close();
+        }
+#endif
+      }
+
+      void server::remove_socket(SOCKET sock, const buffered_socket *value) {
+#ifdef EPOLL_FOUND
+        std::lock_guard<std::mutex> lock(sockets_mutex_);
+
+        auto it = sockets_.find(sock);
+
+        // the descriptor may already belong to a newer connection
+        if (it == sockets_.end() || it->second.get() != value) {
+          return;
+        }
+
+        if (poller_ != INVALID) {
+          epoll_ctl(poller_, EPOLL_CTL_DEL, sock, NULL);
+        }
+
+        sockets_.erase(it);
+#endif
+      }
     } // namespace async
   }   // namespace net
 } // namespace coda
@@ -2,10 +2,27 @@
 #define CODA_NET_SERVER_ASYNC_H
 
 #include "../socket_server.h"
+#include "thread_pool.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 namespace coda {
   namespace net {
     namespace async {
+      namespace detail {
+        class connection_listener;
+      }
+
+      /*!
+       * An asyncronous server.  One thread waits for connections to become
+       * readable or writable and hands their reads and writes to a bounded
+       * pool of worker threads.  A connection is only ever worked on by one
+       * worker at a time.
+       *
+       * In legacy mode, or where epoll is unavailable, each connection runs
+       * client::run() on a thread of its own instead.
+       */
       class server : public coda::net::socket_server {
         public:
         /*!
@@ -36,11 +53,72 @@ namespace coda {
          */
         server &operator=(server &&other);
 
+        /*!
+         * Sets the number of worker threads, zero for one per core.  Must
+         * be set before the server starts.
+         */
+        void set_threads(unsigned value);
+
+        /*!
+         * @returns the number of worker threads
+         */
+        unsigned threads() const noexcept;
+
+        /*!
+         * Runs a thread per connection, driven by client::run(), instead of
+         * the worker pool.  Must be set before the server starts.
+         */
+        void set_legacy(bool value);
+
+        /*!
+         * @returns true if connections run on their own threads
+         */
+        bool is_legacy() const noexcept;
+
+        /*!
+         * @returns the number of connections served by the pool
+         */
+        size_t connections() const;
+
+        protected:
+        virtual socket_type on_accept(SOCKET socket, sockaddr_storage addr);
+
         private:
         void set_non_blocking(bool);
         void on_start();
+        void on_stop();
 
         void run();
+
+        void run_legacy();
+
+        /*!
+         * watches a connection for its next event
+         */
+        bool arm(const socket_type &sock, int op);
+
+        /*!
+         * reads and writes a connection on a worker thread
+         */
+        void serve(const socket_type &sock, uint32_t events);
+
+        void remove_socket(SOCKET sock, const buffered_socket *value);
+
+        bool legacy_;
+
+        unsigned threads_;
+
+        SOCKET poller_;
+
+        SOCKET wakeup_;
+
+        std::shared_ptr<thread_pool> pool_;
+
+        mutable std::mutex sockets_mutex_;
+
+        std::unordered_map<SOCKET, socket_type> sockets_;
+
+        friend class detail::connection_listener;
       };
     } // namespace async
   }   // namespace net
@@ -0,0 +1,155 @@
+#ifndef CODA_NET_SERVER_ASYNC_TASK_H
+#define CODA_NET_SERVER_ASYNC_TASK_H
+
+#ifdef COROUTINES_FOUND
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace coda {
+  namespace net {
+    namespace async {
+      template <typename T = void> class task;
+
+      namespace detail {
+        /*!
+         * resumes whoever awaited the task once it finishes
+         */
+        struct final_awaiter {
+          bool await_ready() const noexcept { return false; }
+
+          template <typename P>
+          std::coroutine_handle<>
+          await_suspend(std::coroutine_handle<P> handle) noexcept {
+            auto continuation = handle.promise().continuation_;
+
+            return continuation ? continuation : std::noop_coroutine();
+          }
+
+          void await_resume() const noexcept {}
+        };
+
+        struct promise_base {
+          std::coroutine_handle<> continuation_;
+          std::exception_ptr error_;
+
+          // tasks are lazy, they start when awaited
+          std::suspend_always initial_suspend() const noexcept { return {}; }
+
+          final_awaiter final_suspend() const noexcept { return {}; }
+
+          void unhandled_exception() noexcept {
+            error_ = std::current_exception();
+          }
+        };
+
+        template <typename T> struct promise : promise_base {
+          std::optional<T> value_;
+
+          task<T> get_return_object() noexcept;
+
+          template <typename V> void return_value(V &&value) {
+            value_.emplace(std::forward<V>(value));
+          }
+
+          T result() {
+            if (error_) {
+              std::rethrow_exception(error_);
+            }
+            return std::move(*value_);
+          }
+        };
+
+        template <> struct promise<void> : promise_base {
+          task<void> get_return_object() noexcept;
+
+          void return_void() const noexcept {}
+
+          void result() {
+            if (error_) {
+              std::rethrow_exception(error_);
+            }
+          }
+        };
+      } // namespace detail
+
+      /*!
+       * A lazily started coroutine producing a T.  Awaiting a task starts
+       * it and suspends the awaiter until it finishes, then returns its
+       * value or rethrows its exception.  Tasks are move only and destroy
+       * their coroutine when they go.
+       */
+      template <typename T> class task {
+        public:
+        typedef detail::promise<T> promise_type;
+        typedef std::coroutine_handle<promise_type> handle_type;
+
+        task() noexcept : handle_(nullptr) {}
+
+        explicit task(handle_type handle) noexcept : handle_(handle) {}
+
+        task(const task &other) = delete;
+
+        task(task &&other) noexcept : handle_(other.handle_) {
+          other.handle_ = nullptr;
+        }
+
+        ~task() {
+          if (handle_) {
+            handle_.destroy();
+          }
+        }
+
+        task &operator=(const task &other) = delete;
+
+        task &operator=(task &&other) noexcept {
+          if (this != &other) {
+            if (handle_) {
+              handle_.destroy();
+            }
+            handle_ = other.handle_;
+            other.handle_ = nullptr;
+          }
+          return *this;
+        }
+
+        /*!
+         * @returns true if the task has run to completion
+         */
+        bool is_done() const noexcept { return !handle_ || handle_.done(); }
+
+        bool await_ready() const noexcept { return is_done(); }
+
+        // transfer straight into the task, so chains of awaits do not
+        // grow the stack
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<> awaiter) noexcept {
+          handle_.promise().continuation_ = awaiter;
+          return handle_;
+        }
+
+        T await_resume() { return handle_.promise().result(); }
+
+        private:
+        handle_type handle_;
+      };
+
+      namespace detail {
+        template <typename T> task<T> promise<T>::get_return_object() noexcept {
+          return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+        }
+
+        inline task<void> promise<void>::get_return_object() noexcept {
+          return task<void>(
+              std::coroutine_handle<promise<void>>::from_promise(*this));
+        }
+      } // namespace detail
+    } // namespace async
+  }   // namespace net
+} // namespace coda
+
+#endif
+
+#endif
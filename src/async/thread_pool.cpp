@@ -0,0 +1,171 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace coda {
+  namespace net {
+    namespace async {
+      namespace detail {
+        // the pool and queue of the worker running on this thread
+        thread_local thread_pool *current_pool = nullptr;
+        thread_local unsigned current_worker = 0;
+      } // namespace detail
+
+      thread_pool::thread_pool(unsigned threads, size_t capacity)
+          : pending_(0), next_(0), capacity_(std::max<size_t>(capacity, 1)),
+            stopped_(false) {
+        if (threads == 0) {
+          threads = std::max(std::thread::hardware_concurrency(), 1U);
+        }
+
+        for (unsigned i = 0; i < threads; i++) {
+          workers_.emplace_back(new worker());
+        }
+
+        for (unsigned i = 0; i < threads; i++) {
+          threads_.emplace_back(&thread_pool::work, this, i);
+        }
+      }
+
+      thread_pool::~thread_pool() { stop(); }
+
+      bool thread_pool::submit(task_type task) {
+        if (!task) {
+          return false;
+        }
+
+        bool local = detail::current_pool == this;
+
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+
+          if (stopped_) {
+            return false;
+          }
+
+          if (pending_ >= capacity_) {
+            // waiting on ourselves would never end
+            if (local) {
+              lock.unlock();
+              task();
+              return true;
+            }
+
+            space_.wait(lock,
+                        [this]() { return stopped_ || pending_ < capacity_; });
+
+            if (stopped_) {
+              return false;
+            }
+          }
+
+          pending_++;
+        }
+
+        // a worker keeps its own tasks, others are spread round robin
+        unsigned index = local ? detail::current_worker
+                               : next_++ % workers_.size();
+
+        {
+          std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+
+          workers_[index]->tasks.push_back(std::move(task));
+        }
+
+        ready_.notify_one();
+
+        return true;
+      }
+
+      void thread_pool::stop() {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+
+          if (stopped_) {
+            return;
+          }
+
+          stopped_ = true;
+        }
+
+        ready_.notify_all();
+        space_.notify_all();
+
+        for (auto &thread : threads_) {
+          if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();
+          } else if (thread.joinable()) {
+            thread.join();
+          }
+        }
+
+        threads_.clear();
+      }
+
+      unsigned thread_pool::threads() const noexcept {
+        return static_cast<unsigned>(workers_.size());
+      }
+
+      size_t thread_pool::pending() const noexcept { return pending_; }
+
+      void thread_pool::work(unsigned index) {
+        detail::current_pool = this;
+        detail::current_worker = index;
+
+        for (;;) {
+          task_type task;
+
+          if (take(index, task)) {
+            // wake a submitter blocked on a full pool
+            if (pending_-- == capacity_) {
+              std::lock_guard<std::mutex> lock(mutex_);
+              space_.notify_all();
+            }
+
+            task();
+            continue;
+          }
+
+          std::unique_lock<std::mutex> lock(mutex_);
+
+          ready_.wait(lock, [this]() { return stopped_ || pending_ > 0; });
+
+          if (stopped_ && pending_ == 0) {
+            break;
+          }
+        }
+
+        detail::current_pool = nullptr;
+      }
+
+      bool thread_pool::take(unsigned index, task_type &task) {
+        // newest first from our own queue, it is most likely still cached
+        {
+          auto &own = *workers_[index];
+
+          std::lock_guard<std::mutex> lock(own.mutex);
+
+          if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+          }
+        }
+
+        // then the oldest from someone else's
+        for (size_t i = 1; i < workers_.size(); i++) {
+          auto &other = *workers_[(index + i) % workers_.size()];
+
+          std::unique_lock<std::mutex> lock(other.mutex, std::try_to_lock);
+
+          if (lock.owns_lock() && !other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            return true;
+          }
+        }
+
+        return false;
+      }
+    } // namespace async
+  }   // namespace net
+} // namespace coda
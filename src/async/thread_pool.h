@@ -0,0 +1,99 @@
+#ifndef CODA_NET_SERVER_ASYNC_THREAD_POOL_H
+#define CODA_NET_SERVER_ASYNC_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    namespace async {
+      /*!
+       * A fixed set of worker threads, each with its own task queue.  A
+       * worker takes the newest task from its own queue and, when that is
+       * empty, steals the oldest task from another.  The number of waiting
+       * tasks is bounded, so a full pool pushes back on whoever submits.
+       */
+      class thread_pool {
+        public:
+        typedef std::function<void()> task_type;
+
+        static const size_t DEFAULT_CAPACITY = 4096;
+
+        /*!
+         * @param threads the number of workers, zero for one per core
+         * @param capacity the most tasks that can wait at once
+         */
+        thread_pool(unsigned threads = 0, size_t capacity = DEFAULT_CAPACITY);
+
+        thread_pool(const thread_pool &other) = delete;
+        thread_pool(thread_pool &&other) = delete;
+
+        /*!
+         * runs the waiting tasks and joins the workers
+         */
+        virtual ~thread_pool();
+
+        thread_pool &operator=(const thread_pool &other) = delete;
+        thread_pool &operator=(thread_pool &&other) = delete;
+
+        /*!
+         * Queues a task, waiting while the pool is full.  A worker of this
+         * pool submitting to a full pool runs the task itself instead.
+         * @returns false if the pool has been stopped
+         */
+        bool submit(task_type task);
+
+        /*!
+         * runs the waiting tasks and joins the workers
+         */
+        void stop();
+
+        /*!
+         * @returns the number of workers
+         */
+        unsigned threads() const noexcept;
+
+        /*!
+         * @returns the number of waiting tasks
+         */
+        size_t pending() const noexcept;
+
+        private:
+        struct worker {
+          std::mutex mutex;
+          std::deque<task_type> tasks;
+        };
+
+        void work(unsigned index);
+
+        bool take(unsigned index, task_type &task);
+
+        std::vector<std::unique_ptr<worker>> workers_;
+
+        std::vector<std::thread> threads_;
+
+        std::mutex mutex_;
+
+        std::condition_variable ready_;
+
+        std::condition_variable space_;
+
+        std::atomic<size_t> pending_;
+
+        std::atomic<unsigned> next_;
+
+        size_t capacity_;
+
+        bool stopped_;
+      };
+    } // namespace async
+  }   // namespace net
+} // namespace coda
+
+#endif
@@ -0,0 +1,133 @@
+#include "buffer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace coda {
+  namespace net {
+    buffer::buffer() noexcept : head_(0), tail_(0) {}
+
+    buffer::buffer(size_t capacity) : storage_(capacity), head_(0), tail_(0) {}
+
+    buffer::buffer(const buffer &other)
+        : storage_(other.begin(), other.end()), head_(0),
+          tail_(other.size()) {}
+
+    buffer::buffer(buffer &&other) noexcept
+        : storage_(std::move(other.storage_)), head_(other.head_),
+          tail_(other.tail_) {
+      other.head_ = 0;
+      other.tail_ = 0;
+    }
+
+    buffer &buffer::operator=(const buffer &other) {
+      if (this != &other) {
+        storage_.assign(other.begin(), other.end());
+        head_ = 0;
+        tail_ = storage_.size();
+      }
+      return *this;
+    }
+
+    buffer &buffer::operator=(buffer &&other) noexcept {
+      storage_ = std::move(other.storage_);
+      head_ = other.head_;
+      tail_ = other.tail_;
+      other.head_ = 0;
+      other.tail_ = 0;
+      return *this;
+    }
+
+    buffer::view buffer::readable() const noexcept {
+      return view(data(), size());
+    }
+
+    buffer::span buffer::writable() noexcept {
+      return span(storage_.data() + tail_, storage_.size() - tail_);
+    }
+
+    buffer::span buffer::prepare(size_t size) {
+      if (storage_.size() - tail_ < size) {
+        reserve(size);
+      }
+      return writable();
+    }
+
+    void buffer::commit(size_t size) noexcept {
+      tail_ = std::min(tail_ + size, storage_.size());
+    }
+
+    void buffer::consume(size_t size) noexcept {
+      head_ += std::min(size, tail_ - head_);
+
+      // an empty buffer can rewind for free
+      if (head_ == tail_) {
+        head_ = tail_ = 0;
+      }
+    }
+
+    void buffer::truncate(size_t size) noexcept {
+      tail_ -= std::min(size, tail_ - head_);
+
+      if (head_ == tail_) {
+        head_ = tail_ = 0;
+      }
+    }
+
+    buffer &buffer::append(const void *data, size_t size) {
+      if (data == nullptr || size == 0) {
+        return *this;
+      }
+
+      auto space = prepare(size);
+
+      memcpy(space.data(), data, size);
+
+      commit(size);
+
+      return *this;
+    }
+
+    void buffer::clear() noexcept { head_ = tail_ = 0; }
+
+    size_t buffer::size() const noexcept { return tail_ - head_; }
+
+    bool buffer::empty() const noexcept { return head_ == tail_; }
+
+    size_t buffer::capacity() const noexcept { return storage_.size(); }
+
+    const buffer::data_type *buffer::data() const noexcept {
+      return storage_.data() + head_;
+    }
+
+    const buffer::data_type *buffer::begin() const noexcept { return data(); }
+
+    const buffer::data_type *buffer::end() const noexcept {
+      return storage_.data() + tail_;
+    }
+
+    void buffer::reserve(size_t size) {
+      auto used = tail_ - head_;
+
+      // reclaim consumed space before growing, but only once it outweighs the
+      // unread bytes so the copies stay amortized
+      if (head_ >= used && storage_.size() - used >= size) {
+        memmove(storage_.data(), storage_.data() + head_, used);
+        head_ = 0;
+        tail_ = used;
+        return;
+      }
+
+      auto capacity = std::max(storage_.size() * 2, used + size);
+
+      capacity = std::max(capacity, DEFAULT_CAPACITY);
+
+      if (head_ > 0) {
+        memmove(storage_.data(), storage_.data() + head_, used);
+        head_ = 0;
+        tail_ = used;
+      }
+
+      storage_.resize(capacity);
+    }
+  } // namespace net
+} // namespace coda
@@ -0,0 +1,144 @@
+#ifndef CODA_NET_BUFFER_H
+#define CODA_NET_BUFFER_H
+
+#include <cstddef>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    /*!
+     * A non-owning range of contiguous bytes
+     */
+    template <typename T> class basic_span {
+      public:
+      typedef T value_type;
+      typedef T *iterator;
+
+      basic_span() noexcept : data_(nullptr), size_(0) {}
+
+      basic_span(T *data, size_t size) noexcept : data_(data), size_(size) {}
+
+      T *data() const noexcept { return data_; }
+
+      size_t size() const noexcept { return size_; }
+
+      bool empty() const noexcept { return size_ == 0; }
+
+      T *begin() const noexcept { return data_; }
+
+      T *end() const noexcept { return data_ + size_; }
+
+      T &operator[](size_t index) const noexcept { return data_[index]; }
+
+      private:
+      T *data_;
+      size_t size_;
+    };
+
+    /*!
+     * A byte buffer with a read cursor and a write cursor over contiguous
+     * storage. Consuming from the front only moves the read cursor, and the
+     * unread bytes are compacted to the front only when the tail runs out of
+     * room, so line-by-line reads are amortized O(1).
+     */
+    class buffer {
+      public:
+      typedef unsigned char data_type;
+
+      /*!
+       * a read only view of the readable bytes
+       */
+      typedef basic_span<const data_type> view;
+
+      /*!
+       * a writable region at the tail of the buffer
+       */
+      typedef basic_span<data_type> span;
+
+      /*!
+       * the default number of bytes reserved on first use
+       */
+      static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+      buffer() noexcept;
+
+      explicit buffer(size_t capacity);
+
+      buffer(const buffer &other);
+
+      buffer(buffer &&other) noexcept;
+
+      buffer &operator=(const buffer &other);
+
+      buffer &operator=(buffer &&other) noexcept;
+
+      /*!
+       * @returns the readable bytes
+       */
+      view readable() const noexcept;
+
+      /*!
+       * @returns the writable space at the tail, without growing
+       */
+      span writable() noexcept;
+
+      /*!
+       * Ensures at least size bytes can be written at the tail
+       * @returns the writable region, which may be larger than requested
+       */
+      span prepare(size_t size);
+
+      /*!
+       * Marks size bytes of the prepared region as readable
+       */
+      void commit(size_t size) noexcept;
+
+      /*!
+       * Discards size bytes from the front of the readable bytes
+       */
+      void consume(size_t size) noexcept;
+
+      /*!
+       * Removes the last size readable bytes
+       */
+      void truncate(size_t size) noexcept;
+
+      /*!
+       * Copies bytes to the tail of the buffer
+       */
+      buffer &append(const void *data, size_t size);
+
+      /*!
+       * discards all readable bytes, keeping the storage
+       */
+      void clear() noexcept;
+
+      /*!
+       * @returns the number of readable bytes
+       */
+      size_t size() const noexcept;
+
+      bool empty() const noexcept;
+
+      /*!
+       * @returns the total storage reserved
+       */
+      size_t capacity() const noexcept;
+
+      const data_type *data() const noexcept;
+
+      const data_type *begin() const noexcept;
+
+      const data_type *end() const noexcept;
+
+      private:
+      void reserve(size_t size);
+
+      std::vector<data_type> storage_;
+      size_t head_;
+      size_t tail_;
+    };
+  } // namespace net
+} // namespace coda
+
+#endif
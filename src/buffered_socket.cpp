@@ -2,6 +2,7 @@
 #include "buffered_socket.h"
 #include "exception.h"
 #include <algorithm>
+#include <climits>
 #include <cstring>
 
 using namespace std;
@@ -10,18 +11,31 @@ namespace coda {
   namespace net {
     static const socket::data_buffer NEWLINE = {'\r', '\n'};
 
-    buffered_socket::buffered_socket() : socket() {}
+#ifdef IOV_MAX
+    static const int MAX_IOV = IOV_MAX;
+#else
+    static const int MAX_IOV = 16;
+#endif
+
+    buffered_socket::buffered_socket()
+        : socket(), write_blocked_(false), write_in_flight_(false),
+          read_closed_(false) {}
 
     buffered_socket::buffered_socket(SOCKET sock, const sockaddr_storage &addr)
-        : socket(sock, addr) {}
+        : socket(sock, addr), write_blocked_(false),
+          write_in_flight_(false), read_closed_(false) {}
 
     buffered_socket::buffered_socket(const std::string &host, const int port)
-        : socket(host, port) {}
+        : socket(host, port), write_blocked_(false),
+          write_in_flight_(false), read_closed_(false) {}
 
     buffered_socket::buffered_socket(buffered_socket &&other)
         : socket(std::move(other)), inBuffer_(std::move(other.inBuffer_)),
           outBuffer_(std::move(other.outBuffer_)),
-          listeners_(std::move(other.listeners_)) {}
+          listeners_(std::move(other.listeners_)),
+          write_blocked_(other.write_blocked_),
+          write_in_flight_(other.write_in_flight_),
+          read_closed_(other.read_closed_) {}
 
     buffered_socket::~buffered_socket() {}
 
@@ -31,6 +45,9 @@ namespace coda {
       inBuffer_ = std::move(other.inBuffer_);
       outBuffer_ = std::move(other.outBuffer_);
       listeners_ = std::move(other.listeners_);
+      write_blocked_ = other.write_blocked_;
+      write_in_flight_ = other.write_in_flight_;
+      read_closed_ = other.read_closed_;
 
       return *this;
     }
@@ -50,12 +67,13 @@ namespace coda {
       return false;
     }
 
-    bool buffered_socket::read_chunk(data_buffer &chunk) {
+    bool buffered_socket::read_chunk() {
       if (!is_valid()) {
         return false;
       }
 
-      int status = socket::recv(chunk);
+      // read straight into the tail of the input buffer
+      int status = socket::recv_into(inBuffer_);
 
       if (status < 0) {
         if (errno == EINTR) {
@@ -73,7 +91,13 @@ namespace coda {
         throw socket_exception(strerror(errno));
       }
 
-      return status > 0;
+      // the peer has finished sending
+      if (status == 0) {
+        read_closed_ = true;
+        return false;
+      }
+
+      return true;
     }
 
     //! reads from the socket into an internal input buffer
@@ -81,21 +105,40 @@ namespace coda {
      * @returns     true if successful
      */
     bool buffered_socket::read_to_buffer() {
-      data_buffer chunk;
-
-      notify_will_read();
+      // nothing more will arrive
+      if (read_closed_) {
+        return true;
+      }
 
       try {
-        if (!read_chunk(chunk)) {
+        // there is nothing to read until a secure session is set up
+        if (is_handshaking() && !handshake()) {
           return true;
         }
 
-        // while not an error or the peer connection was closed
-        do {
-          inBuffer_.insert(inBuffer_.end(), chunk.begin(), chunk.end());
-        } while (is_non_blocking() && read_chunk(chunk));
+        notify_will_read();
+
+        if (!read_chunk()) {
+          return true;
+        }
 
-        notify_did_read();
+        size_t seen = inBuffer_.size();
+
+        // while not an error or the peer connection was closed, and
+        // whatever the secure layer has already decrypted
+        while ((is_non_blocking() || pending() > 0) && read_chunk()) {
+          // a peer sending as fast as it is read would otherwise keep the
+          // listeners waiting, and the input growing, for as long as it can
+          if (inBuffer_.size() - seen >= READ_BATCH) {
+            notify_did_read();
+            seen = inBuffer_.size();
+          }
+        }
+
+        // a listener may have closed the socket part way
+        if (is_valid()) {
+          notify_did_read();
+        }
       } catch (const socket_exception &e) {
         return false;
       }
@@ -103,6 +146,34 @@ namespace coda {
       return true;
     }
 
+    //! appends bytes recieved elsewhere into the input buffer
+    bool buffered_socket::read_to_buffer(const void *data, size_t size) {
+      if (!is_valid()) {
+        return false;
+      }
+
+      if (data == nullptr || size == 0) {
+        return true;
+      }
+
+      // records are decrypted by the secure layer, and read back from it
+      if (is_secure()) {
+        return feed_records(data, size) && read_to_buffer();
+      }
+
+      notify_will_read();
+
+      auto space = inBuffer_.prepare(size);
+
+      memcpy(space.data(), data, size);
+
+      inBuffer_.commit(on_recv(space.data(), size));
+
+      notify_did_read();
+
+      return true;
+    }
+
     //! Reads a line from the internal input buffer
     /*!
      * @returns a line from the buffer
@@ -111,25 +182,21 @@ namespace coda {
       if (inBuffer_.empty())
         return string();
 
-      /* find a new line  */
-      auto pos = find_first_of(inBuffer_.begin(), inBuffer_.end(),
-                               NEWLINE.begin(), NEWLINE.end());
+      auto input = inBuffer_.readable();
 
-      if (pos == inBuffer_.end()) {
-        string temp(inBuffer_.begin(), inBuffer_.end());
-        inBuffer_.clear();
-        return temp;
-      }
+      /* find a new line  */
+      auto pos = find_first_of(input.begin(), input.end(), NEWLINE.begin(),
+                               NEWLINE.end());
 
-      string temp(inBuffer_.begin(), pos);
+      string temp(input.begin(), pos);
 
       /* Skip all new line characters, squelching blank lines */
-      while (pos != inBuffer_.end() &&
+      while (pos != input.end() &&
              find(NEWLINE.begin(), NEWLINE.end(), *pos) != NEWLINE.end()) {
         pos++;
       }
 
-      inBuffer_.erase(inBuffer_.begin(), pos);
+      inBuffer_.consume(pos - input.begin());
 
       return temp;
     }
@@ -137,35 +204,116 @@ namespace coda {
     //! tests if the internal input buffer has content
     bool buffered_socket::has_input() const { return !inBuffer_.empty(); }
 
-    //! gets the internal data buffer
-    const socket::data_buffer &buffered_socket::input() const {
-      return inBuffer_;
+    //! gets the unread input
+    buffer::view buffered_socket::input() const {
+      return inBuffer_.readable();
     }
 
     //! tests internal output buffer for content
-    bool buffered_socket::has_output() const { return !outBuffer_.empty(); }
+    bool buffered_socket::has_output() const {
+      // records a secure layer made are output the socket hasn't taken yet
+      return !outBuffer_.empty() || pending_records() > 0;
+    }
+
+    //! the number of bytes left to send
+    size_t buffered_socket::pending_output() const {
+      return outBuffer_.size() + pending_records();
+    }
+
+    //! tests if the last write filled the socket send buffer
+    bool buffered_socket::is_write_blocked() const { return write_blocked_; }
+
+    //! tests if the peer has finished sending
+    bool buffered_socket::is_read_closed() const { return read_closed_; }
+
+    //! stops reading once the peer has finished sending
+    void buffered_socket::stop_reading() { read_closed_ = true; }
+
+    //! tests if the socket has nothing left to read or send
+    bool buffered_socket::is_finished() const {
+      return read_closed_ && !has_output();
+    }
+
+    //! tests if a reactor should watch for writability
+    bool buffered_socket::needs_writable() const {
+      if (wants_write()) {
+        return true;
+      }
+
+      // output waits for the handshake, and a send waiting on a read is
+      // retried when the socket is readable
+      if (is_handshaking() && is_non_blocking()) {
+        return false;
+      }
 
-    //! the internal output buffer
-    const socket::data_buffer &buffered_socket::output() const {
-      return outBuffer_;
+      return has_output() && !send_wants_read();
+    }
+
+    //! the unsent output
+    buffer::view buffered_socket::output() const {
+      // an asynchronous send still points into the queued segments
+      if (write_in_flight_) {
+        struct iovec iov;
+
+        if (outBuffer_.gather(&iov, 1) != 1) {
+          return buffer::view();
+        }
+
+        return buffer::view(static_cast<const data_type *>(iov.iov_base),
+                            iov.iov_len);
+      }
+
+      return outBuffer_.flatten();
     }
 
     //! writes a string to the output buffer and an appending new line
     buffered_socket &buffered_socket::writeln(const string &value) {
-      outBuffer_.insert(outBuffer_.end(), value.begin(), value.end());
-      outBuffer_.insert(outBuffer_.end(), NEWLINE.begin(), NEWLINE.end());
+      outBuffer_.append(value.data(), value.size());
+      outBuffer_.append(NEWLINE.data(), NEWLINE.size());
       return *this;
     }
 
     //! writes a new line to the output buffer
     buffered_socket &buffered_socket::writeln() {
-      outBuffer_.insert(outBuffer_.end(), NEWLINE.begin(), NEWLINE.end());
+      outBuffer_.append(NEWLINE.data(), NEWLINE.size());
       return *this;
     }
 
-    //!
+    //! writes a string to the output buffer
     buffered_socket &buffered_socket::write(const string &value) {
-      outBuffer_.insert(outBuffer_.end(), value.begin(), value.end());
+      outBuffer_.append(value.data(), value.size());
+      return *this;
+    }
+
+    //! writes raw bytes to the output buffer
+    buffered_socket &buffered_socket::write(void *pbuf, size_t sz) {
+      outBuffer_.append(pbuf, sz);
+      return *this;
+    }
+
+    //! moves a string into the output queue
+    buffered_socket &buffered_socket::write(string &&value) {
+      outBuffer_.append(std::move(value));
+      return *this;
+    }
+
+    //! moves bytes into the output queue
+    buffered_socket &buffered_socket::write(data_buffer &&value) {
+      outBuffer_.append(std::move(value));
+      return *this;
+    }
+
+    //! queues a shared string by reference
+    buffered_socket &
+    buffered_socket::write(const std::shared_ptr<const string> &value) {
+      outBuffer_.append(value);
+      return *this;
+    }
+
+    //! queues shared bytes by reference
+    buffered_socket &
+    buffered_socket::write(const std::shared_ptr<const data_buffer> &value) {
+      outBuffer_.append(value);
       return *this;
     }
 
@@ -196,26 +344,116 @@ namespace coda {
     }
 
     //! will write the output buffer to the socket
+    /*!
+     * Sends as much of the output queue as the socket will take. Whatever is
+     * not sent stays queued, and listeners are only told about the write once
+     * the queue has drained.
+     */
     bool buffered_socket::write_from_buffer() {
       if (!is_valid()) {
         return false;
       }
 
-      if (outBuffer_.empty()) {
+      write_blocked_ = false;
+
+      // an asynchronous send owns the queue until it completes
+      if (!has_output() || write_in_flight_) {
+        return true;
+      }
+
+      // output waits for a secure session being set up by the reactor
+      if (is_handshaking() && is_non_blocking()) {
         return true;
       }
 
       notify_will_write();
 
-      if (send(outBuffer_) != static_cast<int>(outBuffer_.size())) {
+      struct iovec iov[MAX_IOV];
+
+      while (!outBuffer_.empty()) {
+        int count = outBuffer_.gather(iov, MAX_IOV);
+
+        size_t size = 0;
+
+        for (int i = 0; i < count; i++) {
+          size += iov[i].iov_len;
+        }
+
+        int status = sendv(iov, count);
+
+        if (status < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+
+          // a secure send may be waiting on a read instead
+          if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            write_blocked_ = !send_wants_read();
+            return true;
+          }
+
+          return false;
+        }
+
+        if (status == 0) {
+          return false;
+        }
+
+        outBuffer_.consume(status);
+
+        // the send buffer is full, resume when the socket is writable.  A
+        // secure layer that sent all it encrypted only stopped at its bound.
+        if (static_cast<size_t>(status) < size && is_non_blocking() &&
+            (!is_secure() || pending_records() > 0)) {
+          write_blocked_ = !send_wants_read();
+          return true;
+        }
+      }
+
+      // what a secure layer encrypted ahead of the socket is sent too
+      if (pending_records() > 0 && send_records() < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          write_blocked_ = !send_wants_read();
+          return true;
+        }
+
         return false;
       }
 
-      outBuffer_.clear();
       notify_did_write();
       return true;
     }
 
+    //! gathers output for an asynchronous send
+    int buffered_socket::prepare_write(struct iovec *iov, int count) {
+      if (!is_valid() || outBuffer_.empty() || write_in_flight_) {
+        return 0;
+      }
+
+      notify_will_write();
+
+      outBuffer_.seal();
+
+      write_in_flight_ = true;
+
+      return outBuffer_.gather(iov, count);
+    }
+
+    //! completes an asynchronous send
+    void buffered_socket::commit_write(size_t size) {
+      if (!write_in_flight_) {
+        return;
+      }
+
+      write_in_flight_ = false;
+
+      outBuffer_.consume(size);
+
+      if (outBuffer_.empty()) {
+        notify_did_write();
+      }
+    }
+
     /*!
      * default implementations do nothing
      */
@@ -1,6 +1,8 @@
 #ifndef CODA_NET_BUFFERED_SOCKET_H
 #define CODA_NET_BUFFERED_SOCKET_H
 
+#include "buffer.h"
+#include "output_queue.h"
 #include "socket.h"
 #include <memory>
 #include <string>
@@ -55,6 +57,11 @@ namespace coda {
       public:
       typedef std::shared_ptr<buffered_socket_listener> listener_type;
 
+      /*!
+       * listeners are told about each batch this size while reading
+       */
+      static constexpr size_t READ_BATCH = 256 * 1024;
+
       /*!
        * Default constructor accepts a raw socket and its address
        */
@@ -100,11 +107,19 @@ namespace coda {
       virtual bool connect(const std::string &host, const int port);
 
       /*!
-       * Reads data from the socket into the read buffer
+       * Reads data from the socket into the read buffer.  A peer that has
+       * finished sending is not an error, see is_read_closed().
        * @returns true if no errors occured
        */
       bool read_to_buffer();
 
+      /*!
+       * Appends bytes that were recieved elsewhere, such as by a completion
+       * based poller, to the read buffer and notifies listeners
+       * @returns true if no errors occured
+       */
+      bool read_to_buffer(const void *data, size_t size);
+
       /*!
        * Reads a line from the read buffer
        */
@@ -131,9 +146,29 @@ namespace coda {
       buffered_socket &write(void *pbuf, size_t sz);
 
       /*!
-       * @returns the read buffer
+       * Moves a string into the write queue without copying it
+       */
+      buffered_socket &write(std::string &&value);
+
+      /*!
+       * Moves a block of bytes into the write queue without copying it
        */
-      const data_buffer &input() const;
+      buffered_socket &write(data_buffer &&value);
+
+      /*!
+       * Queues a shared immutable string by reference
+       */
+      buffered_socket &write(const std::shared_ptr<const std::string> &value);
+
+      /*!
+       * Queues a shared immutable block of bytes by reference
+       */
+      buffered_socket &write(const std::shared_ptr<const data_buffer> &value);
+
+      /*!
+       * @returns a view of the unread bytes in the read buffer
+       */
+      buffer::view input() const;
 
       /*!
        * @returns true if the read buffer contains data
@@ -141,21 +176,76 @@ namespace coda {
       bool has_input() const;
 
       /*!
-       * @returns the write buffer
+       * @returns a view of the unsent bytes in the write buffer, coalescing
+       * any queued segments.  While an asynchronous send is in flight the
+       * segments can't be moved, so only the first one is viewed.
        */
-      const data_buffer &output() const;
+      buffer::view output() const;
 
       /*!
-       * @returns true if the write buffer contains data
+       * @returns true if the write buffer contains data, or a secure layer
+       * has records the socket hasn't taken yet
        */
       bool has_output() const;
 
       /*!
-       * Will write the buffer to the actual socket
+       * @returns the number of bytes waiting to be sent
+       */
+      size_t pending_output() const;
+
+      /*!
+       * @returns true if the last write stopped because the socket could not
+       * take more data, and output should wait until it is writable again
+       */
+      bool is_write_blocked() const;
+
+      /*!
+       * @returns true once the peer has finished sending, after which the
+       * socket is no longer read
+       */
+      bool is_read_closed() const;
+
+      /*!
+       * Stops reading, as the peer has finished sending.  Output already
+       * queued is still sent.
+       */
+      void stop_reading();
+
+      /*!
+       * @returns true if the peer has finished sending and there is nothing
+       * left to send it, so the socket can be closed
+       */
+      bool is_finished() const;
+
+      /*!
+       * @returns true if a reactor should wait for the socket to be writable:
+       * output is queued and not waiting on a read, or the secure layer is
+       * waiting to write
+       */
+      bool needs_writable() const;
+
+      /*!
+       * Will write the buffer to the actual socket, gathering queued segments
+       * into as few system calls as possible.  On a non blocking socket any
+       * unsent remainder stays queued for the next call.
        * @returns true if no errors occured
        */
       bool write_from_buffer();
 
+      /*!
+       * Gathers queued output for an asynchronous send.  The gathered bytes
+       * stay in place until commit_write() is called, and write_from_buffer()
+       * will not send them again in the meantime.
+       * @returns the number of io vectors filled
+       */
+      int prepare_write(struct iovec *iov, int count);
+
+      /*!
+       * Completes an asynchronous send started by prepare_write()
+       * @param size the number of bytes actually sent
+       */
+      void commit_write(size_t size);
+
       /*!
        * Appends some data to the write buffer
        */
@@ -188,8 +278,8 @@ namespace coda {
       virtual void on_close();
 
       /* the actual buffers */
-      data_buffer inBuffer_;
-      data_buffer outBuffer_;
+      buffer inBuffer_;
+      output_queue outBuffer_;
 
       private:
       /*!
@@ -207,9 +297,15 @@ namespace coda {
 
       void notify_close();
 
-      bool read_chunk(data_buffer &chunk);
+      bool read_chunk();
 
       std::vector<listener_type> listeners_;
+
+      bool write_blocked_;
+
+      bool write_in_flight_;
+
+      bool read_closed_;
     };
   } // namespace net
 } // namespace coda
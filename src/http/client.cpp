@@ -6,6 +6,7 @@
 #include "../socket.h"
 #include "../uri.h"
 #include "client.h"
+#include "parser.h"
 #include <cinttypes>
 
 using namespace std;
@@ -15,17 +16,6 @@ using namespace std;
 namespace coda {
   namespace net {
     namespace http {
-      namespace helper {
-        size_t skip_newline(const string &s, size_t pos) {
-          for (int i = 0; i < 2; i++, pos++) {
-            if (s[pos] != '\r' && s[pos] != '\n')
-              break;
-          }
-
-          return pos;
-        }
-      } // namespace helper
-
       transfer::transfer() : version_(http::VERSION_1_1) {}
 
       transfer::transfer(const transfer &other)
@@ -125,53 +115,25 @@ namespace coda {
       }
 
       void response::parse() {
-        auto pos = value_.find("\r\n");
-
-        if (pos == string::npos) {
-          content_ = value_;
-          return;
-        }
-
-        string line = value_.substr(0, pos);
-
-        char buf[http::MAX_URL_LEN + 1] = {0};
+        response_head head;
 
-        char version[http::MAX_URL_LEN + 1] = {0};
+        int length = parse_response(value_.data(), value_.size(), head);
 
-        if (sscanf(line.c_str(), http::RESPONSE_PREAMBLE, version, &code_,
-                   buf) != 3) {
+        if (length < 0) {
           content_ = value_;
           return;
         }
 
-        version_ = version;
-
-        pos = helper::skip_newline(value_, pos);
-
-        while (!line.empty()) {
-          auto next = value_.find("\r\n", pos);
+        code_ = head.code;
 
-          if (next == string::npos)
-            break;
+        version_ = "1." + std::to_string(head.minor_version);
 
-          line = value_.substr(pos, next - pos);
-
-          auto sep = line.find(':');
-
-          if (sep != string::npos) {
-            auto key = line.substr(0, sep);
-
-            auto value = line.substr(sep + 2);
-
-            headers_[key] = value;
-          }
-
-          pos = helper::skip_newline(value_, next);
+        for (size_t i = 0; i < head.header_count; i++) {
+          headers_[string(head.headers[i].name)] =
+              string(head.headers[i].value);
         }
 
-        if (pos != string::npos) {
-          content_ = value_.substr(pos);
-        }
+        content_ = value_.substr(length);
       }
 
       client::client(const coda::net::uri &uri)
@@ -185,18 +147,20 @@ namespace coda {
       client::~client() {}
 
       client::client(const client &other)
-          : transfer(other), uri_(other.uri_), response_(other.response_),
-            timeout_(other.timeout_) {}
+          : transfer(other), uri_(other.uri_), timeout_(other.timeout_),
+            response_(other.response_), body_callback_(other.body_callback_) {}
 
       client::client(client &&other)
           : transfer(std::move(other)), uri_(std::move(other.uri_)),
-            response_(std::move(other.response_)), timeout_(other.timeout_) {}
+            timeout_(other.timeout_), response_(std::move(other.response_)),
+            body_callback_(std::move(other.body_callback_)) {}
 
       client &client::operator=(const client &other) {
         transfer::operator=(other);
         uri_ = other.uri_;
         headers_ = other.headers_;
         timeout_ = other.timeout_;
+        body_callback_ = other.body_callback_;
         return *this;
       }
 
@@ -205,6 +169,7 @@ namespace coda {
         uri_ = std::move(other.uri_);
         response_ = std::move(other.response_);
         timeout_ = other.timeout_;
+        body_callback_ = std::move(other.body_callback_);
         return *this;
       }
 
@@ -241,6 +206,16 @@ namespace coda {
         return *this;
       }
 
+      client &
+      client::set_body_callback(const response_parser::body_callback &value) {
+        body_callback_ = value;
+        return *this;
+      }
+
+      response_parser::body_callback client::body_callback() const {
+        return body_callback_;
+      }
+
       client &client::request(http::method method, const std::string &path,
                               const client::callback &callback) {
         if (!impl_) {
@@ -261,6 +236,40 @@ namespace coda {
         return *this;
       }
 
+      std::future<http::response>
+      client::request_async(http::method method, const std::string &path) {
+        auto promise = std::make_shared<std::promise<http::response>>();
+
+        request_async(method, path,
+                      [promise](const http::response &response,
+                                const char *error) {
+                        if (error != NULL) {
+                          promise->set_exception(
+                              std::make_exception_ptr(socket_exception(error)));
+                        } else {
+                          promise->set_value(response);
+                        }
+                      });
+
+        return promise->get_future();
+      }
+
+      client &client::request_async(http::method method,
+                                    const std::string &path,
+                                    const client::completion &completion) {
+        if (!async_impl_) {
+          throw socket_exception("invalid implementation");
+        }
+
+        if (!uri_.is_valid()) {
+          throw socket_exception("invalid uri");
+        }
+
+        async_impl_(*this, method, path, completion);
+
+        return *this;
+      }
+
       client &client::get(const client::callback &callback) {
         return request(http::GET, uri_.path(), callback);
       }
@@ -293,6 +302,10 @@ namespace coda {
       void client::set_request_type(const implementation &impl) {
         impl_ = impl;
       }
+
+      void client::set_async_request_type(const async_implementation &impl) {
+        async_impl_ = impl;
+      }
     } // namespace http
   }   // namespace net
 } // namespace coda
@@ -2,8 +2,10 @@
 #define CODA_NET_HTTP_CLIENT_H
 
 #include "protocol.h"
+#include "response_parser.h"
 #include "../uri.h"
 #include <functional>
+#include <future>
 #include <map>
 #include <string>
 
@@ -81,10 +83,22 @@ namespace coda {
         public:
         typedef std::function<void(const response &)> callback;
 
+        /*!
+         * receives the response of an asynchronous request, or an error
+         * message with an empty response
+         */
+        typedef std::function<void(const http::response &response,
+                                   const char *error)>
+            completion;
+
         typedef std::function<std::string(http::client &, http::method,
                                           const std::string &)>
             implementation;
 
+        typedef std::function<void(const http::client &, http::method,
+                                   const std::string &, const completion &)>
+            async_implementation;
+
         public:
         client(const coda::net::uri &uri);
         client(const std::string &uri);
@@ -96,6 +110,8 @@ namespace coda {
 
         static void set_request_type(const implementation &impl);
 
+        static void set_async_request_type(const async_implementation &impl);
+
         /*!
          * adds an HTTP header to the request
          */
@@ -144,6 +160,23 @@ namespace coda {
         client &request(http::method method, const std::string &path,
                         const client::callback &callback = nullptr);
 
+        /*!
+         * Starts a request without waiting for it.  The uri, headers and
+         * content are copied, and the response is not kept in this client.
+         * @returns the response once it arrives
+         * @throws socket_exception from the future if the request failed
+         */
+        std::future<http::response> request_async(http::method method,
+                                                  const std::string &path);
+
+        /*!
+         * Starts a request without waiting for it.  The completion runs on
+         * the thread driving the request, so it should hand off anything
+         * slow.
+         */
+        client &request_async(http::method method, const std::string &path,
+                              const client::completion &completion);
+
         /*!
          * performs a GET request
          */
@@ -190,21 +223,37 @@ namespace coda {
 
         client &set_timeout(int value);
 
+        /*!
+         * Streams the response body to a callback as it arrives, rather
+         * than collecting it in the response content
+         */
+        client &set_body_callback(const response_parser::body_callback &value);
+
+        response_parser::body_callback body_callback() const;
+
         private:
         static client::implementation impl_;
+        static client::async_implementation async_impl_;
         coda::net::uri uri_;
         int timeout_;
         http::response response_;
+        response_parser::body_callback body_callback_;
       };
 
       namespace socket {
         std::string request(http::client &, http::method, const std::string &);
-      }
+
+        void request_async(const http::client &, http::method,
+                           const std::string &, const client::completion &);
+      } // namespace socket
 
 #ifdef CURL_FOUND
       namespace curl {
         std::string request(http::client &, http::method, const std::string &);
-      }
+
+        void request_async(const http::client &, http::method,
+                           const std::string &, const client::completion &);
+      } // namespace curl
 #endif
     } // namespace http
   }   // namespace net
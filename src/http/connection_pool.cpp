@@ -0,0 +1,202 @@
+#include "connection_pool.h"
+#include "protocol.h"
+#include <poll.h>
+
+namespace coda {
+  namespace net {
+    namespace http {
+      namespace detail {
+        /*!
+         * An idle connection has nothing to read, so anything waiting is
+         * the server closing it, or data that belongs to no request.
+         */
+        bool is_reusable(const connection_pool::connection_type &connection) {
+          if (!connection || !connection->is_valid()) {
+            return false;
+          }
+
+          struct pollfd fds;
+
+          fds.fd = connection->raw_socket();
+          fds.events = POLLIN;
+          fds.revents = 0;
+
+          return ::poll(&fds, 1, 0) == 0;
+        }
+      } // namespace detail
+
+      connection_pool::connection_pool()
+          : idle_count_(0), max_idle_(DEFAULT_MAX_IDLE),
+            max_per_host_(DEFAULT_MAX_PER_HOST),
+            idle_timeout_(DEFAULT_IDLE_TIMEOUT), hits_(0), misses_(0),
+            evictions_(0) {}
+
+      connection_pool::~connection_pool() {}
+
+      connection_pool &connection_pool::shared() {
+        static connection_pool instance;
+
+        return instance;
+      }
+
+      connection_pool::connection_type
+      connection_pool::acquire(const std::string &scheme,
+                               const std::string &host, int port,
+                               bool &reused) {
+        auto connection = take_idle(scheme, host, port);
+
+        reused = connection != nullptr;
+
+        if (reused) {
+          return connection;
+        }
+
+        connection = std::make_shared<buffered_socket>();
+
+        if (scheme == http::SECURE_PROTOCOL) {
+          connection->set_secure(true);
+        }
+
+        if (!connection->connect(host, port)) {
+          return nullptr;
+        }
+
+        return connection;
+      }
+
+      connection_pool::connection_type
+      connection_pool::take_idle(const std::string &scheme,
+                                 const std::string &host, int port) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        evict(clock::now());
+
+        auto it = idle_.find(key(scheme, host, port));
+
+        // the most recently used is the least likely to have been closed
+        while (it != idle_.end() && !it->second.empty()) {
+          auto connection = std::move(it->second.back().connection);
+
+          it->second.pop_back();
+
+          idle_count_--;
+
+          if (detail::is_reusable(connection)) {
+            hits_++;
+            return connection;
+          }
+
+          evictions_++;
+        }
+
+        misses_++;
+
+        return nullptr;
+      }
+
+      void connection_pool::release(const std::string &scheme,
+                                    const std::string &host, int port,
+                                    const connection_type &connection) {
+        if (!connection || !connection->is_valid()) {
+          return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (max_idle_ == 0 || max_per_host_ == 0) {
+          return;
+        }
+
+        auto now = clock::now();
+
+        idle_[key(scheme, host, port)].push_back({connection, now});
+
+        idle_count_++;
+
+        evict(now);
+      }
+
+      void connection_pool::set_max_idle(size_t value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        max_idle_ = value;
+
+        evict(clock::now());
+      }
+
+      void connection_pool::set_max_per_host(size_t value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        max_per_host_ = value;
+
+        evict(clock::now());
+      }
+
+      void connection_pool::set_idle_timeout(duration value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        idle_timeout_ = value;
+
+        evict(clock::now());
+      }
+
+      void connection_pool::clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        idle_.clear();
+
+        idle_count_ = 0;
+      }
+
+      connection_pool::statistics connection_pool::stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        return statistics{hits_, misses_, evictions_, idle_count_};
+      }
+
+      std::string connection_pool::key(const std::string &scheme,
+                                       const std::string &host, int port) {
+        return scheme + "://" + host + ":" + std::to_string(port);
+      }
+
+      void connection_pool::evict(clock::time_point now) {
+        for (auto it = idle_.begin(); it != idle_.end();) {
+          auto &list = it->second;
+
+          while (!list.empty() && (list.size() > max_per_host_ ||
+                                   now - list.front().since >= idle_timeout_)) {
+            list.pop_front();
+            idle_count_--;
+            evictions_++;
+          }
+
+          if (list.empty()) {
+            it = idle_.erase(it);
+          } else {
+            ++it;
+          }
+        }
+
+        // over the total, the longest idle go first
+        while (idle_count_ > max_idle_) {
+          auto oldest = idle_.end();
+
+          for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+            if (oldest == idle_.end() ||
+                it->second.front().since < oldest->second.front().since) {
+              oldest = it;
+            }
+          }
+
+          oldest->second.pop_front();
+          idle_count_--;
+          evictions_++;
+
+          if (oldest->second.empty()) {
+            idle_.erase(oldest);
+          }
+        }
+      }
+    } // namespace http
+  }   // namespace net
+} // namespace coda
@@ -0,0 +1,146 @@
+#ifndef CODA_NET_HTTP_CONNECTION_POOL_H
+#define CODA_NET_HTTP_CONNECTION_POOL_H
+
+#include "../buffered_socket.h"
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace coda {
+  namespace net {
+    namespace http {
+      /*!
+       * Keeps idle persistent connections per scheme, host and port so
+       * requests to the same server skip the connect and handshake.  A
+       * connection is idle only between requests; whoever acquires one owns
+       * it until it is released.
+       */
+      class connection_pool {
+        public:
+        typedef std::chrono::steady_clock clock;
+        typedef std::chrono::milliseconds duration;
+        typedef std::shared_ptr<buffered_socket> connection_type;
+
+        /*!
+         * counts of how requests found their connection
+         */
+        struct statistics {
+          // requests that reused an idle connection
+          size_t hits;
+          // requests that had to connect
+          size_t misses;
+          // idle connections closed for being stale, expired or over a limit
+          size_t evictions;
+          // connections waiting to be reused
+          size_t idle;
+        };
+
+        static const size_t DEFAULT_MAX_IDLE = 64;
+        static const size_t DEFAULT_MAX_PER_HOST = 8;
+        static constexpr duration DEFAULT_IDLE_TIMEOUT =
+            std::chrono::seconds(30);
+
+        connection_pool();
+
+        connection_pool(const connection_pool &other) = delete;
+        connection_pool(connection_pool &&other) = delete;
+
+        virtual ~connection_pool();
+
+        connection_pool &operator=(const connection_pool &other) = delete;
+        connection_pool &operator=(connection_pool &&other) = delete;
+
+        /*!
+         * @returns the pool used by the http client socket implementation
+         */
+        static connection_pool &shared();
+
+        /*!
+         * Takes an idle connection to the server, or connects a new one
+         * @param reused set to true if the connection was idle in the pool
+         * @returns the connection, or null if unable to connect
+         */
+        connection_type acquire(const std::string &scheme,
+                                const std::string &host, int port,
+                                bool &reused);
+
+        /*!
+         * Takes an idle connection to the server without connecting
+         * @returns the connection, or null if the caller must connect
+         */
+        connection_type take_idle(const std::string &scheme,
+                                  const std::string &host, int port);
+
+        /*!
+         * Hands back a connection that has finished a request and can carry
+         * another.  It is closed instead if the pool is full.
+         */
+        void release(const std::string &scheme, const std::string &host,
+                     int port, const connection_type &connection);
+
+        /*!
+         * sets the most idle connections kept across all servers
+         */
+        void set_max_idle(size_t value);
+
+        /*!
+         * sets the most idle connections kept for one server
+         */
+        void set_max_per_host(size_t value);
+
+        /*!
+         * sets how long a connection may sit idle before it is closed
+         */
+        void set_idle_timeout(duration value);
+
+        /*!
+         * closes every idle connection
+         */
+        void clear();
+
+        statistics stats() const;
+
+        private:
+        struct idle_connection {
+          connection_type connection;
+          clock::time_point since;
+        };
+
+        typedef std::deque<idle_connection> idle_list;
+
+        static std::string key(const std::string &scheme,
+                               const std::string &host, int port);
+
+        /*!
+         * drops connections past the idle timeout or over the limits, with
+         * the lock held
+         */
+        void evict(clock::time_point now);
+
+        // most recently released last
+        std::unordered_map<std::string, idle_list> idle_;
+
+        size_t idle_count_;
+
+        size_t max_idle_;
+
+        size_t max_per_host_;
+
+        duration idle_timeout_;
+
+        size_t hits_;
+
+        size_t misses_;
+
+        size_t evictions_;
+
+        mutable std::mutex mutex_;
+      };
+    } // namespace http
+  }   // namespace net
+} // namespace coda
+
+#endif
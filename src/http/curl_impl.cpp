@@ -2,11 +2,13 @@
 #include "../socket.h"
 #include "../uri.h"
 #include "client.h"
+#include "curl_multi.h"
 
 #ifdef CURL_FOUND
 
 #include <cstring>
 #include <curl/curl.h>
+#include <mutex>
 #endif
 
 using namespace std;
@@ -35,6 +37,16 @@ namespace coda {
             return new_len;
           }
 
+          size_t curl_body_callback(void *ptr, size_t size, size_t nmemb,
+                                    response_parser::body_callback *callback) {
+            if (callback == NULL)
+              return 0;
+
+            (*callback)(static_cast<const char *>(ptr), size * nmemb);
+
+            return size * nmemb;
+          }
+
           void curl_set_opt_num(CURL *curl, CURLoption option, long number) {
             CURLcode code = curl_easy_setopt(curl, option, number);
             if (code != CURLE_OK) {
@@ -55,96 +67,197 @@ namespace coda {
               throw socket_exception(curl_easy_strerror(code));
             }
           }
+          void curl_set_opt_fun(CURL *curl, CURLoption option,
+                                size_t (*value)(void *, size_t, size_t,
+                                                response_parser::body_callback *)) {
+            CURLcode code = curl_easy_setopt(curl, option, value);
+            if (code != CURLE_OK) {
+              throw socket_exception(curl_easy_strerror(code));
+            }
+          }
         } // namespace helper
 
-        std::string request(http::client &client, http::method method,
-                            const std::string &userPath) {
-          CURLcode code;
+        namespace helper {
+          /*!
+           * The share handle every curl request uses, so DNS lookups,
+           * connections and TLS sessions carry over between requests.
+           * Each kind of data has its own lock.
+           */
+          class share {
+            public:
+            share() {
+              curl_global_init(CURL_GLOBAL_DEFAULT);
+
+              handle_ = curl_share_init();
+
+              if (handle_ == NULL) {
+                throw socket_exception("unable to initialize curl share");
+              }
+
+              curl_share_setopt(handle_, CURLSHOPT_LOCKFUNC, lock);
+              curl_share_setopt(handle_, CURLSHOPT_UNLOCKFUNC, unlock);
+              curl_share_setopt(handle_, CURLSHOPT_USERDATA, this);
+              curl_share_setopt(handle_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+              curl_share_setopt(handle_, CURLSHOPT_SHARE,
+                                CURL_LOCK_DATA_SSL_SESSION);
+              curl_share_setopt(handle_, CURLSHOPT_SHARE,
+                                CURL_LOCK_DATA_CONNECT);
+            }
 
-          char buf[http::MAX_URL_LEN + 1] = {0};
+            ~share() { curl_share_cleanup(handle_); }
 
-          struct curl_slist *headers = NULL;
+            CURLSH *handle() const noexcept { return handle_; }
 
-          CURL *curl = NULL;
+            static share &instance() {
+              static share value;
+
+              return value;
+            }
 
-          std::string path = userPath;
+            private:
+            static void lock(CURL *, curl_lock_data data, curl_lock_access,
+                             void *ptr) {
+              static_cast<share *>(ptr)->locks_[data].lock();
+            }
 
-          net::uri uri = client.uri();
+            static void unlock(CURL *, curl_lock_data data, void *ptr) {
+              static_cast<share *>(ptr)->locks_[data].unlock();
+            }
 
-          std::string content = client.content();
+            CURLSH *handle_;
 
-          std::string response;
+            std::mutex locks_[CURL_LOCK_DATA_LAST];
+          };
 
-          curl = curl_easy_init();
+          /*!
+           * Sets up an easy handle for a request.  The content and response
+           * strings and the body callback are used by reference, so they
+           * must outlive the transfer.
+           * @returns the header list, for the caller to free
+           */
+          struct curl_slist *
+          prepare(CURL *curl, const http::client &client,
+                  http::method method, const std::string &userPath,
+                  const std::string &content, std::string &response,
+                  response_parser::body_callback &body_callback) {
+            char buf[http::MAX_URL_LEN + 1] = {0};
 
-          if (curl == NULL) {
-            throw socket_exception("unable to initialize curl request");
-          }
+            struct curl_slist *headers = NULL;
 
-          // check if a path was specified
-          if (path.empty()) {
-            path = uri.full_path();
-          }
+            std::string path = userPath;
 
-          if (path.empty()) {
-            snprintf(buf, http::MAX_URL_LEN, "%s://%s", uri.scheme().c_str(),
-                     uri.host_with_port().c_str());
-          } else if (path[0] == '/') {
-            snprintf(buf, http::MAX_URL_LEN, "%s://%s%s", uri.scheme().c_str(),
-                     uri.host_with_port().c_str(), path.c_str());
-          } else {
-            snprintf(buf, http::MAX_URL_LEN, "%s://%s/%s", uri.scheme().c_str(),
-                     uri.host_with_port().c_str(), path.c_str());
-          }
+            net::uri uri = client.uri();
+
+            // check if a path was specified
+            if (path.empty()) {
+              path = uri.full_path();
+            }
+
+            if (path.empty()) {
+              snprintf(buf, http::MAX_URL_LEN, "%s://%s", uri.scheme().c_str(),
+                       uri.host_with_port().c_str());
+            } else if (path[0] == '/') {
+              snprintf(buf, http::MAX_URL_LEN, "%s://%s%s",
+                       uri.scheme().c_str(), uri.host_with_port().c_str(),
+                       path.c_str());
+            } else {
+              snprintf(buf, http::MAX_URL_LEN, "%s://%s/%s",
+                       uri.scheme().c_str(), uri.host_with_port().c_str(),
+                       path.c_str());
+            }
+
+            curl_set_opt(curl, CURLOPT_URL, buf);
+
+            curl_set_opt(curl, CURLOPT_SHARE, share::instance().handle());
 
-          helper::curl_set_opt(curl, CURLOPT_URL, buf);
+            // requests run on many threads, where signals can't time out DNS
+            curl_set_opt_num(curl, CURLOPT_NOSIGNAL, 1L);
 
-          helper::curl_set_opt_fun(curl, CURLOPT_WRITEFUNCTION,
-                                   helper::curl_append_response_callback);
+            if (body_callback) {
+              // the headers still make up the response, the body streams
+              curl_set_opt_fun(curl, CURLOPT_HEADERFUNCTION,
+                               curl_append_response_callback);
 
-          helper::curl_set_opt_num(curl, CURLOPT_HEADER, 1L);
+              curl_set_opt(curl, CURLOPT_HEADERDATA, &response);
+
+              curl_set_opt_fun(curl, CURLOPT_WRITEFUNCTION,
+                               curl_body_callback);
+
+              curl_set_opt(curl, CURLOPT_WRITEDATA, &body_callback);
+            } else {
+              curl_set_opt_fun(curl, CURLOPT_WRITEFUNCTION,
+                               curl_append_response_callback);
+
+              curl_set_opt_num(curl, CURLOPT_HEADER, 1L);
+
+              curl_set_opt(curl, CURLOPT_WRITEDATA, &response);
+            }
 
 #ifdef DEBUG
-          helper::curl_set_opt_num(curl, CURLOPT_VERBOSE, 1L);
+            curl_set_opt_num(curl, CURLOPT_VERBOSE, 1L);
 #endif
 
-          switch (method) {
-          case http::GET:
-            helper::curl_set_opt_num(curl, CURLOPT_HTTPGET, 1L);
-            break;
-          case http::POST:
-            helper::curl_set_opt_num(curl, CURLOPT_POST, 1L);
-            if (!content.empty()) {
-              helper::curl_set_opt(curl, CURLOPT_POSTFIELDS, content.c_str());
-              helper::curl_set_opt_num(curl, CURLOPT_POSTFIELDSIZE,
-                                       content.size());
+            switch (method) {
+            case http::GET:
+              curl_set_opt_num(curl, CURLOPT_HTTPGET, 1L);
+              break;
+            case http::POST:
+              curl_set_opt_num(curl, CURLOPT_POST, 1L);
+              if (!content.empty()) {
+                curl_set_opt(curl, CURLOPT_POSTFIELDS, content.c_str());
+                curl_set_opt_num(curl, CURLOPT_POSTFIELDSIZE, content.size());
+              }
+              break;
+            case http::PUT:
+              curl_set_opt_num(curl, CURLOPT_PUT, 1L);
+              if (!content.empty()) {
+                curl_set_opt(curl, CURLOPT_POSTFIELDS, content.c_str());
+                curl_set_opt_num(curl, CURLOPT_POSTFIELDSIZE, content.size());
+              }
+              break;
+            default:
+              curl_set_opt(curl, CURLOPT_CUSTOMREQUEST,
+                           http::method_names[method]);
+              break;
             }
-            break;
-          case http::PUT:
-            helper::curl_set_opt_num(curl, CURLOPT_PUT, 1L);
-            if (!content.empty()) {
-              helper::curl_set_opt(curl, CURLOPT_POSTFIELDS, content.c_str());
-              helper::curl_set_opt_num(curl, CURLOPT_POSTFIELDSIZE,
-                                       content.size());
+
+            for (auto &h : client.headers()) {
+              snprintf(buf, http::MAX_URL_LEN, "%s: %s", h.first.c_str(),
+                       h.second.c_str());
+              headers = curl_slist_append(headers, buf);
             }
-            break;
-          default:
-            helper::curl_set_opt(curl, CURLOPT_CUSTOMREQUEST,
-                                 http::method_names[method]);
-            break;
-          }
 
-          for (auto &h : client.headers()) {
-            snprintf(buf, http::MAX_URL_LEN, "%s: %s", h.first.c_str(),
-                     h.second.c_str());
-            headers = curl_slist_append(headers, buf);
+            curl_set_opt(curl, CURLOPT_HTTPHEADER, headers);
+
+            curl_set_opt_num(curl, CURLOPT_TIMEOUT, client.timeout());
+
+            return headers;
           }
+        } // namespace helper
+
+        std::string request(http::client &client, http::method method,
+                            const std::string &userPath) {
+          std::string content = client.content();
+
+          std::string response;
+
+          auto body_callback = client.body_callback();
+
+          CURL *curl = curl_easy_init();
 
-          helper::curl_set_opt(curl, CURLOPT_HTTPHEADER, headers);
+          if (curl == NULL) {
+            throw socket_exception("unable to initialize curl request");
+          }
 
-          helper::curl_set_opt_num(curl, CURLOPT_TIMEOUT, client.timeout());
+          struct curl_slist *headers = NULL;
 
-          helper::curl_set_opt(curl, CURLOPT_WRITEDATA, &response);
+          try {
+            headers = helper::prepare(curl, client, method, userPath, content,
+                                      response, body_callback);
+          } catch (const socket_exception &e) {
+            curl_easy_cleanup(curl);
+            throw;
+          }
 
           CURLcode res = curl_easy_perform(curl);
 
@@ -160,12 +273,249 @@ namespace coda {
 
           return response;
         }
+
+        void request_async(const http::client &client, http::method method,
+                           const std::string &path,
+                           const client::completion &completion) {
+          multi::shared().add(client, method, path, completion);
+        }
+
+        /*!
+         * a request in flight, owning everything its easy handle points to
+         */
+        struct multi::transfer {
+          CURL *curl = NULL;
+
+          struct curl_slist *headers = NULL;
+
+          std::string content;
+
+          std::string response;
+
+          response_parser::body_callback body_callback;
+
+          completion_type completion;
+
+          char error[CURL_ERROR_SIZE] = {0};
+
+          ~transfer() {
+            curl_slist_free_all(headers);
+
+            if (curl != NULL) {
+              curl_easy_cleanup(curl);
+            }
+          }
+        };
+
+        multi::multi() : pending_(0), stopping_(false) {
+          // the share must outlive every handle using it
+          helper::share::instance();
+
+          handle_ = curl_multi_init();
+
+          if (handle_ == NULL) {
+            throw socket_exception("unable to initialize curl multi");
+          }
+
+          curl_multi_setopt(handle_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                            MAX_PER_HOST);
+        }
+
+        multi::~multi() {
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            stopping_ = true;
+          }
+
+          curl_multi_wakeup(handle_);
+
+          if (thread_.joinable()) {
+            thread_.join();
+          }
+
+          for (auto &queued : queued_) {
+            finish(*queued, CURLE_ABORTED_BY_CALLBACK);
+          }
+
+          queued_.clear();
+
+          curl_multi_cleanup(handle_);
+        }
+
+        multi &multi::shared() {
+          static multi instance;
+
+          return instance;
+        }
+
+        std::future<http::response> multi::add(const http::client &client,
+                                               http::method method,
+                                               const std::string &path) {
+          auto promise = std::make_shared<std::promise<http::response>>();
+
+          add(client, method, path,
+              [promise](const http::response &response, const char *error) {
+                if (error != NULL) {
+                  promise->set_exception(
+                      std::make_exception_ptr(socket_exception(error)));
+                } else {
+                  promise->set_value(response);
+                }
+              });
+
+          return promise->get_future();
+        }
+
+        void multi::add(const http::client &client, http::method method,
+                        const std::string &path,
+                        const completion_type &completion) {
+          auto value = std::make_unique<transfer>();
+
+          value->content = client.content();
+
+          value->body_callback = client.body_callback();
+
+          value->completion = completion;
+
+          value->curl = curl_easy_init();
+
+          if (value->curl == NULL) {
+            throw socket_exception("unable to initialize curl request");
+          }
+
+          value->headers =
+              helper::prepare(value->curl, client, method, path, value->content,
+                              value->response, value->body_callback);
+
+          helper::curl_set_opt(value->curl, CURLOPT_ERRORBUFFER, value->error);
+
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (stopping_) {
+              throw socket_exception("curl multi is stopping");
+            }
+
+            queued_.push_back(std::move(value));
+
+            pending_++;
+
+            // the thread starts with the first request
+            if (!thread_.joinable()) {
+              thread_ = std::thread(&multi::run, this);
+            }
+          }
+
+          curl_multi_wakeup(handle_);
+        }
+
+        size_t multi::pending() const noexcept { return pending_; }
+
+        void multi::run() {
+          std::vector<transfer_type> added;
+
+          for (;;) {
+            {
+              std::lock_guard<std::mutex> lock(mutex_);
+
+              if (stopping_) {
+                break;
+              }
+
+              added.swap(queued_);
+            }
+
+            for (auto &value : added) {
+              CURL *curl = value->curl;
+
+              CURLMcode code = curl_multi_add_handle(handle_, curl);
+
+              if (code != CURLM_OK) {
+                pending_--;
+                finish(*value, CURLE_FAILED_INIT);
+                continue;
+              }
+
+              active_.emplace(curl, std::move(value));
+            }
+
+            added.clear();
+
+            int running = 0;
+
+            curl_multi_perform(handle_, &running);
+
+            CURLMsg *message = NULL;
+
+            int left = 0;
+
+            while ((message = curl_multi_info_read(handle_, &left)) != NULL) {
+              if (message->msg != CURLMSG_DONE) {
+                continue;
+              }
+
+              auto it = active_.find(message->easy_handle);
+
+              if (it == active_.end()) {
+                continue;
+              }
+
+              auto value = std::move(it->second);
+
+              CURLcode result = message->data.result;
+
+              active_.erase(it);
+
+              curl_multi_remove_handle(handle_, value->curl);
+
+              pending_--;
+
+              finish(*value, result);
+            }
+
+            // woken early by add or the destructor
+            curl_multi_poll(handle_, NULL, 0, 1000, NULL);
+          }
+
+          for (auto &it : active_) {
+            curl_multi_remove_handle(handle_, it.first);
+
+            finish(*it.second, CURLE_ABORTED_BY_CALLBACK);
+          }
+
+          active_.clear();
+        }
+
+        void multi::finish(transfer &value, CURLcode result) {
+          if (!value.completion) {
+            return;
+          }
+
+          // a throwing completion must not take the thread down
+          try {
+            if (result == CURLE_OK || result == CURLE_PARTIAL_FILE) {
+              value.completion(http::response(value.response), NULL);
+            } else {
+              value.completion(http::response(),
+                               value.error[0] ? value.error
+                                              : curl_easy_strerror(result));
+            }
+          } catch (...) {
+          }
+        }
 #else
 
         std::string request(http::client &client, http::method method,
                             const std::string &userPath) {
           throw socket_exception("curl implementation not enabled");
         }
+
+        void request_async(const http::client &client, http::method method,
+                           const std::string &path,
+                           const client::completion &completion) {
+          throw socket_exception("curl implementation not enabled");
+        }
 #endif
       } // namespace curl
     }   // namespace http
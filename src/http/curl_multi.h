@@ -0,0 +1,117 @@
+#ifndef CODA_NET_HTTP_CURL_MULTI_H
+#define CODA_NET_HTTP_CURL_MULTI_H
+
+#include "../exception.h"
+#include "client.h"
+
+#ifdef CURL_FOUND
+
+#include <atomic>
+#include <curl/curl.h>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    namespace http {
+      namespace curl {
+        /*!
+         * Runs many requests at once on a single background thread with
+         * curl's multi interface.  Every curl request, this one's and the
+         * blocking ones alike, shares one DNS cache, connection cache and
+         * TLS session cache.
+         */
+        class multi {
+          public:
+          /*!
+           * receives the response, or an error message with an empty
+           * response.  Runs on the background thread.
+           */
+          typedef http::client::completion completion_type;
+
+          /*!
+           * the most connections kept open to one host
+           */
+          static const long MAX_PER_HOST = 8;
+
+          multi();
+
+          multi(const multi &other) = delete;
+          multi(multi &&other) = delete;
+
+          /*!
+           * stops the thread, failing any request not yet finished
+           */
+          virtual ~multi();
+
+          multi &operator=(const multi &other) = delete;
+          multi &operator=(multi &&other) = delete;
+
+          /*!
+           * @returns the instance the clients share
+           */
+          static multi &shared();
+
+          /*!
+           * Starts a request with a copy of the client's uri, headers and
+           * content
+           * @returns the response once it arrives
+           * @throws socket_exception from the future if the request failed
+           */
+          std::future<http::response> add(const http::client &client,
+                                          http::method method,
+                                          const std::string &path);
+
+          /*!
+           * Starts a request with a copy of the client's uri, headers and
+           * content
+           * @param completion called once with the result
+           */
+          void add(const http::client &client, http::method method,
+                   const std::string &path, const completion_type &completion);
+
+          /*!
+           * @returns the requests added but not yet completed
+           */
+          size_t pending() const noexcept;
+
+          private:
+          struct transfer;
+
+          typedef std::unique_ptr<transfer> transfer_type;
+
+          /*!
+           * the background thread, driving transfers until stopped
+           */
+          void run();
+
+          static void finish(transfer &value, CURLcode result);
+
+          CURLM *handle_;
+
+          // handed over by add, taken by the background thread
+          std::vector<transfer_type> queued_;
+
+          // only touched by the background thread
+          std::unordered_map<CURL *, transfer_type> active_;
+
+          std::atomic<size_t> pending_;
+
+          bool stopping_;
+
+          std::thread thread_;
+
+          std::mutex mutex_;
+        };
+      } // namespace curl
+    }   // namespace http
+  }     // namespace net
+} // namespace coda
+
+#endif
+
+#endif
@@ -0,0 +1,562 @@
+#include "parser.h"
+#include "../exception.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace coda {
+  namespace net {
+    namespace http {
+      namespace detail {
+        /*!
+         * characters allowed in a method or header name (RFC 7230 section
+         * 3.2.6)
+         */
+        bool is_token(unsigned char c) noexcept {
+          static const char *const extra = "!#$%&'*+-.^_`|~";
+
+          return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                 (c >= 'A' && c <= 'Z') || (c != 0 && strchr(extra, c));
+        }
+
+        /*!
+         * control characters other than tab end up as smuggled syntax
+         */
+        bool is_text(unsigned char c) noexcept {
+          return c == '\t' || (c >= 0x20 && c != 0x7f);
+        }
+
+        /*!
+         * finds the next line feed, sixteen bytes at a time where it can
+         */
+        const char *find_newline(const char *p, const char *end) noexcept {
+#ifdef __SSE2__
+          const __m128i newline = _mm_set1_epi8('\n');
+
+          while (end - p >= 16) {
+            __m128i chunk =
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+
+            if (mask != 0) {
+              return p + __builtin_ctz(mask);
+            }
+
+            p += 16;
+          }
+#endif
+          if (p >= end) {
+            return NULL;
+          }
+
+          return static_cast<const char *>(memchr(p, '\n', end - p));
+        }
+
+        /*!
+         * @returns the line from pos, without its CRLF or LF, and moves pos
+         * past it.  The head end must already be known to be in range.
+         */
+        bool next_line(const char *data, size_t end, size_t &pos,
+                       std::string_view &line) noexcept {
+          auto nl = find_newline(data + pos, data + end);
+
+          if (nl == NULL) {
+            return false;
+          }
+
+          size_t len = nl - (data + pos);
+
+          // a carriage return only counts as part of the line ending
+          if (len > 0 && data[pos + len - 1] == '\r') {
+            len--;
+          }
+
+          line = std::string_view(data + pos, len);
+
+          pos = nl - data + 1;
+
+          return true;
+        }
+
+        /*!
+         * @returns the minor version of "HTTP/1.x", or -1
+         */
+        int parse_version(std::string_view value) noexcept {
+          if (value.size() != 8 || value.compare(0, 7, "HTTP/1.") != 0 ||
+              value[7] < '0' || value[7] > '9') {
+            return -1;
+          }
+          return value[7] - '0';
+        }
+
+        /*!
+         * parses header lines up to the blank line
+         * @returns false if a line is malformed or there are too many
+         */
+        bool parse_headers(const char *data, size_t end, size_t &pos,
+                           message_head &head) noexcept {
+          head.header_count = 0;
+
+          std::string_view line;
+
+          while (next_line(data, end, pos, line)) {
+            if (line.empty()) {
+              return true;
+            }
+
+            if (head.header_count == MAX_HEADERS) {
+              return false;
+            }
+
+            size_t i = 0;
+
+            // no space is allowed before the colon, and a folded line
+            // starts with one
+            while (i < line.size() && is_token(line[i])) {
+              i++;
+            }
+
+            if (i == 0 || i == line.size() || line[i] != ':') {
+              return false;
+            }
+
+            auto &h = head.headers[head.header_count++];
+
+            h.name = line.substr(0, i);
+
+            size_t start = i + 1;
+
+            while (start < line.size() &&
+                   (line[start] == ' ' || line[start] == '\t')) {
+              start++;
+            }
+
+            size_t stop = line.size();
+
+            while (stop > start &&
+                   (line[stop - 1] == ' ' || line[stop - 1] == '\t')) {
+              stop--;
+            }
+
+            for (size_t j = start; j < stop; j++) {
+              if (!is_text(line[j])) {
+                return false;
+              }
+            }
+
+            h.value = line.substr(start, stop - start);
+          }
+
+          return false;
+        }
+
+        /*!
+         * splits a start line into its three parts at the first two spaces
+         */
+        bool split_start_line(std::string_view line, std::string_view &first,
+                              std::string_view &second,
+                              std::string_view &rest) noexcept {
+          auto a = line.find(' ');
+
+          if (a == std::string_view::npos) {
+            return false;
+          }
+
+          auto b = line.find(' ', a + 1);
+
+          first = line.substr(0, a);
+
+          if (b == std::string_view::npos) {
+            second = line.substr(a + 1);
+            rest = std::string_view();
+          } else {
+            second = line.substr(a + 1, b - a - 1);
+            rest = line.substr(b + 1);
+          }
+
+          return true;
+        }
+
+        /*!
+         * @returns the head length, or why there is none yet
+         */
+        int head_length(const char *data, size_t size,
+                        size_t last_size) noexcept {
+          // the blank line could have started in the part already seen
+          size_t from = last_size > 3 ? last_size - 3 : 0;
+
+          size_t end = find_head_end(data, size, from);
+
+          if (end == 0) {
+            return PARSE_INCOMPLETE;
+          }
+
+          return static_cast<int>(end);
+        }
+      } // namespace detail
+
+      std::string_view message_head::header(std::string_view name) const
+          noexcept {
+        for (size_t i = 0; i < header_count; i++) {
+          const auto &h = headers[i];
+
+          if (h.name.size() == name.size() &&
+              !strncasecmp(h.name.data(), name.data(), name.size())) {
+            return h.value;
+          }
+        }
+        return std::string_view();
+      }
+
+      bool message_head::has_header(std::string_view name) const noexcept {
+        for (size_t i = 0; i < header_count; i++) {
+          const auto &h = headers[i];
+
+          if (h.name.size() == name.size() &&
+              !strncasecmp(h.name.data(), name.data(), name.size())) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      size_t message_head::count_header(std::string_view name) const
+          noexcept {
+        size_t count = 0;
+
+        for (size_t i = 0; i < header_count; i++) {
+          const auto &h = headers[i];
+
+          if (h.name.size() == name.size() &&
+              !strncasecmp(h.name.data(), name.data(), name.size())) {
+            count++;
+          }
+        }
+        return count;
+      }
+
+      bool parse_content_length(std::string_view value,
+                                size_t &length) noexcept {
+        if (value.empty()) {
+          return false;
+        }
+
+        size_t result = 0;
+
+        for (auto c : value) {
+          if (c < '0' || c > '9') {
+            return false;
+          }
+
+          size_t digit = c - '0';
+
+          // a wrapped length frames the body differently to a proxy that
+          // read it right
+          if (result > (SIZE_MAX - digit) / 10) {
+            return false;
+          }
+
+          result = result * 10 + digit;
+        }
+
+        length = result;
+
+        return true;
+      }
+
+      bool is_chunked(std::string_view encoding) noexcept {
+        auto comma = encoding.rfind(',');
+
+        if (comma != std::string_view::npos) {
+          encoding.remove_prefix(comma + 1);
+        }
+
+        // the coding is a token, with optional white space around it
+        while (!encoding.empty() &&
+               (encoding.front() == ' ' || encoding.front() == '\t')) {
+          encoding.remove_prefix(1);
+        }
+
+        while (!encoding.empty() &&
+               (encoding.back() == ' ' || encoding.back() == '\t')) {
+          encoding.remove_suffix(1);
+        }
+
+        return encoding.size() == 7 &&
+               !strncasecmp(encoding.data(), "chunked", 7);
+      }
+
+      size_t find_head_end(const char *data, size_t size,
+                           size_t from) noexcept {
+        const char *end = data + size;
+
+        for (auto p = data + from; p < end;) {
+          auto nl = detail::find_newline(p, end);
+
+          if (nl == NULL) {
+            return 0;
+          }
+
+          p = nl + 1;
+
+          if (p < end && *p == '\n') {
+            return p - data + 1;
+          }
+
+          if (p + 1 < end && p[0] == '\r' && p[1] == '\n') {
+            return p - data + 2;
+          }
+        }
+
+        return 0;
+      }
+
+      int parse_request(const char *data, size_t size, request_head &head,
+                        size_t last_size) noexcept {
+        size_t pos = 0;
+
+        // empty lines before a request are ignored (RFC 7230 section 3.5)
+        while (pos < size && (data[pos] == '\r' || data[pos] == '\n')) {
+          pos++;
+        }
+
+        int length = detail::head_length(data + pos, size - pos,
+                                         last_size > pos ? last_size - pos : 0);
+
+        if (length < 0) {
+          return length;
+        }
+
+        size_t end = pos + length;
+
+        std::string_view line, version;
+
+        if (!detail::next_line(data, end, pos, line) ||
+            !detail::split_start_line(line, head.method, head.target,
+                                      version)) {
+          return PARSE_ERROR;
+        }
+
+        if (head.method.empty() || head.target.empty()) {
+          return PARSE_ERROR;
+        }
+
+        for (auto c : head.method) {
+          if (!detail::is_token(c)) {
+            return PARSE_ERROR;
+          }
+        }
+
+        for (unsigned char c : head.target) {
+          if (c <= ' ' || c == 0x7f) {
+            return PARSE_ERROR;
+          }
+        }
+
+        head.minor_version = detail::parse_version(version);
+
+        if (head.minor_version < 0) {
+          return PARSE_ERROR;
+        }
+
+        if (!detail::parse_headers(data, end, pos, head)) {
+          return PARSE_ERROR;
+        }
+
+        return static_cast<int>(end);
+      }
+
+      int parse_response(const char *data, size_t size, response_head &head,
+                         size_t last_size) noexcept {
+        int length = detail::head_length(data, size, last_size);
+
+        // a status line can be told apart before the rest arrives
+        if (size >= 5 && memcmp(data, "HTTP/", 5) != 0) {
+          return PARSE_ERROR;
+        }
+
+        if (length < 0) {
+          return length;
+        }
+
+        size_t pos = 0, end = length;
+
+        std::string_view line, version, code;
+
+        if (!detail::next_line(data, end, pos, line) ||
+            !detail::split_start_line(line, version, code, head.reason)) {
+          return PARSE_ERROR;
+        }
+
+        head.minor_version = detail::parse_version(version);
+
+        if (head.minor_version < 0 || code.size() != 3) {
+          return PARSE_ERROR;
+        }
+
+        head.code = 0;
+
+        for (auto c : code) {
+          if (c < '0' || c > '9') {
+            return PARSE_ERROR;
+          }
+          head.code = head.code * 10 + (c - '0');
+        }
+
+        if (!detail::parse_headers(data, end, pos, head)) {
+          return PARSE_ERROR;
+        }
+
+        return static_cast<int>(end);
+      }
+
+      chunked_decoder::chunked_decoder() : state_(STATE_SIZE), remaining_(0) {}
+
+      size_t chunked_decoder::decode(const char *data, size_t size,
+                                     const callback_type &callback) {
+        size_t pos = 0;
+
+        while (pos < size && state_ != STATE_DONE) {
+          switch (state_) {
+          case STATE_SIZE: {
+            if (!take_line(data, size, pos)) {
+              break;
+            }
+
+            remaining_ = parse_chunk_size(line_);
+
+            line_.clear();
+
+            state_ = remaining_ == 0 ? STATE_TRAILERS : STATE_DATA;
+            break;
+          }
+          case STATE_DATA: {
+            size_t n = std::min(remaining_, size - pos);
+
+            if (callback) {
+              callback(data + pos, n);
+            }
+
+            pos += n;
+
+            remaining_ -= n;
+
+            if (remaining_ == 0) {
+              state_ = STATE_DATA_END;
+            }
+            break;
+          }
+          case STATE_DATA_END:
+            if (!take_line(data, size, pos)) {
+              break;
+            }
+
+            if (!line_.empty()) {
+              throw socket_exception("invalid chunk terminator");
+            }
+
+            state_ = STATE_SIZE;
+            break;
+          case STATE_TRAILERS:
+            if (!take_line(data, size, pos)) {
+              break;
+            }
+
+            // a blank line ends the trailers
+            if (line_.empty()) {
+              state_ = STATE_DONE;
+            }
+
+            line_.clear();
+            break;
+          case STATE_DONE:
+            break;
+          }
+        }
+
+        return pos;
+      }
+
+      size_t chunked_decoder::parse_chunk_size(const std::string &line) {
+        size_t size = 0;
+        size_t digits = 0;
+
+        for (; digits < line.size(); digits++) {
+          char c = line[digits];
+          size_t value;
+
+          if (c >= '0' && c <= '9') {
+            value = c - '0';
+          } else if (c >= 'a' && c <= 'f') {
+            value = c - 'a' + 10;
+          } else if (c >= 'A' && c <= 'F') {
+            value = c - 'A' + 10;
+          } else {
+            break;
+          }
+
+          if (size > (SIZE_MAX >> 4)) {
+            throw socket_exception("chunk size is too large");
+          }
+
+          size = (size << 4) | value;
+        }
+
+        if (digits == 0) {
+          throw socket_exception("invalid chunk size");
+        }
+
+        // anything after the size is a chunk extension, which is ignored
+        if (digits < line.size() && line[digits] != ';' &&
+            line[digits] != ' ' && line[digits] != '\t') {
+          throw socket_exception("invalid chunk size");
+        }
+
+        return size;
+      }
+
+      bool chunked_decoder::is_complete() const noexcept {
+        return state_ == STATE_DONE;
+      }
+
+      void chunked_decoder::reset() noexcept {
+        state_ = STATE_SIZE;
+        line_.clear();
+        remaining_ = 0;
+      }
+
+      bool chunked_decoder::take_line(const char *data, size_t size,
+                                      size_t &pos) {
+        auto end = detail::find_newline(data + pos, data + size);
+
+        if (end == NULL) {
+          line_.append(data + pos, size - pos);
+
+          pos = size;
+
+          if (line_.size() > MAX_LINE_SIZE) {
+            throw socket_exception("chunk line is too long");
+          }
+          return false;
+        }
+
+        line_.append(data + pos, end - (data + pos));
+
+        pos = end - data + 1;
+
+        if (!line_.empty() && line_.back() == '\r') {
+          line_.pop_back();
+        }
+
+        return true;
+      }
+    } // namespace http
+  }   // namespace net
+} // namespace coda
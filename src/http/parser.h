@@ -0,0 +1,179 @@
+#ifndef CODA_NET_HTTP_PARSER_H
+#define CODA_NET_HTTP_PARSER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace coda {
+  namespace net {
+    namespace http {
+      /*!
+       * the most headers a parsed head can hold
+       */
+      constexpr static const size_t MAX_HEADERS = 64;
+
+      /*!
+       * the head is malformed
+       */
+      constexpr static const int PARSE_ERROR = -1;
+
+      /*!
+       * the head has not all arrived yet
+       */
+      constexpr static const int PARSE_INCOMPLETE = -2;
+
+      /*!
+       * a header as slices of the buffer it was parsed from
+       */
+      struct header_view {
+        std::string_view name;
+        std::string_view value;
+      };
+
+      /*!
+       * What the request and response heads share.  Every view points into
+       * the parsed buffer, so they are only valid while it is.
+       */
+      struct message_head {
+        // the x in HTTP/1.x
+        int minor_version = 0;
+
+        header_view headers[MAX_HEADERS];
+
+        size_t header_count = 0;
+
+        /*!
+         * @returns the value of the first header with the name, compared
+         * without case, or empty if there is none
+         */
+        std::string_view header(std::string_view name) const noexcept;
+
+        bool has_header(std::string_view name) const noexcept;
+
+        /*!
+         * @returns how many headers have the name, compared without case
+         */
+        size_t count_header(std::string_view name) const noexcept;
+      };
+
+      struct request_head : public message_head {
+        std::string_view method;
+        std::string_view target;
+      };
+
+      struct response_head : public message_head {
+        int code = 0;
+        std::string_view reason;
+      };
+
+      /*!
+       * Finds the blank line that ends a head.  Lines may end in CRLF or a
+       * bare LF.
+       * @param from where an earlier search with less data stopped, so only
+       * new bytes are looked at
+       * @returns the length of the head, or zero if it is not all there
+       */
+      size_t find_head_end(const char *data, size_t size,
+                           size_t from = 0) noexcept;
+
+      /*!
+       * Parses a request line and headers in place without allocating.
+       * Anything after the head, a body or the next pipelined request, is
+       * left alone.
+       * @param last_size how much of the buffer an earlier incomplete call
+       * saw, to skip searching it again
+       * @returns the length of the head, PARSE_INCOMPLETE or PARSE_ERROR
+       */
+      int parse_request(const char *data, size_t size, request_head &head,
+                        size_t last_size = 0) noexcept;
+
+      /*!
+       * Parses a status line and headers in place without allocating
+       * @returns the length of the head, PARSE_INCOMPLETE or PARSE_ERROR
+       */
+      int parse_response(const char *data, size_t size, response_head &head,
+                         size_t last_size = 0) noexcept;
+
+      /*!
+       * Parses a Content-Length value, which is only digits
+       * @returns false if it is malformed or too large for a size_t
+       */
+      bool parse_content_length(std::string_view value,
+                                size_t &length) noexcept;
+
+      /*!
+       * @returns true if the last coding of a Transfer-Encoding value, the
+       * one that frames the message, is chunked
+       */
+      bool is_chunked(std::string_view encoding) noexcept;
+
+      /*!
+       * Decodes a chunked body as it arrives.  Chunk extensions and trailers
+       * are read past.
+       */
+      class chunked_decoder {
+        public:
+        /*!
+         * receives the decoded body a piece at a time
+         */
+        typedef std::function<void(const char *data, size_t size)>
+            callback_type;
+
+        /*!
+         * the longest chunk size or trailer line accepted
+         */
+        static const size_t MAX_LINE_SIZE = 8 * 1024;
+
+        chunked_decoder();
+
+        /*!
+         * Takes the next bytes of the body
+         * @returns the bytes used, fewer than given if the body ended
+         * @throws socket_exception if the framing is malformed
+         */
+        size_t decode(const char *data, size_t size,
+                      const callback_type &callback);
+
+        /*!
+         * @returns true once the last chunk and trailers are in
+         */
+        bool is_complete() const noexcept;
+
+        void reset() noexcept;
+
+        private:
+        typedef enum {
+          STATE_SIZE,
+          STATE_DATA,
+          STATE_DATA_END,
+          STATE_TRAILERS,
+          STATE_DONE
+        } state_type;
+
+        /*!
+         * @returns the hex size that starts a chunk line, before any
+         * extension
+         * @throws socket_exception if it is malformed or too large
+         */
+        static size_t parse_chunk_size(const std::string &line);
+
+        /*!
+         * collects a line, across calls if need be
+         * @returns true once the line is complete in line_
+         */
+        bool take_line(const char *data, size_t size, size_t &pos);
+
+        state_type state_;
+
+        std::string line_;
+
+        // bytes left in the current chunk
+        size_t remaining_;
+      };
+    } // namespace http
+  }   // namespace net
+} // namespace coda
+
+#endif
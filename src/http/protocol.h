@@ -39,6 +39,9 @@ namespace coda {
        */
       constexpr static const char *const HEADER_CONTENT_SIZE = "Content-Size";
 
+      constexpr static const char *const HEADER_CONTENT_LENGTH =
+          "Content-Length";
+
       constexpr static const char *const HEADER_HOST = "Host";
 
       constexpr static const char *const HEADER_USER_AGENT = "User-Agent";
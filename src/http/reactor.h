@@ -0,0 +1,153 @@
+#ifndef CODA_NET_HTTP_REACTOR_H
+#define CODA_NET_HTTP_REACTOR_H
+
+#include "../exception.h"
+#include "../resolver.h"
+#include "client.h"
+#include "connection_pool.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    namespace http {
+      /*!
+       * Drives many requests at once on a single background thread with
+       * non-blocking sockets.  Host names are looked up on the shared
+       * resolver's threads, and connections come from and go back to the
+       * shared connection pool.
+       */
+      class reactor {
+        public:
+        typedef http::client::completion completion_type;
+
+        reactor();
+
+        reactor(const reactor &other) = delete;
+        reactor(reactor &&other) = delete;
+
+        /*!
+         * stops the thread, failing any request not yet finished
+         */
+        virtual ~reactor();
+
+        reactor &operator=(const reactor &other) = delete;
+        reactor &operator=(reactor &&other) = delete;
+
+        /*!
+         * @returns the instance the clients share
+         */
+        static reactor &shared();
+
+        /*!
+         * Starts a request with a copy of the client's uri, headers and
+         * content
+         * @param completion called once with the result, on the background
+         * thread
+         */
+        void add(const http::client &client, http::method method,
+                 const std::string &path, const completion_type &completion);
+
+        /*!
+         * @returns the requests added but not yet completed
+         */
+        size_t pending() const noexcept;
+
+        private:
+        typedef std::chrono::steady_clock clock;
+
+        struct operation;
+
+        typedef std::unique_ptr<operation> operation_type;
+
+        /*!
+         * an answer from the resolver, waiting to be picked up
+         */
+        struct resolution {
+          uint64_t id;
+          int error;
+          resolver::endpoints_type endpoints;
+        };
+
+        /*!
+         * the background thread, driving requests until stopped
+         */
+        void run();
+
+        /*!
+         * takes an idle connection, or looks up the host to connect
+         */
+        void start(uint64_t id, operation &value);
+
+        /*!
+         * tries the next address of the host
+         * @returns false if there are none left
+         */
+        bool connect_next(operation &value);
+
+        /*!
+         * @returns what a request is waiting on its socket for
+         */
+        static short events_for(const operation &value);
+
+        /*!
+         * moves a request along once its socket is ready
+         * @returns false once it is finished
+         */
+        bool on_ready(uint64_t id, operation &value);
+
+        /*!
+         * reads and parses whatever has arrived
+         * @returns false once it is finished
+         */
+        bool on_readable(uint64_t id, operation &value);
+
+        /*!
+         * starts over on a new connection if a pooled one was found closed
+         * before it answered
+         * @returns false if it can't
+         */
+        bool retry(uint64_t id, operation &value);
+
+        /*!
+         * calls back with the response, pooling the connection if it can
+         * carry another request
+         */
+        void complete(operation &value, bool reusable);
+
+        void fail(operation &value, const char *error);
+
+        void wakeup();
+
+        // handed over by add, taken by the background thread
+        std::vector<operation_type> queued_;
+
+        // handed over by resolver threads
+        std::vector<resolution> resolved_;
+
+        // only touched by the background thread
+        std::unordered_map<uint64_t, operation_type> active_;
+
+        uint64_t next_id_;
+
+        std::atomic<size_t> pending_;
+
+        bool stopping_;
+
+        // written to wake the thread from poll
+        SOCKET wakeup_[2];
+
+        std::thread thread_;
+
+        std::mutex mutex_;
+      };
+    } // namespace http
+  }   // namespace net
+} // namespace coda
+
+#endif
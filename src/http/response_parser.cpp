@@ -0,0 +1,210 @@
+#include "response_parser.h"
+#include "../exception.h"
+#include <algorithm>
+#include <cstring>
+#include <strings.h>
+
+using namespace std;
+
+namespace coda {
+  namespace net {
+    namespace http {
+      namespace detail {
+        bool equals(std::string_view value, std::string_view other) noexcept {
+          return value.size() == other.size() &&
+                 !strncasecmp(value.data(), other.data(), other.size());
+        }
+      } // namespace detail
+
+      response_parser::response_parser(http::method method)
+          : state_(STATE_HEAD), method_(method), remaining_(0), code_(0),
+            persistent_(false) {}
+
+      size_t response_parser::parse(const char *data, size_t size) {
+        size_t pos = 0;
+
+        while (pos < size && state_ != STATE_DONE) {
+          switch (state_) {
+          case STATE_HEAD: {
+            size_t last = head_.size();
+
+            head_.append(data + pos, size - pos);
+
+            // without a status line it is a bare body up to the close, as
+            // an HTTP/0.9 server would send
+            if (head_.compare(0, min<size_t>(head_.size(), 5), "HTTP/",
+                              min<size_t>(head_.size(), 5)) != 0) {
+              pos = size;
+              state_ = STATE_UNTIL_CLOSE;
+              on_body(head_.data(), head_.size());
+              head_.clear();
+              break;
+            }
+
+            int length =
+                parse_response(head_.data(), head_.size(), parsed_, last);
+
+            if (length == PARSE_INCOMPLETE) {
+              if (head_.size() > MAX_HEAD_SIZE) {
+                throw socket_exception("response head is too large");
+              }
+              pos = size;
+              break;
+            }
+
+            if (length == PARSE_ERROR) {
+              throw socket_exception("invalid response head");
+            }
+
+            // shrinking keeps the buffer the parsed views point into
+            head_.resize(length);
+
+            pos += head_.size() - last;
+
+            on_head();
+            break;
+          }
+          case STATE_LENGTH: {
+            size_t n = min(remaining_, size - pos);
+
+            on_body(data + pos, n);
+
+            pos += n;
+
+            remaining_ -= n;
+
+            if (remaining_ == 0) {
+              state_ = STATE_DONE;
+            }
+            break;
+          }
+          case STATE_CHUNKED:
+            pos += chunks_.decode(data + pos, size - pos,
+                                  [this](const char *value, size_t length) {
+                                    on_body(value, length);
+                                  });
+
+            if (chunks_.is_complete()) {
+              state_ = STATE_DONE;
+            }
+            break;
+          case STATE_UNTIL_CLOSE:
+            on_body(data + pos, size - pos);
+            pos = size;
+            break;
+          case STATE_DONE:
+            break;
+          }
+        }
+
+        return pos;
+      }
+
+      bool response_parser::finish() {
+        if (state_ == STATE_UNTIL_CLOSE) {
+          state_ = STATE_DONE;
+        }
+
+        return state_ == STATE_DONE;
+      }
+
+      void response_parser::reset(http::method method) {
+        state_ = STATE_HEAD;
+        method_ = method;
+        head_.clear();
+        parsed_ = response_head();
+        body_.clear();
+        chunks_.reset();
+        remaining_ = 0;
+        code_ = 0;
+        persistent_ = false;
+      }
+
+      void response_parser::set_body_callback(const body_callback &value) {
+        callback_ = value;
+      }
+
+      bool response_parser::has_head() const noexcept {
+        return state_ != STATE_HEAD;
+      }
+
+      bool response_parser::is_complete() const noexcept {
+        return state_ == STATE_DONE;
+      }
+
+      bool response_parser::is_persistent() const noexcept {
+        return persistent_;
+      }
+
+      int response_parser::code() const noexcept { return code_; }
+
+      const string &response_parser::head() const noexcept { return head_; }
+
+      const string &response_parser::body() const noexcept { return body_; }
+
+      const response_head &response_parser::parsed_head() const noexcept {
+        return parsed_;
+      }
+
+      std::string_view response_parser::header(std::string_view name) const
+          noexcept {
+        if (!has_head() || head_.empty()) {
+          return std::string_view();
+        }
+        return parsed_.header(name);
+      }
+
+      void response_parser::on_head() {
+        code_ = parsed_.code;
+
+        auto connection = parsed_.header(http::HEADER_CONNECTION);
+
+        // 1.0 closes unless asked not to, 1.1 the other way round
+        persistent_ = parsed_.minor_version == 0
+                          ? detail::equals(connection, "keep-alive")
+                          : !detail::equals(connection, "close");
+
+        if (method_ == http::HEAD || code_ == 204 || code_ == 304 ||
+            (code_ >= 100 && code_ < 200)) {
+          state_ = STATE_DONE;
+          return;
+        }
+
+        auto encoding = parsed_.header(http::HEADER_TRANSFER_ENCODING);
+
+        if (is_chunked(encoding)) {
+          state_ = STATE_CHUNKED;
+          return;
+        }
+
+        auto length = parsed_.header(http::HEADER_CONTENT_LENGTH);
+
+        if (!length.empty()) {
+          if (!parse_content_length(length, remaining_)) {
+            throw socket_exception("invalid content length");
+          }
+
+          state_ = remaining_ == 0 ? STATE_DONE : STATE_LENGTH;
+          return;
+        }
+
+        // only closing the connection ends the message
+        persistent_ = false;
+
+        state_ = STATE_UNTIL_CLOSE;
+      }
+
+      void response_parser::on_body(const char *data, size_t size) {
+        if (size == 0) {
+          return;
+        }
+
+        if (callback_) {
+          callback_(data, size);
+        } else {
+          body_.append(data, size);
+        }
+      }
+    } // namespace http
+  }   // namespace net
+} // namespace coda
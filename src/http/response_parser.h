@@ -0,0 +1,151 @@
+#ifndef CODA_NET_HTTP_RESPONSE_PARSER_H
+#define CODA_NET_HTTP_RESPONSE_PARSER_H
+
+#include "parser.h"
+#include "protocol.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace coda {
+  namespace net {
+    namespace http {
+      /*!
+       * Reads an HTTP/1.x response as it arrives, in pieces of any size.
+       * The message ends where Content-Length or the last chunk says, or
+       * when the connection closes if neither is given.  Chunked bodies are
+       * decoded, and the body is either collected or handed to a callback
+       * as it comes.
+       */
+      class response_parser {
+        public:
+        /*!
+         * receives the body a piece at a time
+         */
+        typedef std::function<void(const char *data, size_t size)>
+            body_callback;
+
+        /*!
+         * the most bytes of status line and headers accepted
+         */
+        static const size_t MAX_HEAD_SIZE = 64 * 1024;
+
+        /*!
+         * @param method the request method, as a HEAD response has no body
+         */
+        response_parser(http::method method = http::GET);
+
+        /*!
+         * non-copyable, as the parsed head points into its own buffer
+         */
+        response_parser(const response_parser &other) = delete;
+        response_parser(response_parser &&other) = delete;
+        response_parser &operator=(const response_parser &other) = delete;
+        response_parser &operator=(response_parser &&other) = delete;
+
+        /*!
+         * Takes the next bytes received
+         * @returns the bytes used, fewer than given if the message ended
+         * @throws socket_exception if the message is malformed
+         */
+        size_t parse(const char *data, size_t size);
+
+        /*!
+         * tells the parser the connection has closed
+         * @returns true if that completed the message
+         */
+        bool finish();
+
+        /*!
+         * starts over for the next response
+         */
+        void reset(http::method method = http::GET);
+
+        /*!
+         * sends the body to a callback instead of collecting it
+         */
+        void set_body_callback(const body_callback &value);
+
+        /*!
+         * @returns true once the status line and headers are in
+         */
+        bool has_head() const noexcept;
+
+        /*!
+         * @returns true once the whole message is in
+         */
+        bool is_complete() const noexcept;
+
+        /*!
+         * @returns true if the connection can carry another message
+         */
+        bool is_persistent() const noexcept;
+
+        /*!
+         * @returns the status code, once the head is in
+         */
+        int code() const noexcept;
+
+        /*!
+         * @returns the status line and headers through the blank line
+         */
+        const std::string &head() const noexcept;
+
+        /*!
+         * @returns the decoded body, if it is not given to a callback
+         */
+        const std::string &body() const noexcept;
+
+        /*!
+         * @returns the parsed status line and headers, once the head is in
+         */
+        const response_head &parsed_head() const noexcept;
+
+        /*!
+         * @returns the value of a header, or empty if it is missing
+         */
+        std::string_view header(std::string_view name) const noexcept;
+
+        private:
+        typedef enum {
+          STATE_HEAD,
+          STATE_LENGTH,
+          STATE_CHUNKED,
+          STATE_UNTIL_CLOSE,
+          STATE_DONE
+        } state_type;
+
+        /*!
+         * works out how the body is framed once the head is in
+         */
+        void on_head();
+
+        void on_body(const char *data, size_t size);
+
+        state_type state_;
+
+        http::method method_;
+
+        std::string head_;
+
+        response_head parsed_;
+
+        std::string body_;
+
+        chunked_decoder chunks_;
+
+        // bytes left in a body of known length
+        size_t remaining_;
+
+        int code_;
+
+        bool persistent_;
+
+        body_callback callback_;
+      };
+    } // namespace http
+  }   // namespace net
+} // namespace coda
+
+#endif
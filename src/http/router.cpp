@@ -0,0 +1,351 @@
+#include "router.h"
+#include <cstring>
+
+using namespace std;
+
+namespace coda {
+  namespace net {
+    namespace http {
+      namespace detail {
+        /*!
+         * splits a path on '/', skipping empty segments
+         */
+        void split_path(std::string_view path,
+                        std::vector<std::string> &segments) {
+          size_t pos = 0;
+
+          while (pos < path.size()) {
+            auto next = path.find('/', pos);
+
+            if (next == std::string_view::npos) {
+              next = path.size();
+            }
+
+            if (next > pos) {
+              segments.emplace_back(path.substr(pos, next - pos));
+            }
+
+            pos = next + 1;
+          }
+        }
+      } // namespace detail
+
+      server_request::server_request(const request_head &head,
+                                     std::string_view body,
+                                     const params_type &params) noexcept
+          : head_(head), body_(body), params_(params) {}
+
+      std::string_view server_request::method() const noexcept {
+        return head_.method;
+      }
+
+      std::string_view server_request::target() const noexcept {
+        return head_.target;
+      }
+
+      std::string_view server_request::path() const noexcept {
+        return head_.target.substr(0, head_.target.find('?'));
+      }
+
+      std::string_view server_request::query() const noexcept {
+        auto pos = head_.target.find('?');
+
+        if (pos == std::string_view::npos) {
+          return std::string_view();
+        }
+
+        return head_.target.substr(pos + 1);
+      }
+
+      int server_request::minor_version() const noexcept {
+        return head_.minor_version;
+      }
+
+      std::string_view server_request::header(std::string_view name) const
+          noexcept {
+        return head_.header(name);
+      }
+
+      bool server_request::has_header(std::string_view name) const noexcept {
+        return head_.has_header(name);
+      }
+
+      std::string_view server_request::param(std::string_view name) const
+          noexcept {
+        for (const auto &p : params_) {
+          if (p.first == name) {
+            return p.second;
+          }
+        }
+        return std::string_view();
+      }
+
+      std::string_view server_request::body() const noexcept { return body_; }
+
+      const request_head &server_request::head() const noexcept {
+        return head_;
+      }
+
+      server_response::server_response() : status_(http::OK) {}
+
+      server_response &server_response::set_status(int code) {
+        status_ = code;
+        return *this;
+      }
+
+      int server_response::status() const noexcept { return status_; }
+
+      server_response &server_response::add_header(const std::string &key,
+                                                   const std::string &value) {
+        headers_.append(key).append(": ").append(value).append("\r\n");
+        return *this;
+      }
+
+      server_response &server_response::write(std::string_view value) {
+        if (shared_body_) {
+          body_.assign(*shared_body_);
+          shared_body_ = nullptr;
+        }
+        body_.append(value);
+        return *this;
+      }
+
+      server_response &server_response::set_body(std::string &&value) {
+        body_ = std::move(value);
+        shared_body_ = nullptr;
+        return *this;
+      }
+
+      server_response &
+      server_response::set_body(const std::shared_ptr<const std::string> &value) {
+        body_.clear();
+        shared_body_ = value;
+        return *this;
+      }
+
+      size_t server_response::content_length() const noexcept {
+        return shared_body_ ? shared_body_->size() : body_.size();
+      }
+
+      void server_response::send(buffered_socket &sock, int minor_version,
+                                 bool keep_alive, bool with_body) {
+        char buf[http::MAX_URL_LEN + 1] = {0};
+
+        std::string head;
+
+        head.reserve(128 + headers_.size());
+
+        snprintf(buf, http::MAX_URL_LEN, "HTTP/1.%d %d %s\r\n", minor_version,
+                 status_, reason(status_));
+
+        head.append(buf);
+
+        head.append(headers_);
+
+        // 1.1 keeps the connection by default, 1.0 has to be told
+        if (!keep_alive) {
+          head.append(http::HEADER_CONNECTION).append(": close\r\n");
+        } else if (minor_version == 0) {
+          head.append(http::HEADER_CONNECTION).append(": keep-alive\r\n");
+        }
+
+        // these never carry a body, nor say how long one would be
+        if (status_ != 204 && status_ != 304 && status_ >= 200) {
+          snprintf(buf, http::MAX_URL_LEN, "%s: %zu\r\n",
+                   http::HEADER_CONTENT_LENGTH, content_length());
+
+          head.append(buf);
+        }
+
+        head.append("\r\n");
+
+        sock.write(std::move(head));
+
+        if (!with_body || content_length() == 0) {
+          return;
+        }
+
+        if (shared_body_) {
+          sock.write(shared_body_);
+        } else {
+          sock.write(std::move(body_));
+        }
+      }
+
+      const char *server_response::reason(int code) noexcept {
+        switch (code) {
+        case 100:
+          return "Continue";
+        case 200:
+          return "OK";
+        case 201:
+          return "Created";
+        case 202:
+          return "Accepted";
+        case 204:
+          return "No Content";
+        case 301:
+          return "Moved Permanently";
+        case 302:
+          return "Found";
+        case 304:
+          return "Not Modified";
+        case 400:
+          return "Bad Request";
+        case 401:
+          return "Unauthorized";
+        case 403:
+          return "Forbidden";
+        case 404:
+          return "Not Found";
+        case 405:
+          return "Method Not Allowed";
+        case 408:
+          return "Request Timeout";
+        case 411:
+          return "Length Required";
+        case 413:
+          return "Payload Too Large";
+        case 431:
+          return "Request Header Fields Too Large";
+        case 500:
+          return "Internal Server Error";
+        case 501:
+          return "Not Implemented";
+        case 503:
+          return "Service Unavailable";
+        default:
+          return "Unknown";
+        }
+      }
+
+      router &router::route(http::method method, const std::string &pattern,
+                            const handler_type &handler,
+                            const body_handler_type &body_handler) {
+        route_type value{handler, body_handler};
+
+        if (pattern.find(':') == std::string::npos &&
+            pattern.find('*') == std::string::npos) {
+          std::string path = pattern.empty() || pattern[0] != '/'
+                                 ? "/" + pattern
+                                 : pattern;
+
+          exact_[method][path] = value;
+
+          return *this;
+        }
+
+        pattern_type entry{method, {}, value};
+
+        detail::split_path(pattern, entry.segments);
+
+        patterns_.push_back(std::move(entry));
+
+        return *this;
+      }
+
+      router &router::get(const std::string &pattern,
+                          const handler_type &handler) {
+        return route(http::GET, pattern, handler);
+      }
+
+      router &router::post(const std::string &pattern,
+                           const handler_type &handler) {
+        return route(http::POST, pattern, handler);
+      }
+
+      router &router::put(const std::string &pattern,
+                          const handler_type &handler) {
+        return route(http::PUT, pattern, handler);
+      }
+
+      router &router::de1ete(const std::string &pattern,
+                             const handler_type &handler) {
+        return route(http::DELETE, pattern, handler);
+      }
+
+      const router::route_type *
+      router::find(http::method method, std::string_view path,
+                   server_request::params_type &params) const {
+        auto &exact = exact_[method];
+
+        if (!exact.empty()) {
+          auto it = exact.find(std::string(path));
+
+          if (it != exact.end()) {
+            return &it->second;
+          }
+        }
+
+        for (const auto &pattern : patterns_) {
+          if (pattern.method != method) {
+            continue;
+          }
+
+          params.clear();
+
+          if (match(pattern, path, params)) {
+            return &pattern.route;
+          }
+        }
+
+        params.clear();
+
+        return nullptr;
+      }
+
+      int router::method_of(std::string_view name) noexcept {
+        for (size_t i = 0; i < sizeof(method_names) / sizeof(method_names[0]);
+             i++) {
+          if (name == method_names[i]) {
+            return static_cast<int>(i);
+          }
+        }
+        return -1;
+      }
+
+      bool router::match(const pattern_type &pattern, std::string_view path,
+                         server_request::params_type &params) {
+        size_t pos = 0;
+
+        for (const auto &segment : pattern.segments) {
+          while (pos < path.size() && path[pos] == '/') {
+            pos++;
+          }
+
+          if (segment == "*") {
+            return true;
+          }
+
+          if (pos >= path.size()) {
+            return false;
+          }
+
+          auto next = path.find('/', pos);
+
+          if (next == std::string_view::npos) {
+            next = path.size();
+          }
+
+          auto value = path.substr(pos, next - pos);
+
+          if (segment[0] == ':') {
+            params.emplace_back(
+                std::string_view(segment).substr(1), value);
+          } else if (segment != value) {
+            return false;
+          }
+
+          pos = next;
+        }
+
+        // everything must have been matched
+        while (pos < path.size() && path[pos] == '/') {
+          pos++;
+        }
+
+        return pos == path.size();
+      }
+    } // namespace http
+  }   // namespace net
+} // namespace coda
@@ -0,0 +1,214 @@
+#ifndef CODA_NET_HTTP_ROUTER_H
+#define CODA_NET_HTTP_ROUTER_H
+
+#include "../buffered_socket.h"
+#include "parser.h"
+#include "protocol.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    namespace http {
+      /*!
+       * A request received by the server.  The method, target and headers
+       * point into the connection's buffers, so they are only valid while
+       * the handler runs.
+       */
+      class server_request {
+        public:
+        typedef std::vector<std::pair<std::string_view, std::string_view>>
+            params_type;
+
+        server_request(const request_head &head, std::string_view body,
+                       const params_type &params) noexcept;
+
+        std::string_view method() const noexcept;
+
+        /*!
+         * @returns the path and query as requested
+         */
+        std::string_view target() const noexcept;
+
+        /*!
+         * @returns the target without the query
+         */
+        std::string_view path() const noexcept;
+
+        /*!
+         * @returns the part of the target after the '?', if any
+         */
+        std::string_view query() const noexcept;
+
+        /*!
+         * @returns the x in HTTP/1.x
+         */
+        int minor_version() const noexcept;
+
+        /*!
+         * @returns the value of a header, or empty if it is missing
+         */
+        std::string_view header(std::string_view name) const noexcept;
+
+        bool has_header(std::string_view name) const noexcept;
+
+        /*!
+         * @returns the value of a ":name" segment in the route, or empty
+         */
+        std::string_view param(std::string_view name) const noexcept;
+
+        /*!
+         * @returns the whole body, or empty if the route streams it
+         */
+        std::string_view body() const noexcept;
+
+        const request_head &head() const noexcept;
+
+        private:
+        const request_head &head_;
+        std::string_view body_;
+        const params_type &params_;
+      };
+
+      /*!
+       * The reply a handler builds.  The head and body are queued as
+       * separate segments, so a shared body is sent without being copied.
+       */
+      class server_response {
+        public:
+        server_response();
+
+        /*!
+         * sets the status code, 200 by default
+         */
+        server_response &set_status(int code);
+
+        int status() const noexcept;
+
+        /*!
+         * adds a header.  Content-Length and Connection are set by the
+         * server.
+         */
+        server_response &add_header(const std::string &key,
+                                    const std::string &value);
+
+        /*!
+         * appends to the body
+         */
+        server_response &write(std::string_view value);
+
+        /*!
+         * replaces the body without copying it
+         */
+        server_response &set_body(std::string &&value);
+
+        /*!
+         * replaces the body with one that can be shared between responses
+         */
+        server_response &set_body(const std::shared_ptr<const std::string> &value);
+
+        /*!
+         * @returns the length of the body
+         */
+        size_t content_length() const noexcept;
+
+        /*!
+         * Queues the status line and headers, then the body as a segment of
+         * its own, on a connection
+         * @param with_body false to leave the body out, as for HEAD
+         */
+        void send(buffered_socket &sock, int minor_version, bool keep_alive,
+                  bool with_body);
+
+        /*!
+         * @returns the usual reason phrase for a status code
+         */
+        static const char *reason(int code) noexcept;
+
+        private:
+        int status_;
+        std::string headers_;
+        std::string body_;
+        std::shared_ptr<const std::string> shared_body_;
+      };
+
+      /*!
+       * Matches requests to handlers by method and path.  A path segment
+       * starting with ':' matches any one segment and is passed on as a
+       * param, and a final "*" matches the rest of the path.  Routes are
+       * meant to be added before the server starts, as reactors read them
+       * without a lock.
+       */
+      class router {
+        public:
+        typedef std::function<void(const server_request &, server_response &)>
+            handler_type;
+
+        /*!
+         * receives a request body a piece at a time, before the handler
+         */
+        typedef std::function<void(const server_request &, const char *data,
+                                   size_t size)>
+            body_handler_type;
+
+        struct route_type {
+          handler_type handler;
+          body_handler_type body_handler;
+        };
+
+        /*!
+         * adds a route
+         * @param body_handler streams the body instead of collecting it
+         */
+        router &route(http::method method, const std::string &pattern,
+                      const handler_type &handler,
+                      const body_handler_type &body_handler = nullptr);
+
+        router &get(const std::string &pattern, const handler_type &handler);
+
+        router &post(const std::string &pattern, const handler_type &handler);
+
+        router &put(const std::string &pattern, const handler_type &handler);
+
+        router &de1ete(const std::string &pattern, const handler_type &handler);
+
+        /*!
+         * Finds the route for a request, exact paths first, then patterns in
+         * the order they were added
+         * @param params receives the ":name" segments
+         * @returns the route, or null if there is none
+         */
+        const route_type *find(http::method method, std::string_view path,
+                               server_request::params_type &params) const;
+
+        /*!
+         * @returns the method of a request method name, or -1 if unknown
+         */
+        static int method_of(std::string_view name) noexcept;
+
+        private:
+        struct pattern_type {
+          http::method method;
+          std::vector<std::string> segments;
+          route_type route;
+        };
+
+        static bool match(const pattern_type &pattern, std::string_view path,
+                          server_request::params_type &params);
+
+        // paths without patterns, by method
+        std::unordered_map<std::string, route_type>
+            exact_[sizeof(method_names) / sizeof(method_names[0])];
+
+        std::vector<pattern_type> patterns_;
+      };
+    } // namespace http
+  }   // namespace net
+} // namespace coda
+
+#endif
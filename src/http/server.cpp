@@ -0,0 +1,409 @@
+#include "server.h"
+#include "../exception.h"
+#include <cstring>
+#include <strings.h>
+
+using namespace std;
+
+namespace coda {
+  namespace net {
+    namespace http {
+      namespace detail {
+        bool same(std::string_view value, const char *other) noexcept {
+          return value.size() == strlen(other) &&
+                 !strncasecmp(value.data(), other, value.size());
+        }
+
+        /*!
+         * A connection to the server.  It reads requests from its input
+         * buffer as they arrive and queues each response behind the last.
+         */
+        class connection : public buffered_socket {
+          public:
+          connection(http::server &server, SOCKET sock,
+                     const sockaddr_storage &addr);
+
+          protected:
+          virtual void on_did_read();
+
+          virtual void on_did_write();
+
+          private:
+          typedef enum { STATE_HEAD, STATE_BODY, STATE_CLOSING } state_type;
+
+          /*!
+           * looks at a parsed head, and answers it straight away if its body
+           * is already here
+           * @returns false if the request was refused
+           */
+          bool begin_request(const char *data, size_t length, size_t size);
+
+          /*!
+           * takes body bytes for the current request
+           * @returns the bytes used
+           */
+          size_t read_body(const char *data, size_t size);
+
+          /*!
+           * runs the handler and queues its response
+           */
+          void dispatch(std::string_view body);
+
+          /*!
+           * answers with an error and closes once it is sent
+           */
+          void fail(int code);
+
+          void on_body(const char *data, size_t size);
+
+          /*!
+           * looks up the route for the current head, letting HEAD use GET
+           */
+          void find_route();
+
+          http::server &server_;
+
+          state_type state_;
+
+          request_head head_;
+
+          // the head, copied out of the input while its body arrives
+          std::string head_copy_;
+
+          // how much input an incomplete head was parsed from
+          size_t last_size_;
+
+          http::method method_;
+
+          const router::route_type *route_;
+
+          server_request::params_type params_;
+
+          bool keep_alive_;
+
+          bool chunked_;
+
+          chunked_decoder chunks_;
+
+          // body bytes left when the length is known
+          size_t remaining_;
+
+          std::string body_;
+
+          bool too_large_;
+        };
+
+        /*!
+         * creates http connections for the server
+         */
+        class connection_factory : public socket_factory {
+          public:
+          socket_type create_socket(const server_type &server, SOCKET sock,
+                                    const struct sockaddr_storage &addr) {
+            auto http = static_cast<http::server *>(server);
+
+            auto value = std::make_shared<connection>(*http, sock, addr);
+
+            value->set_non_blocking(server->is_non_blocking());
+
+            return value;
+          }
+        };
+
+        connection::connection(http::server &server, SOCKET sock,
+                               const sockaddr_storage &addr)
+            : buffered_socket(sock, addr), server_(server), state_(STATE_HEAD),
+              last_size_(0), method_(http::GET), route_(nullptr),
+              keep_alive_(false), chunked_(false), remaining_(0),
+              too_large_(false) {}
+
+        void connection::on_did_read() {
+          while (state_ != STATE_CLOSING && !inBuffer_.empty()) {
+            // let the client read what it has before asking for more
+            if (pending_output() > http::server::MAX_PENDING_OUTPUT) {
+              // the reactor keeps reading, so stop a pipelining client that
+              // never reads from growing the input without limit
+              if (inBuffer_.size() > http::server::MAX_PENDING_INPUT) {
+                state_ = STATE_CLOSING;
+                inBuffer_.clear();
+                close();
+              }
+              return;
+            }
+
+            auto input = inBuffer_.readable();
+
+            auto data = reinterpret_cast<const char *>(input.data());
+
+            if (state_ == STATE_BODY) {
+              inBuffer_.consume(read_body(data, input.size()));
+              continue;
+            }
+
+            int length = parse_request(data, input.size(), head_, last_size_);
+
+            if (length == PARSE_INCOMPLETE) {
+              if (input.size() > http::server::MAX_HEAD_SIZE) {
+                fail(431);
+              } else {
+                last_size_ = input.size();
+              }
+              return;
+            }
+
+            last_size_ = 0;
+
+            if (length == PARSE_ERROR) {
+              fail(400);
+              return;
+            }
+
+            if (!begin_request(data, length, input.size())) {
+              return;
+            }
+          }
+        }
+
+        void connection::on_did_write() {
+          if (state_ == STATE_CLOSING) {
+            close();
+            return;
+          }
+
+          // requests held back by a full output queue
+          if (!inBuffer_.empty()) {
+            on_did_read();
+          }
+        }
+
+        bool connection::begin_request(const char *data, size_t length,
+                                       size_t size) {
+          int method = router::method_of(head_.method);
+
+          if (method < 0) {
+            fail(501);
+            return false;
+          }
+
+          method_ = static_cast<http::method>(method);
+
+          auto connection = head_.header(http::HEADER_CONNECTION);
+
+          keep_alive_ = head_.minor_version == 0
+                            ? same(connection, "keep-alive")
+                            : !same(connection, "close");
+
+          chunked_ = false;
+
+          remaining_ = 0;
+
+          bool has_encoding = head_.has_header(http::HEADER_TRANSFER_ENCODING);
+
+          bool has_length = head_.has_header(http::HEADER_CONTENT_LENGTH);
+
+          // a proxy in front may frame the body by another of the copies, or
+          // by both at once, which is how requests are smuggled
+          if (head_.count_header(http::HEADER_TRANSFER_ENCODING) > 1 ||
+              head_.count_header(http::HEADER_CONTENT_LENGTH) > 1 ||
+              (has_encoding && has_length)) {
+            fail(400);
+            return false;
+          }
+
+          if (has_encoding) {
+            if (!is_chunked(head_.header(http::HEADER_TRANSFER_ENCODING))) {
+              fail(400);
+              return false;
+            }
+
+            chunked_ = true;
+
+            chunks_.reset();
+          } else if (has_length &&
+                     !parse_content_length(
+                         head_.header(http::HEADER_CONTENT_LENGTH),
+                         remaining_)) {
+            fail(400);
+            return false;
+          }
+
+          bool has_body = chunked_ || remaining_ > 0;
+
+          // the whole request is here, so the head can stay where it is
+          if (!chunked_ && size - length >= remaining_) {
+            find_route();
+
+            std::string_view body(data + length, remaining_);
+
+            if (route_ != nullptr && route_->body_handler && has_body) {
+              route_->body_handler(
+                  server_request(head_, std::string_view(), params_),
+                  body.data(), body.size());
+
+              body = std::string_view();
+            } else if (body.size() > server_.max_body_size()) {
+              fail(413);
+              return false;
+            }
+
+            dispatch(body);
+
+            inBuffer_.consume(length + remaining_);
+
+            remaining_ = 0;
+
+            return true;
+          }
+
+          // the views must outlive the input they were parsed from
+          head_copy_.assign(data, length);
+
+          parse_request(head_copy_.data(), head_copy_.size(), head_);
+
+          inBuffer_.consume(length);
+
+          find_route();
+
+          if (!chunked_ && remaining_ > server_.max_body_size() &&
+              (route_ == nullptr || !route_->body_handler)) {
+            fail(413);
+            return false;
+          }
+
+          auto expect = head_.header("Expect");
+
+          if (same(expect, "100-continue")) {
+            write("HTTP/1.1 100 Continue\r\n\r\n");
+          }
+
+          body_.clear();
+
+          too_large_ = false;
+
+          state_ = STATE_BODY;
+
+          return true;
+        }
+
+        size_t connection::read_body(const char *data, size_t size) {
+          size_t used = 0;
+
+          if (chunked_) {
+            try {
+              used = chunks_.decode(
+                  data, size,
+                  [this](const char *value, size_t n) { on_body(value, n); });
+            } catch (const socket_exception &e) {
+              fail(400);
+              return 0;
+            }
+          } else {
+            used = std::min(remaining_, size);
+
+            on_body(data, used);
+
+            remaining_ -= used;
+          }
+
+          if (too_large_) {
+            fail(413);
+            return 0;
+          }
+
+          if (chunked_ ? chunks_.is_complete() : remaining_ == 0) {
+            state_ = STATE_HEAD;
+
+            dispatch(body_);
+
+            body_.clear();
+          }
+
+          return used;
+        }
+
+        void connection::find_route() {
+          auto path = head_.target.substr(0, head_.target.find('?'));
+
+          params_.clear();
+
+          route_ = server_.routes().find(method_, path, params_);
+
+          if (route_ == nullptr && method_ == http::HEAD) {
+            route_ = server_.routes().find(http::GET, path, params_);
+          }
+        }
+
+        void connection::on_body(const char *data, size_t size) {
+          if (route_ != nullptr && route_->body_handler) {
+            route_->body_handler(
+                server_request(head_, std::string_view(), params_), data,
+                size);
+            return;
+          }
+
+          // a body with nowhere to go is read past
+          if (route_ == nullptr || too_large_) {
+            return;
+          }
+
+          if (body_.size() + size > server_.max_body_size()) {
+            too_large_ = true;
+            return;
+          }
+
+          body_.append(data, size);
+        }
+
+        void connection::dispatch(std::string_view body) {
+          server_request request(head_, body, params_);
+
+          server_response response;
+
+          if (route_ == nullptr) {
+            response.set_status(404);
+          } else {
+            try {
+              route_->handler(request, response);
+            } catch (const std::exception &e) {
+              response = server_response();
+              response.set_status(500);
+            }
+          }
+
+          response.send(*this, head_.minor_version, keep_alive_,
+                        method_ != http::HEAD);
+
+          if (!keep_alive_) {
+            state_ = STATE_CLOSING;
+          }
+        }
+
+        void connection::fail(int code) {
+          server_response response;
+
+          response.set_status(code);
+
+          response.send(*this, 1, false, true);
+
+          state_ = STATE_CLOSING;
+
+          inBuffer_.clear();
+        }
+      } // namespace detail
+
+      server::server()
+          : sync::server(std::make_shared<detail::connection_factory>()),
+            max_body_size_(DEFAULT_MAX_BODY_SIZE) {}
+
+      router &server::routes() noexcept { return routes_; }
+
+      const router &server::routes() const noexcept { return routes_; }
+
+      void server::set_max_body_size(size_t value) noexcept {
+        max_body_size_ = value;
+      }
+
+      size_t server::max_body_size() const noexcept { return max_body_size_; }
+    } // namespace http
+  }   // namespace net
+} // namespace coda
@@ -0,0 +1,68 @@
+#ifndef CODA_NET_HTTP_SERVER_H
+#define CODA_NET_HTTP_SERVER_H
+
+#include "../sync/server.h"
+#include "router.h"
+
+namespace coda {
+  namespace net {
+    namespace http {
+      /*!
+       * An HTTP/1.1 server on the sync server's reactors.  Connections are
+       * kept alive, pipelined requests are answered in order, and each
+       * request is handed to the handler its route names.  Handlers run on
+       * the reactor thread that owns the connection, so with more than one
+       * thread they must be safe to run at once.
+       */
+      class server : public sync::server {
+        public:
+        /*!
+         * the most bytes of request line and headers accepted
+         */
+        static const size_t MAX_HEAD_SIZE = 64 * 1024;
+
+        static const size_t DEFAULT_MAX_BODY_SIZE = 1024 * 1024;
+
+        /*!
+         * past this much unsent output, pipelined requests wait their turn
+         */
+        static const size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+
+        /*!
+         * past this much held back input, a client that is not reading its
+         * responses is disconnected
+         */
+        static const size_t MAX_PENDING_INPUT = 4 * 1024 * 1024;
+
+        server();
+
+        server(const server &other) = delete;
+        server(server &&other) = delete;
+        server &operator=(const server &other) = delete;
+        server &operator=(server &&other) = delete;
+
+        /*!
+         * @returns the routes, to add to before the server starts
+         */
+        router &routes() noexcept;
+
+        const router &routes() const noexcept;
+
+        /*!
+         * Sets the largest body collected for a handler.  Bodies streamed to
+         * a body handler are not limited.
+         */
+        void set_max_body_size(size_t value) noexcept;
+
+        size_t max_body_size() const noexcept;
+
+        private:
+        router routes_;
+
+        size_t max_body_size_;
+      };
+    } // namespace http
+  }   // namespace net
+} // namespace coda
+
+#endif
@@ -1,51 +1,123 @@
 #include "../buffered_socket.h"
 #include "../exception.h"
+#include "../secure_layer.h"
 #include "../uri.h"
 #include "client.h"
+#include "connection_pool.h"
+#include "reactor.h"
+#include "response_parser.h"
+#include <arpa/inet.h>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
 #include <strings.h>
+#include <unistd.h>
 
 using namespace std;
 
 namespace coda {
   namespace net {
     namespace http {
-      namespace socket {
-        std::string request(http::client &client, http::method method,
-                            const string &userPath) {
-          char buf[http::MAX_URL_LEN + 1] = {0};
+      namespace detail {
+        void append_line(std::string &message, const char *line) {
+          message.append(line).append("\r\n");
+        }
 
-          buffered_socket sock;
+        /*!
+         * Reads one response, stopping at the end of its message so the
+         * connection can carry another.  Interim 1xx responses are skipped.
+         * @param received set to true if any of the response arrived
+         * @returns true if the connection may be reused
+         */
+        bool read_response(net::socket &sock, response_parser &parser,
+                           http::method method, bool &received) {
+          buffer input;
 
-          std::string path = userPath;
+          for (;;) {
+            int status = sock.recv_into(input);
 
-          net::uri uri = client.uri();
+            if (status <= 0) {
+              if (status == 0 && parser.finish()) {
+                return false;
+              }
+              if (!received) {
+                return false;
+              }
+              throw socket_exception("connection closed before the response "
+                                     "was complete");
+            }
 
-          std::string content = client.content();
+            received = true;
 
-          if (client.is_secure()) {
-            sock.set_secure(true);
-          }
+            auto data = input.readable();
 
-          if (!uri.port().empty()) {
-            int port = stoi(uri.port());
+            auto pos = reinterpret_cast<const char *>(data.data());
 
-            if (!sock.connect(uri.host(), port)) {
-              throw socket_exception("unable to connect to " + uri.to_string());
+            size_t size = data.size();
+
+            size_t used = parser.parse(pos, size);
+
+            while (parser.is_complete() && parser.code() >= 100 &&
+                   parser.code() < 200 && parser.code() != 101) {
+              parser.reset(method);
+
+              pos += used;
+              size -= used;
+
+              used = parser.parse(pos, size);
             }
-          } else {
-            if (!sock.connect(uri.host(), client.is_secure()
-                                              ? http::DEFAULT_SECURE_PORT
-                                              : http::DEFAULT_PORT)) {
-              throw socket_exception("unable to connect to " + uri.to_string());
+
+            if (parser.is_complete()) {
+              // anything past the message answers no request of ours
+              return parser.is_persistent() && used == size;
             }
+
+            input.clear();
           }
+        }
+
+        /*!
+         * where a client's requests go
+         */
+        struct destination {
+          std::string scheme;
+          std::string host;
+          int port;
+        };
+
+        destination destination_of(const http::client &client) {
+          net::uri uri = client.uri();
+
+          std::string scheme =
+              client.is_secure() ? http::SECURE_PROTOCOL : http::PROTOCOL;
+
+          int port = !uri.port().empty() ? stoi(uri.port())
+                                         : client.is_secure()
+                                               ? http::DEFAULT_SECURE_PORT
+                                               : http::DEFAULT_PORT;
+
+          return {scheme, uri.host(), port};
+        }
+
+        /*!
+         * Writes out the request line, headers and content
+         * @returns true if the connection may carry another request
+         */
+        bool build_request(http::client &client, http::method method,
+                           const string &userPath, std::string &message) {
+          char buf[http::MAX_URL_LEN + 1] = {0};
+
+          std::string path = userPath;
+
+          net::uri uri = client.uri();
+
+          std::string content = client.content();
 
           if (path.empty()) {
             path = uri.full_path();
           }
 
           // send the method and path
-
           if (path.empty())
             snprintf(buf, http::MAX_URL_LEN, http::REQUEST_PREAMBLE,
                      http::method_names[method], "/", client.version().c_str());
@@ -58,7 +130,7 @@ namespace coda {
                      http::method_names[method], ("/" + path).c_str(),
                      client.version().c_str());
 
-          sock.writeln(buf);
+          detail::append_line(message, buf);
 
           bool chunked =
               client.has_header(http::HEADER_TRANSFER_ENCODING) &&
@@ -69,61 +141,728 @@ namespace coda {
           if (!client.has_header(http::HEADER_HOST)) {
             snprintf(buf, http::MAX_URL_LEN, "%s: %s", http::HEADER_HOST,
                      uri.host().c_str());
-            sock.writeln(buf);
+            detail::append_line(message, buf);
           }
 
           if (!client.has_header(http::HEADER_ACCEPT)) {
             snprintf(buf, http::MAX_URL_LEN, "%s: */*", http::HEADER_ACCEPT);
-            sock.writeln(buf);
+            detail::append_line(message, buf);
           }
 
-          if (!client.has_header(http::HEADER_CONNECTION)) {
-            snprintf(buf, http::MAX_URL_LEN, "%s: close",
+          // 1.1 connections persist unless asked otherwise
+          bool keep_alive = true;
+
+          if (client.has_header(http::HEADER_CONNECTION)) {
+            keep_alive = strcasecmp(
+                client.header(http::HEADER_CONNECTION).c_str(), "close");
+          } else if (client.version() == http::VERSION_1_0) {
+            snprintf(buf, http::MAX_URL_LEN, "%s: keep-alive",
                      http::HEADER_CONNECTION);
-            sock.writeln(buf);
+            detail::append_line(message, buf);
           }
 
           // add the headers
           for (const auto &h : client.headers()) {
             snprintf(buf, http::MAX_URL_LEN, "%s: %s", h.first.c_str(),
                      h.second.c_str());
-            sock.writeln(buf);
+            detail::append_line(message, buf);
           }
 
           // if we have a content, add the size
           if (!chunked && !content.empty()) {
             snprintf(buf, http::MAX_URL_LEN, "%s: %zu",
-                     http::HEADER_CONTENT_SIZE, content.size());
-            sock.writeln(buf);
+                     http::HEADER_CONTENT_LENGTH, content.size());
+            detail::append_line(message, buf);
           }
 
           // finish header
-          sock.writeln();
+          detail::append_line(message, "");
 
           // add the content
-          if (!content.empty()) {
-            sock.write(content);
-          }
+          message += content;
 
 #ifdef DEBUG
-          cout << string(sock.output().begin(), sock.output().end());
+          cout << message;
 #endif
 
-          if (!sock.write_from_buffer()) {
-            throw socket_exception("unable to write to socket");
+          return keep_alive;
+        }
+      } // namespace detail
+
+      namespace socket {
+        std::string request(http::client &client, http::method method,
+                            const string &userPath) {
+          std::string message;
+
+          bool keep_alive =
+              detail::build_request(client, method, userPath, message);
+
+          auto to = detail::destination_of(client);
+
+          auto &pool = connection_pool::shared();
+
+          // a pooled connection the server has just closed fails before any
+          // response, so that one is worth a single retry on a new connection
+          for (bool retry = true;; retry = false) {
+            bool reused = false;
+
+            auto sock = pool.acquire(to.scheme, to.host, to.port, reused);
+
+            if (!sock) {
+              throw socket_exception("unable to connect to " +
+                                     client.uri().to_string());
+            }
+
+            sock->write(message);
+
+            if (!sock->write_from_buffer()) {
+              if (reused && retry) {
+                continue;
+              }
+              throw socket_exception("unable to write to socket");
+            }
+
+            response_parser parser(method);
+
+            parser.set_body_callback(client.body_callback());
+
+            bool received = false;
+
+            bool reusable =
+                detail::read_response(*sock, parser, method, received);
+
+            if (!received) {
+              if (reused && retry) {
+                continue;
+              }
+              throw socket_exception("unable to read from socket");
+            }
+
+            if (keep_alive && reusable) {
+              pool.release(to.scheme, to.host, to.port, sock);
+            }
+
+            // a streamed body has already gone to the callback
+            return parser.head() + parser.body();
+          }
+        }
+
+        void request_async(const http::client &client, http::method method,
+                           const std::string &path,
+                           const client::completion &completion) {
+          reactor::shared().add(client, method, path, completion);
+        }
+      } // namespace socket
+
+      /*!
+       * a request in flight and everything it needs until it completes
+       */
+      struct reactor::operation {
+        typedef enum {
+          STATE_RESOLVING,
+          STATE_CONNECTING,
+          STATE_HANDSHAKING,
+          STATE_WRITING,
+          STATE_READING
+        } state_type;
+
+        operation(http::method method) : method(method), parser(method) {}
+
+        ~operation() {
+          if (connecting != net::socket::INVALID) {
+            closesocket(connecting);
+          }
+        }
+
+        state_type state = STATE_RESOLVING;
+
+        detail::destination to;
+
+        http::method method;
+
+        std::string message;
+
+        bool keep_alive = true;
+
+        response_parser parser;
+
+        completion_type completion;
+
+        connection_pool::connection_type sock;
+
+        // a descriptor whose connect is in progress
+        SOCKET connecting = net::socket::INVALID;
+
+        sockaddr_storage addr;
+
+        resolver::endpoints_type endpoints;
+
+        size_t next_endpoint = 0;
+
+        buffer input;
+
+        // the connection came from the pool
+        bool reused = false;
+
+        bool retried = false;
+
+        // some of the response has arrived
+        bool received = false;
+
+        // zero for no limit
+        clock::time_point deadline;
+      };
+
+      reactor::reactor() : next_id_(0), pending_(0), stopping_(false) {
+        if (::pipe(wakeup_) != 0) {
+          throw socket_exception("unable to create reactor wakeup");
+        }
+
+        fcntl(wakeup_[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakeup_[1], F_SETFL, O_NONBLOCK);
+      }
+
+      reactor::~reactor() {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+
+          stopping_ = true;
+        }
+
+        wakeup();
+
+        if (thread_.joinable()) {
+          thread_.join();
+        }
+
+        for (auto &value : queued_) {
+          fail(*value, "reactor stopped");
+        }
+
+        ::close(wakeup_[0]);
+        ::close(wakeup_[1]);
+      }
+
+      reactor &reactor::shared() {
+        static reactor instance;
+
+        return instance;
+      }
+
+      void reactor::add(const http::client &client, http::method method,
+                        const std::string &path,
+                        const completion_type &completion) {
+        // the headers are read through a copy, as the lookups aren't const
+        http::client request(client);
+
+        auto value = std::make_unique<operation>(method);
+
+        value->keep_alive =
+            detail::build_request(request, method, path, value->message);
+
+        value->to = detail::destination_of(request);
+
+        value->parser.set_body_callback(request.body_callback());
+
+        value->completion = completion;
+
+        if (request.timeout() > 0) {
+          value->deadline = clock::now() + std::chrono::seconds(request.timeout());
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+
+          if (stopping_) {
+            throw socket_exception("reactor is stopping");
           }
 
-          if (!sock.read_to_buffer()) {
-            throw socket_exception("unable to read from socket");
+          queued_.push_back(std::move(value));
+
+          pending_++;
+
+          // the thread starts with the first request
+          if (!thread_.joinable()) {
+            thread_ = std::thread(&reactor::run, this);
           }
+        }
+
+        wakeup();
+      }
+
+      size_t reactor::pending() const noexcept { return pending_; }
 
-          auto input = sock.input();
+      void reactor::wakeup() {
+        char c = 0;
 
-          return string(input.begin(), input.end());
+        // a full pipe already has a wakeup waiting
+        if (::write(wakeup_[1], &c, 1) < 0) {
+          return;
         }
-      } // namespace socket
+      }
+
+      void reactor::run() {
+        std::vector<operation_type> added;
+
+        std::vector<resolution> answers;
+
+        std::vector<struct pollfd> fds;
+
+        std::vector<uint64_t> ids;
+
+        for (;;) {
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (stopping_) {
+              break;
+            }
+
+            added.swap(queued_);
+
+            answers.swap(resolved_);
+          }
+
+          for (auto &value : added) {
+            auto id = next_id_++;
+
+            auto &op = *value;
+
+            active_.emplace(id, std::move(value));
+
+            start(id, op);
+          }
+
+          added.clear();
+
+          for (auto &answer : answers) {
+            auto it = active_.find(answer.id);
+
+            // finished while it was being looked up
+            if (it == active_.end()) {
+              continue;
+            }
+
+            auto &op = *it->second;
+
+            if (answer.error != 0) {
+              fail(op, gai_strerror(answer.error));
+              active_.erase(it);
+              continue;
+            }
+
+            op.endpoints = answer.endpoints;
+
+            op.next_endpoint = 0;
+
+            if (!connect_next(op)) {
+              fail(op, "unable to connect");
+              active_.erase(it);
+            }
+          }
+
+          answers.clear();
+
+          fds.clear();
+
+          ids.clear();
+
+          fds.push_back({wakeup_[0], POLLIN, 0});
+
+          ids.push_back(0);
+
+          auto now = clock::now();
+
+          auto until = clock::time_point::max();
+
+          for (auto it = active_.begin(); it != active_.end();) {
+            auto &op = *it->second;
+
+            if (op.deadline != clock::time_point() && op.deadline <= now) {
+              fail(op, "request timed out");
+              it = active_.erase(it);
+              continue;
+            }
+
+            if (op.deadline != clock::time_point()) {
+              until = std::min(until, op.deadline);
+            }
+
+            switch (op.state) {
+            case operation::STATE_CONNECTING:
+              fds.push_back({op.connecting, POLLOUT, 0});
+              ids.push_back(it->first);
+              break;
+            case operation::STATE_HANDSHAKING:
+            case operation::STATE_WRITING:
+            case operation::STATE_READING:
+              fds.push_back({op.sock->raw_socket(), events_for(op), 0});
+              ids.push_back(it->first);
+              break;
+            default:
+              break;
+            }
+
+            ++it;
+          }
+
+          int wait = -1;
+
+          if (until != clock::time_point::max()) {
+            wait = static_cast<int>(
+                       std::chrono::duration_cast<std::chrono::milliseconds>(
+                           until - now)
+                           .count()) +
+                   1;
+          }
+
+          if (::poll(fds.data(), fds.size(), wait) < 0) {
+            continue;
+          }
+
+          if (fds[0].revents != 0) {
+            char drain[64];
+
+            while (::read(wakeup_[0], drain, sizeof(drain)) > 0) {
+            }
+          }
+
+          for (size_t i = 1; i < fds.size(); i++) {
+            if (fds[i].revents == 0) {
+              continue;
+            }
+
+            auto it = active_.find(ids[i]);
+
+            if (it == active_.end()) {
+              continue;
+            }
+
+            // finished requests have already called back
+            if (!on_ready(it->first, *it->second)) {
+              active_.erase(it);
+            }
+          }
+        }
+
+        for (auto &it : active_) {
+          fail(*it.second, "reactor stopped");
+        }
+
+        active_.clear();
+      }
+
+      short reactor::events_for(const operation &value) {
+        // a secure session can need the socket the other way for a while
+        if (value.sock->wants_write()) {
+          return POLLOUT;
+        }
+
+        if (value.state == operation::STATE_WRITING) {
+          return value.sock->send_wants_read() ? POLLIN : POLLOUT;
+        }
+
+        return POLLIN;
+      }
+
+      void reactor::start(uint64_t id, operation &value) {
+        auto &pool = connection_pool::shared();
+
+        value.sock = pool.take_idle(value.to.scheme, value.to.host, value.to.port);
+
+        value.reused = value.sock != nullptr;
+
+        if (value.reused) {
+          value.sock->set_non_blocking(true);
+
+          value.sock->write(value.message);
+
+          value.state = operation::STATE_WRITING;
+          return;
+        }
+
+        value.state = operation::STATE_RESOLVING;
+
+        resolver::shared().resolve(
+            value.to.host,
+            [this, id](int error, const resolver::endpoints_type &endpoints) {
+              {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                resolved_.push_back({id, error, endpoints});
+              }
+
+              wakeup();
+            });
+      }
+
+      bool reactor::connect_next(operation &value) {
+        if (value.connecting != net::socket::INVALID) {
+          closesocket(value.connecting);
+
+          value.connecting = net::socket::INVALID;
+        }
+
+        while (value.endpoints && value.next_endpoint < value.endpoints->size()) {
+          auto &endpoint = (*value.endpoints)[value.next_endpoint++];
+
+          SOCKET sock =
+              ::socket(endpoint.family, endpoint.socktype, endpoint.protocol);
+
+          if (sock == net::socket::INVALID) {
+            continue;
+          }
+
+          fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+          memset(&value.addr, 0, sizeof(value.addr));
+          memmove(&value.addr, &endpoint.addr, endpoint.length);
+
+          // the resolver leaves the port out
+          if (endpoint.family == AF_INET6) {
+            reinterpret_cast<sockaddr_in6 *>(&value.addr)->sin6_port =
+                htons(value.to.port);
+          } else {
+            reinterpret_cast<sockaddr_in *>(&value.addr)->sin_port =
+                htons(value.to.port);
+          }
+
+          if (::connect(sock, reinterpret_cast<const sockaddr *>(&value.addr),
+                        endpoint.length) == 0 ||
+              errno == EINPROGRESS) {
+            value.connecting = sock;
+
+            value.state = operation::STATE_CONNECTING;
+
+            return true;
+          }
+
+          closesocket(sock);
+        }
+
+        return false;
+      }
+
+      bool reactor::on_ready(uint64_t id, operation &value) {
+        switch (value.state) {
+        case operation::STATE_CONNECTING: {
+          int status = 0;
+
+          socklen_t length = sizeof(status);
+
+          if (getsockopt(value.connecting, SOL_SOCKET, SO_ERROR, &status,
+                         &length) != 0 ||
+              status != 0) {
+            if (connect_next(value)) {
+              return true;
+            }
+            fail(value, "unable to connect");
+            return false;
+          }
+
+          value.sock =
+              std::make_shared<buffered_socket>(value.connecting, value.addr);
+
+          value.connecting = net::socket::INVALID;
+
+          value.sock->set_non_blocking(true);
+
+          value.state = operation::STATE_HANDSHAKING;
+
+#ifdef OPENSSL_FOUND
+          // the handshake goes on here, so it never holds up other requests
+          if (value.to.scheme == http::SECURE_PROTOCOL) {
+            try {
+              auto layer = std::make_shared<openssl_layer>();
+
+              layer->attach(value.sock->raw_socket(), value.to.host,
+                            value.to.port);
+
+              value.sock->set_secure(layer);
+            } catch (const socket_exception &e) {
+              fail(value, e.what());
+              return false;
+            }
+          }
+#endif
+
+          // the client speaks first
+          [[fallthrough]];
+        }
+        case operation::STATE_HANDSHAKING:
+          try {
+            if (!value.sock->handshake()) {
+              return true;
+            }
+          } catch (const socket_exception &e) {
+            fail(value, e.what());
+            return false;
+          }
+
+          value.sock->write(value.message);
+
+          value.state = operation::STATE_WRITING;
+
+          // connected sockets are usually writable straight away
+          [[fallthrough]];
+        case operation::STATE_WRITING:
+          if (!value.sock->write_from_buffer()) {
+            if (retry(id, value)) {
+              return true;
+            }
+            fail(value, "unable to write to socket");
+            return false;
+          }
+
+          if (value.sock->has_output()) {
+            return true;
+          }
+
+          value.state = operation::STATE_READING;
+          return true;
+        case operation::STATE_READING:
+          return on_readable(id, value);
+        default:
+          return true;
+        }
+      }
+
+      bool reactor::on_readable(uint64_t id, operation &value) {
+        for (;;) {
+          int status = value.sock->recv_into(value.input);
+
+          if (status < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+          }
+
+          if (status <= 0) {
+            if (status == 0 && value.parser.finish()) {
+              complete(value, false);
+              return false;
+            }
+
+            if (!value.received && retry(id, value)) {
+              return true;
+            }
+
+            fail(value, value.received ? "connection closed before the "
+                                         "response was complete"
+                                       : "unable to read from socket");
+            return false;
+          }
+
+          value.received = true;
+
+          auto data = value.input.readable();
+
+          auto pos = reinterpret_cast<const char *>(data.data());
+
+          size_t size = data.size();
+
+          size_t used = 0;
+
+          try {
+            used = value.parser.parse(pos, size);
+
+            // interim responses come before the one that answers
+            while (value.parser.is_complete() && value.parser.code() >= 100 &&
+                   value.parser.code() < 200 && value.parser.code() != 101) {
+              value.parser.reset(value.method);
+
+              pos += used;
+              size -= used;
+
+              used = value.parser.parse(pos, size);
+            }
+          } catch (const socket_exception &e) {
+            fail(value, e.what());
+            return false;
+          }
+
+          if (value.parser.is_complete()) {
+            // anything past the message answers no request of ours
+            complete(value, value.parser.is_persistent() && used == size);
+            return false;
+          }
+
+          value.input.clear();
+        }
+      }
+
+      bool reactor::retry(uint64_t id, operation &value) {
+        if (!value.reused || value.retried) {
+          return false;
+        }
+
+        value.retried = true;
+
+        value.reused = false;
+
+        value.sock.reset();
+
+        value.input.clear();
+
+        value.parser.reset(value.method);
+
+        value.state = operation::STATE_RESOLVING;
+
+        resolver::shared().resolve(
+            value.to.host,
+            [this, id](int error, const resolver::endpoints_type &endpoints) {
+              {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                resolved_.push_back({id, error, endpoints});
+              }
+
+              wakeup();
+            });
+
+        return true;
+      }
+
+      void reactor::complete(operation &value, bool reusable) {
+        if (value.keep_alive && reusable) {
+          // pooled connections are used blocking by the synchronous path
+          value.sock->set_non_blocking(false);
+
+          connection_pool::shared().release(value.to.scheme, value.to.host,
+                                            value.to.port, value.sock);
+        }
+
+        value.sock.reset();
+
+        pending_--;
+
+        if (!value.completion) {
+          return;
+        }
+
+        // a throwing completion must not take the thread down
+        try {
+          // a streamed body has already gone to the callback
+          value.completion(
+              http::response(value.parser.head() + value.parser.body()), NULL);
+        } catch (...) {
+        }
+      }
+
+      void reactor::fail(operation &value, const char *error) {
+        pending_--;
+
+        if (!value.completion) {
+          return;
+        }
+
+        try {
+          value.completion(http::response(), error);
+        } catch (...) {
+        }
+      }
 
       client::implementation client::impl_ = socket::request;
+
+      client::async_implementation client::async_impl_ = socket::request_async;
     } // namespace http
   }   // namespace net
 } // namespace coda
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "output_queue.h"
+#include <algorithm>
+
+namespace coda {
+  namespace net {
+    buffer::view output_queue::segment::readable() const noexcept {
+      if (owned) {
+        return owned->readable();
+      }
+      return buffer::view(data, size);
+    }
+
+    void output_queue::segment::consume(size_t value) noexcept {
+      if (owned) {
+        owned->consume(value);
+        return;
+      }
+      value = std::min(value, size);
+      data += value;
+      size -= value;
+    }
+
+    output_queue::output_queue() noexcept : size_(0), sealed_(false) {}
+
+    output_queue::output_queue(output_queue &&other) noexcept
+        : segments_(std::move(other.segments_)), size_(other.size_),
+          sealed_(other.sealed_) {
+      other.size_ = 0;
+      other.sealed_ = false;
+    }
+
+    output_queue &output_queue::operator=(output_queue &&other) noexcept {
+      segments_ = std::move(other.segments_);
+      size_ = other.size_;
+      sealed_ = other.sealed_;
+      other.size_ = 0;
+      other.sealed_ = false;
+      return *this;
+    }
+
+    output_queue &output_queue::append(const void *data, size_t size) {
+      if (data == nullptr || size == 0) {
+        return *this;
+      }
+
+      if (segments_.empty() || !segments_.back().owned || sealed_) {
+        segments_.push_back(
+            {std::make_shared<buffer>(), nullptr, nullptr, 0});
+        sealed_ = false;
+      }
+
+      segments_.back().owned->append(data, size);
+
+      size_ += size;
+
+      return *this;
+    }
+
+    output_queue &output_queue::append(std::string &&value) {
+      if (value.size() < COPY_THRESHOLD) {
+        return append(value.data(), value.size());
+      }
+
+      auto owner = std::make_shared<const std::string>(std::move(value));
+
+      push(owner, owner->data(), owner->size());
+
+      return *this;
+    }
+
+    output_queue &output_queue::append(blob_type &&value) {
+      if (value.size() < COPY_THRESHOLD) {
+        return append(value.data(), value.size());
+      }
+
+      auto owner = std::make_shared<const blob_type>(std::move(value));
+
+      push(owner, owner->data(), owner->size());
+
+      return *this;
+    }
+
+    output_queue &
+    output_queue::append(const std::shared_ptr<const std::string> &value) {
+      if (value) {
+        push(value, value->data(), value->size());
+      }
+      return *this;
+    }
+
+    output_queue &
+    output_queue::append(const std::shared_ptr<const blob_type> &value) {
+      if (value) {
+        push(value, value->data(), value->size());
+      }
+      return *this;
+    }
+
+    void output_queue::push(const std::shared_ptr<const void> &owner,
+                            const void *data, size_t size) {
+      if (size == 0) {
+        return;
+      }
+
+      segments_.push_back(
+          {nullptr, owner, static_cast<const data_type *>(data), size});
+
+      size_ += size;
+    }
+
+    int output_queue::gather(struct iovec *iov, int count) const noexcept {
+      int filled = 0;
+
+      for (auto it = segments_.begin();
+           it != segments_.end() && filled < count; ++it) {
+        auto view = it->readable();
+
+        if (view.empty()) {
+          continue;
+        }
+
+        iov[filled].iov_base = const_cast<data_type *>(view.data());
+        iov[filled].iov_len = view.size();
+        filled++;
+      }
+
+      return filled;
+    }
+
+    void output_queue::seal() noexcept { sealed_ = !segments_.empty(); }
+
+    void output_queue::consume(size_t size) noexcept {
+      size = std::min(size, size_);
+
+      size_ -= size;
+
+      while (size > 0 && !segments_.empty()) {
+        auto &front = segments_.front();
+
+        auto available = front.readable().size();
+
+        if (size < available) {
+          front.consume(size);
+          return;
+        }
+
+        size -= available;
+
+        segments_.pop_front();
+      }
+
+      // drop any drained segments
+      while (!segments_.empty() && segments_.front().readable().empty()) {
+        segments_.pop_front();
+      }
+    }
+
+    buffer::view output_queue::flatten() const {
+      if (segments_.empty()) {
+        return buffer::view();
+      }
+
+      if (segments_.size() > 1 || !segments_.front().owned) {
+        auto owned = std::make_shared<buffer>(size_);
+
+        for (const auto &s : segments_) {
+          auto view = s.readable();
+          owned->append(view.data(), view.size());
+        }
+
+        segments_.clear();
+        segments_.push_back({owned, nullptr, nullptr, 0});
+      }
+
+      return segments_.front().readable();
+    }
+
+    void output_queue::clear() noexcept {
+      segments_.clear();
+      size_ = 0;
+      sealed_ = false;
+    }
+
+    size_t output_queue::size() const noexcept { return size_; }
+
+    bool output_queue::empty() const noexcept { return size_ == 0; }
+  } // namespace net
+} // namespace coda
@@ -0,0 +1,118 @@
+#ifndef CODA_NET_OUTPUT_QUEUE_H
+#define CODA_NET_OUTPUT_QUEUE_H
+
+#include "buffer.h"
+#include <deque>
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    /*!
+     * A queue of output segments waiting to be sent. Small writes are copied
+     * into a shared tail buffer, while moved strings and shared blobs are
+     * queued by reference so large payloads are never copied.
+     */
+    class output_queue {
+      public:
+      typedef buffer::data_type data_type;
+      typedef std::vector<data_type> blob_type;
+
+      /*!
+       * moved payloads smaller than this are copied instead of queued
+       */
+      static constexpr size_t COPY_THRESHOLD = 512;
+
+      output_queue() noexcept;
+
+      output_queue(const output_queue &other) = delete;
+
+      output_queue(output_queue &&other) noexcept;
+
+      output_queue &operator=(const output_queue &other) = delete;
+
+      output_queue &operator=(output_queue &&other) noexcept;
+
+      /*!
+       * Copies bytes to the end of the queue
+       */
+      output_queue &append(const void *data, size_t size);
+
+      /*!
+       * Takes ownership of a string
+       */
+      output_queue &append(std::string &&value);
+
+      /*!
+       * Takes ownership of a block of bytes
+       */
+      output_queue &append(blob_type &&value);
+
+      /*!
+       * Queues a shared immutable string by reference
+       */
+      output_queue &append(const std::shared_ptr<const std::string> &value);
+
+      /*!
+       * Queues a shared immutable block of bytes by reference
+       */
+      output_queue &append(const std::shared_ptr<const blob_type> &value);
+
+      /*!
+       * Fills io vectors from the front of the queue
+       * @returns the number of vectors filled
+       */
+      int gather(struct iovec *iov, int count) const noexcept;
+
+      /*!
+       * Stops later copies from growing the queued segments, so the bytes
+       * already gathered stay put while an asynchronous send is in flight
+       */
+      void seal() noexcept;
+
+      /*!
+       * Discards size bytes from the front of the queue
+       */
+      void consume(size_t size) noexcept;
+
+      /*!
+       * Coalesces the queue into a single segment
+       * @returns a view of all the queued bytes
+       */
+      buffer::view flatten() const;
+
+      void clear() noexcept;
+
+      /*!
+       * @returns the total number of bytes queued
+       */
+      size_t size() const noexcept;
+
+      bool empty() const noexcept;
+
+      private:
+      struct segment {
+        // copied bytes, which may still grow while this is the last segment
+        std::shared_ptr<buffer> owned;
+        // keeps referenced bytes alive
+        std::shared_ptr<const void> shared;
+        const data_type *data;
+        size_t size;
+
+        buffer::view readable() const noexcept;
+        void consume(size_t size) noexcept;
+      };
+
+      void push(const std::shared_ptr<const void> &owner, const void *data,
+                size_t size);
+
+      mutable std::deque<segment> segments_;
+      size_t size_;
+      bool sealed_;
+    };
+  } // namespace net
+} // namespace coda
+
+#endif
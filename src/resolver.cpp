@@ -0,0 +1,346 @@
+#include "resolver.h"
+#include <cstring>
+
+namespace coda {
+  namespace net {
+    namespace detail {
+      /*!
+       * lets a blocking resolve wait on a query another caller started
+       */
+      struct resolve_waiter {
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool done = false;
+        int error = 0;
+        resolver::endpoints_type endpoints;
+      };
+    } // namespace detail
+
+    resolver::resolver(unsigned threads)
+        : lookup_(system_lookup), ttl_(DEFAULT_TTL),
+          negative_ttl_(DEFAULT_NEGATIVE_TTL), capacity_(DEFAULT_CAPACITY),
+          max_threads_(threads > 0 ? threads : 1), idle_(0), stopped_(false) {}
+
+    resolver::~resolver() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        stopped_ = true;
+      }
+
+      ready_.notify_all();
+
+      for (auto &thread : threads_) {
+        if (thread.joinable()) {
+          thread.join();
+        }
+      }
+    }
+
+    resolver &resolver::shared() {
+      static resolver instance;
+
+      return instance;
+    }
+
+    int resolver::resolve(const std::string &host, endpoints_type &endpoints) {
+      std::shared_ptr<detail::resolve_waiter> waiter;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto value = lookup_cache(host);
+
+        if (value != NULL) {
+          endpoints = value->endpoints;
+          return value->error;
+        }
+
+        auto it = pending_.find(host);
+
+        // nobody is asking yet, so query on this thread
+        if (it == pending_.end()) {
+          pending_[host];
+        } else {
+          waiter = std::make_shared<detail::resolve_waiter>();
+
+          it->second.push_back(
+              [waiter](int error, const endpoints_type &found) {
+                std::lock_guard<std::mutex> lock(waiter->mutex);
+                waiter->error = error;
+                waiter->endpoints = found;
+                waiter->done = true;
+                waiter->ready.notify_all();
+              });
+        }
+      }
+
+      if (!waiter) {
+        return query(host, endpoints);
+      }
+
+      std::unique_lock<std::mutex> lock(waiter->mutex);
+
+      waiter->ready.wait(lock, [&waiter]() { return waiter->done; });
+
+      endpoints = waiter->endpoints;
+
+      return waiter->error;
+    }
+
+    void resolver::resolve(const std::string &host,
+                           const callback_type &callback) {
+      if (!callback) {
+        return;
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        auto value = lookup_cache(host);
+
+        if (value != NULL) {
+          auto error = value->error;
+          auto endpoints = value->endpoints;
+
+          lock.unlock();
+
+          callback(error, endpoints);
+          return;
+        }
+
+        if (stopped_) {
+          lock.unlock();
+
+          callback(EAI_FAIL, nullptr);
+          return;
+        }
+
+        auto it = pending_.find(host);
+
+        // join the query already running
+        if (it != pending_.end()) {
+          it->second.push_back(callback);
+          return;
+        }
+
+        pending_[host].push_back(callback);
+
+        queue_.push_back(host);
+
+        // threads start as they are needed
+        if (threads_.size() < max_threads_ && queue_.size() > idle_) {
+          threads_.emplace_back(&resolver::work, this);
+        }
+      }
+
+      ready_.notify_one();
+    }
+
+    bool resolver::find(const std::string &host, int &error,
+                        endpoints_type &endpoints) {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      auto value = lookup_cache(host);
+
+      if (value == NULL) {
+        return false;
+      }
+
+      error = value->error;
+      endpoints = value->endpoints;
+
+      return true;
+    }
+
+    void resolver::set_ttl(duration value) {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      ttl_ = value;
+    }
+
+    void resolver::set_negative_ttl(duration value) {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      negative_ttl_ = value;
+    }
+
+    void resolver::set_capacity(size_t value) {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      capacity_ = value;
+
+      while (cache_.size() > capacity_) {
+        cache_.erase(recent_.back());
+        recent_.pop_back();
+      }
+    }
+
+    void resolver::set_lookup(const lookup_type &value) {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      lookup_ = value ? value : system_lookup;
+    }
+
+    void resolver::clear() {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      cache_.clear();
+      recent_.clear();
+    }
+
+    size_t resolver::size() const {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      return cache_.size();
+    }
+
+    int resolver::system_lookup(const std::string &host,
+                                std::vector<endpoint> &endpoints) {
+      struct addrinfo hints, *result;
+
+      memset(&hints, 0, sizeof hints);
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+
+      int error = getaddrinfo(host.c_str(), NULL, &hints, &result);
+
+      if (error != 0) {
+        return error;
+      }
+
+      for (auto p = result; p != NULL; p = p->ai_next) {
+        endpoint value;
+
+        memset(&value, 0, sizeof(value));
+
+        value.family = p->ai_family;
+        value.socktype = p->ai_socktype;
+        value.protocol = p->ai_protocol;
+        value.length = p->ai_addrlen;
+
+        memmove(&value.addr, p->ai_addr, p->ai_addrlen);
+
+        endpoints.push_back(value);
+      }
+
+      freeaddrinfo(result);
+
+      return 0;
+    }
+
+    resolver::entry *resolver::lookup_cache(const std::string &host) {
+      auto it = cache_.find(host);
+
+      if (it == cache_.end()) {
+        return NULL;
+      }
+
+      if (it->second.expires <= clock::now()) {
+        recent_.erase(it->second.position);
+        cache_.erase(it);
+        return NULL;
+      }
+
+      recent_.splice(recent_.begin(), recent_, it->second.position);
+
+      return &it->second;
+    }
+
+    int resolver::query(const std::string &host, endpoints_type &endpoints) {
+      lookup_type lookup;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        lookup = lookup_;
+      }
+
+      std::vector<endpoint> found;
+
+      int error = lookup(host, found);
+
+      if (error == 0 && found.empty()) {
+        error = EAI_NONAME;
+      }
+
+      endpoints = error == 0 ? std::make_shared<const std::vector<endpoint>>(
+                                   std::move(found))
+                             : nullptr;
+
+      std::vector<callback_type> waiting;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // a temporary failure is worth asking again straight away
+        auto ttl = error == 0 ? ttl_
+                              : error == EAI_AGAIN ? duration(0) : negative_ttl_;
+
+        if (ttl.count() > 0 && capacity_ > 0) {
+          auto it = cache_.find(host);
+
+          if (it == cache_.end()) {
+            recent_.push_front(host);
+
+            it = cache_.emplace(host, entry{}).first;
+
+            it->second.position = recent_.begin();
+          } else {
+            recent_.splice(recent_.begin(), recent_, it->second.position);
+          }
+
+          it->second.error = error;
+          it->second.endpoints = endpoints;
+          it->second.expires = clock::now() + ttl;
+
+          while (cache_.size() > capacity_) {
+            cache_.erase(recent_.back());
+            recent_.pop_back();
+          }
+        }
+
+        auto it = pending_.find(host);
+
+        if (it != pending_.end()) {
+          waiting = std::move(it->second);
+          pending_.erase(it);
+        }
+      }
+
+      for (const auto &callback : waiting) {
+        callback(error, endpoints);
+      }
+
+      return error;
+    }
+
+    void resolver::work() {
+      for (;;) {
+        std::string host;
+
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+
+          idle_++;
+
+          ready_.wait(lock, [this]() { return stopped_ || !queue_.empty(); });
+
+          idle_--;
+
+          if (queue_.empty()) {
+            return;
+          }
+
+          host = std::move(queue_.front());
+
+          queue_.pop_front();
+        }
+
+        endpoints_type endpoints;
+
+        query(host, endpoints);
+      }
+    }
+  } // namespace net
+} // namespace coda
@@ -0,0 +1,197 @@
+#ifndef CODA_NET_RESOLVER_H
+#define CODA_NET_RESOLVER_H
+
+#include "socket.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    /*!
+     * Resolves host names to addresses and caches the answers, failures
+     * included, for a while.  Concurrent lookups of the same host share one
+     * query.  Lookups can block the caller, or run on the resolver's own
+     * threads and call back when done so a reactor never waits on them.
+     *
+     * The system resolver does not report record TTLs, so entries live for
+     * a configured time instead.
+     */
+    class resolver {
+      public:
+      typedef std::chrono::steady_clock clock;
+      typedef std::chrono::milliseconds duration;
+
+      /*!
+       * an address to connect to, without a port
+       */
+      struct endpoint {
+        int family;
+        int socktype;
+        int protocol;
+        socklen_t length;
+        sockaddr_storage addr;
+      };
+
+      typedef std::shared_ptr<const std::vector<endpoint>> endpoints_type;
+
+      /*!
+       * called with zero and the addresses, or a getaddrinfo error code
+       */
+      typedef std::function<void(int error, const endpoints_type &endpoints)>
+          callback_type;
+
+      /*!
+       * does the actual query, returning zero or a getaddrinfo error code
+       */
+      typedef std::function<int(const std::string &host,
+                                std::vector<endpoint> &endpoints)>
+          lookup_type;
+
+      static const size_t DEFAULT_CAPACITY = 1024;
+      static const unsigned DEFAULT_THREADS = 2;
+      static constexpr duration DEFAULT_TTL = std::chrono::seconds(60);
+      static constexpr duration DEFAULT_NEGATIVE_TTL = std::chrono::seconds(5);
+
+      /*!
+       * @param threads the most background lookups run at once
+       */
+      resolver(unsigned threads = DEFAULT_THREADS);
+
+      resolver(const resolver &other) = delete;
+      resolver(resolver &&other) = delete;
+
+      /*!
+       * waits for background lookups to finish
+       */
+      virtual ~resolver();
+
+      resolver &operator=(const resolver &other) = delete;
+      resolver &operator=(resolver &&other) = delete;
+
+      /*!
+       * @returns the resolver used by sockets to connect
+       */
+      static resolver &shared();
+
+      /*!
+       * Resolves a host, waiting for the answer if it is not cached
+       * @returns zero or a getaddrinfo error code
+       */
+      int resolve(const std::string &host, endpoints_type &endpoints);
+
+      /*!
+       * Resolves a host without blocking.  A cached answer calls back
+       * straight away, otherwise the callback runs on a resolver thread.
+       */
+      void resolve(const std::string &host, const callback_type &callback);
+
+      /*!
+       * Looks in the cache only
+       * @returns true if the host has a fresh answer, which is put in error
+       * and endpoints
+       */
+      bool find(const std::string &host, int &error, endpoints_type &endpoints);
+
+      /*!
+       * sets how long found addresses are kept
+       */
+      void set_ttl(duration value);
+
+      /*!
+       * sets how long a failed lookup is remembered, zero to not remember
+       */
+      void set_negative_ttl(duration value);
+
+      /*!
+       * sets the most hosts cached, the least recently used go first
+       */
+      void set_capacity(size_t value);
+
+      /*!
+       * replaces the query, to use a stub in tests for example
+       */
+      void set_lookup(const lookup_type &value);
+
+      /*!
+       * forgets every cached answer
+       */
+      void clear();
+
+      /*!
+       * @returns the number of cached hosts
+       */
+      size_t size() const;
+
+      /*!
+       * queries the system resolver with getaddrinfo
+       */
+      static int system_lookup(const std::string &host,
+                               std::vector<endpoint> &endpoints);
+
+      private:
+      struct entry {
+        int error;
+        endpoints_type endpoints;
+        clock::time_point expires;
+        std::list<std::string>::iterator position;
+      };
+
+      /*!
+       * finds a fresh cache entry and marks it recently used, with the lock
+       * held
+       */
+      entry *lookup_cache(const std::string &host);
+
+      /*!
+       * runs a query, caches it and hands the answer to everyone waiting
+       * on it
+       * @returns zero or a getaddrinfo error code
+       */
+      int query(const std::string &host, endpoints_type &endpoints);
+
+      void work();
+
+      lookup_type lookup_;
+
+      duration ttl_;
+
+      duration negative_ttl_;
+
+      size_t capacity_;
+
+      unsigned max_threads_;
+
+      // threads waiting for a query
+      unsigned idle_;
+
+      std::unordered_map<std::string, entry> cache_;
+
+      // most recently used first
+      std::list<std::string> recent_;
+
+      // hosts being queried, and who is waiting on them
+      std::unordered_map<std::string, std::vector<callback_type>> pending_;
+
+      std::deque<std::string> queue_;
+
+      std::vector<std::thread> threads_;
+
+      mutable std::mutex mutex_;
+
+      std::condition_variable ready_;
+
+      bool stopped_;
+    };
+  } // namespace net
+} // namespace coda
+
+#endif
@@ -2,62 +2,111 @@
 #include "exception.h"
 
 #ifdef OPENSSL_FOUND
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <openssl/err.h>
-#include <openssl/rand.h>
+#include <poll.h>
+#include <vector>
 #endif
 
 namespace coda {
   namespace net {
 #ifdef OPENSSL_FOUND
-    openssl_layer::openssl_layer() : handle_(NULL), context_(NULL) { init(); }
+    namespace detail {
+      /*!
+       * waits for a socket that is not ready for the handshake
+       */
+      void wait_for(SOCKET sock, bool writable) {
+        struct pollfd fds;
+
+        fds.fd = sock;
+        fds.events = writable ? POLLOUT : POLLIN;
+        fds.revents = 0;
+
+        while (::poll(&fds, 1, -1) < 0 && errno == EINTR) {
+        }
+      }
+
+      /*!
+       * tests if a handshake on the socket is left to the caller
+       */
+      bool is_non_blocking(SOCKET sock) {
+        int flags = fcntl(sock, F_GETFL);
+
+        return flags >= 0 && (flags & O_NONBLOCK);
+      }
+    } // namespace detail
+
+    openssl_layer::openssl_layer()
+        : handle_(NULL), handshake_done_(false), read_wants_(WANTS_NOTHING),
+          send_wants_(WANTS_NOTHING), kernel_send_(false),
+          kernel_recv_(false) {
+      init();
+    }
+    openssl_layer::openssl_layer(const std::shared_ptr<tls_context> &context)
+        : handle_(NULL), context_(context), handshake_done_(false),
+          read_wants_(WANTS_NOTHING), send_wants_(WANTS_NOTHING),
+          kernel_send_(false), kernel_recv_(false) {
+      init();
+    }
     openssl_layer::openssl_layer(const openssl_layer &other)
-        : handle_(other.handle_), context_(other.context_) {}
+        : handle_(other.handle_), context_(other.context_),
+          handshake_done_(other.handshake_done_),
+          read_wants_(other.read_wants_), send_wants_(other.send_wants_),
+          kernel_send_(other.kernel_send_), kernel_recv_(other.kernel_recv_) {}
     openssl_layer::openssl_layer(openssl_layer &&other)
-        : handle_(other.handle_), context_(other.context_) {
+        : handle_(other.handle_), context_(std::move(other.context_)),
+          handshake_done_(other.handshake_done_),
+          read_wants_(other.read_wants_), send_wants_(other.send_wants_),
+          kernel_send_(other.kernel_send_), kernel_recv_(other.kernel_recv_) {
       other.handle_ = NULL;
-      other.context_ = NULL;
     }
     openssl_layer::~openssl_layer() { shutdown(); }
     openssl_layer &openssl_layer::operator=(const openssl_layer &other) {
       handle_ = other.handle_;
       context_ = other.context_;
+      handshake_done_ = other.handshake_done_;
+      read_wants_ = other.read_wants_;
+      send_wants_ = other.send_wants_;
+      kernel_send_ = other.kernel_send_;
+      kernel_recv_ = other.kernel_recv_;
       return *this;
     }
     openssl_layer &openssl_layer::operator=(openssl_layer &&other) {
       handle_ = other.handle_;
-      context_ = other.context_;
+      context_ = std::move(other.context_);
+      handshake_done_ = other.handshake_done_;
+      read_wants_ = other.read_wants_;
+      send_wants_ = other.send_wants_;
+      kernel_send_ = other.kernel_send_;
+      kernel_recv_ = other.kernel_recv_;
       other.handle_ = NULL;
-      other.context_ = NULL;
       return *this;
     }
 
     void openssl_layer::init() {
-      static bool initialized = false;
-
-      if (!initialized) {
-        // Register the available ciphers and digests
-        SSL_library_init();
-        // Register the error strings for libcrypto & libssl
-        SSL_load_error_strings();
-
-        initialized = true;
-      }
+      if (!context_) {
+        // every socket without a context of its own shares this one, so it
+        // and its sessions are kept for the life of the process
+        static const auto defaults = tls_context::get(tls_context::options());
 
-      if (context_ == NULL) {
-        // New context saying we are a client, and using SSL 2 or 3
-        context_ = SSL_CTX_new(SSLv23_client_method());
-        if (context_ == NULL) {
-          throw socket_exception(ERR_error_string(ERR_get_error(), NULL));
-        }
+        context_ = defaults;
       }
 
       if (handle_ == NULL) {
         // Create an SSL struct for the connection
-        handle_ = SSL_new(context_);
+        handle_ = SSL_new(context_->handle());
 
         if (handle_ == NULL) {
           throw socket_exception(ERR_error_string(ERR_get_error(), NULL));
         }
+
+        // a send that would block is retried from an output queue that may
+        // have moved, and whatever was sent is worth reporting
+        SSL_set_mode(handle_, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                                  SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
       }
     }
 
@@ -67,13 +116,11 @@ namespace coda {
         SSL_free(handle_);
         handle_ = NULL;
       }
-      if (context_ != NULL) {
-        SSL_CTX_free(context_);
-        context_ = NULL;
-      }
+      // the context stays, as a listener accepts with it again on restart
     }
 
-    void openssl_layer::attach(SOCKET sock) {
+    void openssl_layer::attach(SOCKET sock, const std::string &host,
+                               int port) {
       if (sock == socket::INVALID || handle_ == NULL) {
         return;
       }
@@ -83,25 +130,566 @@ namespace coda {
         throw socket_exception(ERR_error_string(ERR_get_error(), NULL));
       }
 
+      context_->prepare(handle_, host,
+                        host.empty() ? std::string()
+                                     : host + ':' + std::to_string(port));
+
+      // a reactor moves the handshake along as the socket is ready
+      if (detail::is_non_blocking(sock)) {
+        SSL_set_connect_state(handle_);
+
+        // the client speaks first
+        read_wants_ = send_wants_ = WANTS_WRITE;
+        return;
+      }
+
       // Initiate SSL handshake
       if (SSL_connect(handle_) != 1) {
         throw socket_exception(ERR_error_string(ERR_get_error(), NULL));
       }
+
+      on_handshake();
+    }
+
+    std::shared_ptr<secure_layer> openssl_layer::accept(SOCKET sock) {
+      if (!context_ || !context_->is_server()) {
+        throw socket_exception("no server certificate to accept with");
+      }
+
+      auto layer = std::make_shared<openssl_layer>(context_);
+
+      if (!SSL_set_fd(layer->handle_, sock)) {
+        throw socket_exception(ERR_error_string(ERR_get_error(), NULL));
+      }
+
+      SSL_set_accept_state(layer->handle_);
+
+      // the client speaks first
+      layer->read_wants_ = layer->send_wants_ = WANTS_READ;
+
+      return layer;
+    }
+
+    bool openssl_layer::handshake() {
+      if (handle_ == NULL || handshake_done_) {
+        return handshake_done_;
+      }
+
+      // errors left by another connection on this thread would be blamed
+      // on this one
+      ERR_clear_error();
+
+      int status = SSL_do_handshake(handle_);
+
+      if (status == 1) {
+        read_wants_ = send_wants_ = WANTS_NOTHING;
+
+        on_handshake();
+
+        return true;
+      }
+
+      want_type wants = WANTS_NOTHING;
+
+      if (on_error(status, wants) == 0 || errno != EAGAIN) {
+        auto error = ERR_get_error();
+
+        throw socket_exception(error != 0
+                                   ? ERR_error_string(error, NULL)
+                                   : "connection closed during handshake");
+      }
+
+      // neither can go on until the handshake does
+      read_wants_ = send_wants_ = wants;
+
+      return false;
+    }
+
+    bool openssl_layer::is_handshake_done() const { return handshake_done_; }
+
+    void openssl_layer::on_handshake() {
+      handshake_done_ = true;
+
+      // the keys went to the kernel with the handshake, or never will
+      kernel_send_ = BIO_get_ktls_send(SSL_get_wbio(handle_));
+
+      kernel_recv_ = BIO_get_ktls_recv(SSL_get_rbio(handle_));
+
+      context_->on_handshake(handle_);
     }
 
     int openssl_layer::send(const void *data, size_t size) {
       if (handle_ == NULL) {
         return 0;
       }
-      return SSL_write(handle_, data, size);
+
+      ERR_clear_error();
+
+      int status = SSL_write(handle_, data, size);
+
+      if (status > 0) {
+        send_wants_ = WANTS_NOTHING;
+        return status;
+      }
+
+      return on_error(status, send_wants_);
+    }
+
+    int openssl_layer::sendv(const struct iovec *iov, int count) {
+      // records are written one block at a time, and a send may stop after
+      // each record, so a short count only means the socket is full once
+      // it would block
+      int total = 0;
+
+      for (int i = 0; i < count; i++) {
+        auto data = static_cast<const char *>(iov[i].iov_base);
+
+        for (size_t sent = 0; sent < iov[i].iov_len;) {
+          int status = send(data + sent, iov[i].iov_len - sent);
+
+          if (status <= 0) {
+            return total > 0 ? total : status;
+          }
+
+          sent += status;
+
+          total += status;
+        }
+      }
+      return total;
     }
 
     int openssl_layer::read(void *buf, size_t size) {
       if (handle_ == NULL) {
         return 0;
       }
-      return SSL_read(handle_, buf, size);
+
+      ERR_clear_error();
+
+      int status = SSL_read(handle_, buf, size);
+
+      if (status > 0) {
+        read_wants_ = WANTS_NOTHING;
+        return status;
+      }
+
+      return on_error(status, read_wants_);
+    }
+
+    int openssl_layer::on_error(int status, want_type &wants) {
+      // read before anything else can touch errno
+      int error = errno;
+
+      wants = WANTS_NOTHING;
+
+      switch (SSL_get_error(handle_, status)) {
+      case SSL_ERROR_WANT_READ:
+        wants = WANTS_READ;
+        errno = EAGAIN;
+        return -1;
+      case SSL_ERROR_WANT_WRITE:
+        wants = WANTS_WRITE;
+        errno = EAGAIN;
+        return -1;
+      case SSL_ERROR_ZERO_RETURN:
+        // the peer closed the session cleanly
+        return 0;
+      case SSL_ERROR_SYSCALL:
+        errno = error != 0 ? error : ECONNRESET;
+        break;
+      default:
+        errno = EPROTO;
+        break;
+      }
+
+      // the session is broken, so don't try to close it politely
+      SSL_set_quiet_shutdown(handle_, 1);
+
+      return -1;
+    }
+
+    bool openssl_layer::feed(const void *, size_t) { return false; }
+
+    openssl_layer::want_type openssl_layer::read_wants() const {
+      return read_wants_;
+    }
+
+    openssl_layer::want_type openssl_layer::send_wants() const {
+      return send_wants_;
+    }
+
+    size_t openssl_layer::pending() const {
+      return handle_ == NULL ? 0 : SSL_pending(handle_);
+    }
+
+    size_t openssl_layer::pending_output() const { return 0; }
+
+    int openssl_layer::send_pending() { return 0; }
+
+    bool openssl_layer::is_kernel_send() const { return kernel_send_; }
+
+    bool openssl_layer::is_kernel_recv() const { return kernel_recv_; }
+
+    openssl_memory_layer::openssl_memory_layer()
+        : sock_(socket::INVALID), in_(NULL), out_(NULL), fed_(false) {}
+
+    openssl_memory_layer::openssl_memory_layer(
+        const std::shared_ptr<tls_context> &context)
+        : openssl_layer(context), sock_(socket::INVALID), in_(NULL),
+          out_(NULL), fed_(false) {}
+
+    openssl_memory_layer::~openssl_memory_layer() { shutdown(); }
+
+    void openssl_memory_layer::bind(SOCKET sock) {
+      in_ = BIO_new(BIO_s_mem());
+      out_ = BIO_new(BIO_s_mem());
+
+      if (in_ == NULL || out_ == NULL) {
+        BIO_free(in_);
+        BIO_free(out_);
+        in_ = out_ = NULL;
+        throw socket_exception(ERR_error_string(ERR_get_error(), NULL));
+      }
+
+      // an empty buffer means more is coming, not the end
+      BIO_set_mem_eof_return(in_, -1);
+
+      // the session owns them from here
+      SSL_set_bio(handle_, in_, out_);
+
+      // writing to memory never blocks, so a send encrypts all it is given
+      SSL_clear_mode(handle_, SSL_MODE_ENABLE_PARTIAL_WRITE);
+
+      sock_ = sock;
+    }
+
+    void openssl_memory_layer::shutdown() {
+      if (handle_ != NULL && handshake_done_ && sock_ != socket::INVALID) {
+        SSL_shutdown(handle_);
+
+        // the close_notify goes out only if there is room for it
+        flush(MSG_DONTWAIT);
+      }
+
+      openssl_layer::shutdown();
+
+      in_ = out_ = NULL;
+      sock_ = socket::INVALID;
     }
+
+    int openssl_memory_layer::flush(int flags) {
+      if (out_ == NULL) {
+        return 0;
+      }
+
+      for (size_t size = BIO_ctrl_pending(out_); size > 0;
+           size = BIO_ctrl_pending(out_)) {
+        auto space = records_.prepare(size);
+
+        int status = BIO_read(out_, space.data(), size);
+
+        if (status <= 0) {
+          break;
+        }
+
+        records_.commit(status);
+      }
+
+#ifdef MSG_NOSIGNAL
+      flags |= MSG_NOSIGNAL;
+#endif
+
+      while (!records_.empty()) {
+        auto data = records_.readable();
+
+        int status = ::send(sock_, data.data(), data.size(), flags);
+
+        if (status < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          return -1;
+        }
+
+        records_.consume(status);
+      }
+
+      return 0;
+    }
+
+    int openssl_memory_layer::receive() {
+      if (fed_ || in_ == NULL) {
+        errno = EAGAIN;
+        return -1;
+      }
+
+      // shared by the connections on a thread, as it is emptied every time
+      static thread_local std::vector<unsigned char> data(RECV_SIZE);
+
+      int status;
+
+      do {
+        status = ::recv(sock_, data.data(), data.size(), 0);
+      } while (status < 0 && errno == EINTR);
+
+      if (status > 0) {
+        BIO_write(in_, data.data(), status);
+      }
+
+      return status;
+    }
+
+    void openssl_memory_layer::attach(SOCKET sock, const std::string &host,
+                                      int port) {
+      if (sock == socket::INVALID || handle_ == NULL) {
+        return;
+      }
+
+      bind(sock);
+
+      context_->prepare(handle_, host,
+                        host.empty() ? std::string()
+                                     : host + ':' + std::to_string(port));
+
+      SSL_set_connect_state(handle_);
+
+      // a reactor moves the handshake along as the socket is ready
+      if (detail::is_non_blocking(sock)) {
+        // the client speaks first
+        read_wants_ = send_wants_ = WANTS_WRITE;
+        return;
+      }
+
+      // a blocking socket is done in one go
+      while (!handshake()) {
+        detail::wait_for(sock_, send_wants() == WANTS_WRITE);
+      }
+    }
+
+    std::shared_ptr<secure_layer> openssl_memory_layer::accept(SOCKET sock) {
+      if (!context_ || !context_->is_server()) {
+        throw socket_exception("no server certificate to accept with");
+      }
+
+      auto layer = std::make_shared<openssl_memory_layer>(context_);
+
+      layer->bind(sock);
+
+      SSL_set_accept_state(layer->handle_);
+
+      // the client speaks first
+      layer->read_wants_ = layer->send_wants_ = WANTS_READ;
+
+      return layer;
+    }
+
+    bool openssl_memory_layer::handshake() {
+      if (handle_ == NULL || handshake_done_) {
+        return handshake_done_;
+      }
+
+      for (;;) {
+        // errors left by another connection on this thread would be blamed
+        // on this one
+        ERR_clear_error();
+
+        int status = SSL_do_handshake(handle_);
+
+        int error = status == 1 ? SSL_ERROR_NONE : SSL_get_error(handle_, status);
+
+        // whatever the session has to say goes first
+        if (flush() < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+          throw socket_exception(strerror(errno));
+        }
+
+        if (error == SSL_ERROR_NONE) {
+          read_wants_ = send_wants_ = WANTS_NOTHING;
+
+          on_handshake();
+
+          return true;
+        }
+
+        if (error != SSL_ERROR_WANT_READ) {
+          auto reason = ERR_get_error();
+
+          throw socket_exception(reason != 0 ? ERR_error_string(reason, NULL)
+                                             : "handshake failed");
+        }
+
+        // the peer answers records it hasn't been sent yet
+        if (!records_.empty()) {
+          read_wants_ = send_wants_ = WANTS_WRITE;
+          return false;
+        }
+
+        int recieved = receive();
+
+        if (recieved > 0) {
+          continue;
+        }
+
+        if (recieved == 0) {
+          throw socket_exception("connection closed during handshake");
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          throw socket_exception(strerror(errno));
+        }
+
+        read_wants_ = send_wants_ = WANTS_READ;
+
+        return false;
+      }
+    }
+
+    int openssl_memory_layer::send(const void *data, size_t size) {
+      struct iovec iov;
+
+      iov.iov_base = const_cast<void *>(data);
+      iov.iov_len = size;
+
+      return sendv(&iov, 1);
+    }
+
+    int openssl_memory_layer::sendv(const struct iovec *iov, int count) {
+      if (handle_ == NULL) {
+        return 0;
+      }
+
+      // records still waiting hold back new ones, so output queues up in the
+      // socket's buffer rather than here
+      if (flush() < 0) {
+        send_wants_ =
+            errno == EAGAIN || errno == EWOULDBLOCK ? WANTS_WRITE : WANTS_NOTHING;
+        return -1;
+      }
+
+      int total = 0;
+
+      // records are only made as far ahead of the socket as SEND_SIZE, the
+      // rest of the output stays queued by the caller
+      for (int i = 0; i < count && static_cast<size_t>(total) < SEND_SIZE;
+           i++) {
+        size_t size = std::min(iov[i].iov_len, SEND_SIZE - total);
+
+        if (size == 0) {
+          continue;
+        }
+
+        ERR_clear_error();
+
+        int status = SSL_write(handle_, iov[i].iov_base, size);
+
+        if (status <= 0) {
+          if (total > 0) {
+            break;
+          }
+          return on_error(status, send_wants_);
+        }
+
+        total += status;
+      }
+
+      send_wants_ = WANTS_NOTHING;
+
+      // every record made above, in as few sends as the socket allows, and
+      // what it won't take yet waits for the next send or read
+      if (flush() < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        return -1;
+      }
+
+      return total;
+    }
+
+    int openssl_memory_layer::read(void *buf, size_t size) {
+      if (handle_ == NULL) {
+        return 0;
+      }
+
+      for (;;) {
+        ERR_clear_error();
+
+        int status = SSL_read(handle_, buf, size);
+
+        int error = status > 0 ? SSL_ERROR_NONE : SSL_get_error(handle_, status);
+
+        // tickets, key updates and alerts the read had to answer
+        if (flush() < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+          read_wants_ = WANTS_NOTHING;
+          return -1;
+        }
+
+        if (error == SSL_ERROR_NONE) {
+          read_wants_ = WANTS_NOTHING;
+          return status;
+        }
+
+        if (error != SSL_ERROR_WANT_READ) {
+          return on_error(status, read_wants_);
+        }
+
+        // every record recieved is decrypted, so bring in the next lot
+        int recieved = receive();
+
+        if (recieved > 0) {
+          continue;
+        }
+
+        if (recieved == 0) {
+          read_wants_ = WANTS_NOTHING;
+          return 0;
+        }
+
+        read_wants_ = errno == EAGAIN || errno == EWOULDBLOCK ? WANTS_READ
+                                                              : WANTS_NOTHING;
+        return -1;
+      }
+    }
+
+    bool openssl_memory_layer::feed(const void *data, size_t size) {
+      if (in_ == NULL) {
+        return false;
+      }
+
+      fed_ = true;
+
+      if (size > 0 && BIO_write(in_, data, size) != static_cast<int>(size)) {
+        return false;
+      }
+
+      return true;
+    }
+
+    openssl_memory_layer::want_type openssl_memory_layer::send_wants() const {
+      // records the socket hasn't taken yet hold up every send
+      return records_.empty() ? send_wants_ : WANTS_WRITE;
+    }
+
+    size_t openssl_memory_layer::pending() const {
+      if (handle_ == NULL) {
+        return 0;
+      }
+
+      return SSL_pending(handle_) + (in_ == NULL ? 0 : BIO_ctrl_pending(in_));
+    }
+
+    size_t openssl_memory_layer::pending_output() const {
+      return records_.size() + (out_ == NULL ? 0 : BIO_ctrl_pending(out_));
+    }
+
+    int openssl_memory_layer::send_pending() {
+      if (flush() < 0) {
+        send_wants_ =
+            errno == EAGAIN || errno == EWOULDBLOCK ? WANTS_WRITE : WANTS_NOTHING;
+        return -1;
+      }
+
+      send_wants_ = WANTS_NOTHING;
+
+      return 0;
+    }
+
 #endif
   } // namespace net
 } // namespace coda
@@ -3,29 +3,136 @@
 #define CODA_NET_SECURE_LAYER_H
 
 #ifdef OPENSSL_FOUND
+#include "tls_context.h"
 #include <openssl/ssl.h>
 #endif
 #include "socket.h"
+#include <memory>
+#include <string>
 
 namespace coda {
   namespace net {
+    /*!
+     * Encrypts a connection.  Reads and sends behave like recv(2) and
+     * send(2) on a non-blocking socket: a count of bytes, 0 once the peer
+     * has closed the session, or -1 with errno set.  EAGAIN means the
+     * operation can go on once the socket is ready, and wants() says for
+     * what, which need not be the way the data is going: a read may have
+     * to send handshake records, and a send may have to read them.
+     */
     class secure_layer {
       public:
+      typedef enum {
+        /* not waiting on the socket */
+        WANTS_NOTHING,
+        /* can go on once the socket is readable */
+        WANTS_READ,
+        /* can go on once the socket is writable */
+        WANTS_WRITE
+      } want_type;
+
       virtual void init() = 0;
       virtual void shutdown() = 0;
-      virtual void attach(SOCKET sock) = 0;
+      /*!
+       * Starts a session over a connected socket.  On a blocking socket the
+       * handshake is done before it returns, otherwise it is left to
+       * handshake().
+       * @param host the name connected to, for SNI and session resumption
+       */
+      virtual void attach(SOCKET sock, const std::string &host, int port) = 0;
+      /*!
+       * Starts a session over a socket accepted by a listener using this
+       * layer.  The handshake is left to handshake(), or to the first read
+       * or write on a blocking socket.
+       * @returns the accepted socket's layer
+       */
+      virtual std::shared_ptr<secure_layer> accept(SOCKET sock) = 0;
+      /*!
+       * Moves the handshake along as far as it will go without blocking
+       * @returns true once the session is ready for data
+       * @throws socket_exception if the handshake failed
+       */
+      virtual bool handshake() = 0;
+      virtual bool is_handshake_done() const = 0;
       virtual int send(const void *data, size_t size) = 0;
+      /*!
+       * sends blocks in order, stopping at the first that would block
+       * @returns the bytes sent, or like send() if none were
+       */
+      virtual int sendv(const struct iovec *iov, int count) = 0;
       virtual int read(void *buf, size_t size) = 0;
+      /*!
+       * Hands over records recieved elsewhere, such as by a completion
+       * based reactor.  Once fed, a layer never reads the socket itself.
+       * @returns false if the layer only reads the socket itself
+       */
+      virtual bool feed(const void *data, size_t size) = 0;
+      /*!
+       * @returns what the last read, or the handshake, is waiting for
+       */
+      virtual want_type read_wants() const = 0;
+      /*!
+       * @returns what the last send, or the handshake, is waiting for
+       */
+      virtual want_type send_wants() const = 0;
+      /*!
+       * @returns bytes already decrypted, readable without the socket
+       */
+      virtual size_t pending() const = 0;
+      /*!
+       * @returns bytes a send has already encrypted, waiting for room in
+       * the socket
+       */
+      virtual size_t pending_output() const = 0;
+      /*!
+       * Sends what is already encrypted, as far as the socket will take it
+       * @returns 0 once nothing is left, or -1 with errno set
+       */
+      virtual int send_pending() = 0;
+      /*!
+       * @returns true if the kernel encrypts sends, so plain bytes written
+       * to the socket go out as records
+       */
+      virtual bool is_kernel_send() const = 0;
+      /*!
+       * @returns true if the kernel decrypts records before they are read
+       */
+      virtual bool is_kernel_recv() const = 0;
     };
 
 #ifdef OPENSSL_FOUND
     class openssl_layer : public secure_layer {
-      private:
+      protected:
       SSL *handle_;
-      SSL_CTX *context_;
+      std::shared_ptr<tls_context> context_;
+      bool handshake_done_;
+      want_type read_wants_;
+      want_type send_wants_;
+      bool kernel_send_;
+      bool kernel_recv_;
+
+      /*!
+       * counts the finished handshake and notes what the kernel took over
+       */
+      void on_handshake();
+
+      /*!
+       * translates an SSL call that failed into the contract
+       * @returns -1 or 0, with errno set
+       */
+      int on_error(int status, want_type &wants);
 
       public:
+      /*!
+       * uses the shared context with the default options
+       */
       openssl_layer();
+
+      /*!
+       * uses a context of its own choosing
+       */
+      explicit openssl_layer(const std::shared_ptr<tls_context> &context);
+
       openssl_layer(const openssl_layer &);
       openssl_layer(openssl_layer &&other);
       virtual ~openssl_layer();
@@ -34,9 +141,95 @@ namespace coda {
 
       void init();
       void shutdown();
-      void attach(SOCKET sock);
+      void attach(SOCKET sock, const std::string &host, int port);
+      std::shared_ptr<secure_layer> accept(SOCKET sock);
+      bool handshake();
+      bool is_handshake_done() const;
+      int send(const void *data, size_t size);
+      int sendv(const struct iovec *iov, int count);
+      int read(void *buf, size_t size);
+      bool feed(const void *data, size_t size);
+      want_type read_wants() const;
+      want_type send_wants() const;
+      size_t pending() const;
+      size_t pending_output() const;
+      int send_pending();
+      bool is_kernel_send() const;
+      bool is_kernel_recv() const;
+    };
+
+    /*!
+     * An OpenSSL session over memory BIOs instead of the socket, so records
+     * pass through buffers of its own: every record a sendv makes goes out
+     * in one send, and a read decrypts as many records as one large recv
+     * brought in.  A completion based reactor can recieve the records and
+     * feed them in instead.
+     */
+    class openssl_memory_layer : public openssl_layer {
+      private:
+      SOCKET sock_;
+      // records from the peer, waiting to be decrypted
+      BIO *in_;
+      // records for the peer, as the session makes them
+      BIO *out_;
+      // records waiting for room in the socket
+      buffer records_;
+      // records come from feed(), never from the socket
+      bool fed_;
+
+      /*!
+       * puts the session on memory BIOs for a socket
+       */
+      void bind(SOCKET sock);
+
+      /*!
+       * sends the records the session has made, as far as the socket will
+       * take them
+       * @returns 0 once all are sent, or -1 with errno set
+       */
+      int flush(int flags = 0);
+
+      /*!
+       * recieves whatever records the socket has into the session
+       * @returns like recv(2)
+       */
+      int receive();
+
+      public:
+      // the most recieved at once
+      static constexpr size_t RECV_SIZE = 256 * 1024;
+
+      // the most encrypted ahead of the socket
+      static constexpr size_t SEND_SIZE = 256 * 1024;
+
+      /*!
+       * uses the shared context with the default options
+       */
+      openssl_memory_layer();
+
+      /*!
+       * uses a context of its own choosing
+       */
+      explicit openssl_memory_layer(const std::shared_ptr<tls_context> &context);
+
+      openssl_memory_layer(const openssl_memory_layer &) = delete;
+      openssl_memory_layer(openssl_memory_layer &&other) = delete;
+      virtual ~openssl_memory_layer();
+      openssl_memory_layer &operator=(const openssl_memory_layer &) = delete;
+      openssl_memory_layer &operator=(openssl_memory_layer &&) = delete;
+
+      void shutdown();
+      void attach(SOCKET sock, const std::string &host, int port);
+      std::shared_ptr<secure_layer> accept(SOCKET sock);
+      bool handshake();
       int send(const void *data, size_t size);
+      int sendv(const struct iovec *iov, int count);
       int read(void *buf, size_t size);
+      bool feed(const void *data, size_t size);
+      want_type send_wants() const;
+      size_t pending() const;
+      size_t pending_output() const;
+      int send_pending();
     };
 #endif
   } // namespace net
@@ -1,12 +1,15 @@
 
 #include "socket.h"
 #include "exception.h"
+#include "resolver.h"
 #include "secure_layer.h"
 #include <cerrno>
 #include <cstring>
 #include <fstream>
+#include <vector>
 #ifndef _WIN32
 #include <fcntl.h>
+#include <poll.h>
 #endif
 
 using namespace std;
@@ -18,22 +21,28 @@ namespace coda {
 #endif
 
     socket::socket() noexcept
-        : sock_(INVALID), non_blocking_(false), ssl_(nullptr) {
+        : sock_(INVALID), non_blocking_(false), read_size_(DEFAULT_READ_SIZE),
+          connect_timeout_(DEFAULT_CONNECT_TIMEOUT), ssl_(nullptr) {
       memset(&addr_, 0, sizeof(addr_));
     }
 
     socket::socket(SOCKET sock, const sockaddr_storage &addr) noexcept
-        : sock_(sock), addr_(addr), non_blocking_(false), ssl_(nullptr) {}
+        : sock_(sock), addr_(addr), non_blocking_(false),
+          read_size_(DEFAULT_READ_SIZE),
+          connect_timeout_(DEFAULT_CONNECT_TIMEOUT), ssl_(nullptr) {}
 
     socket::socket(socket &&other) noexcept
         : sock_(other.sock_), addr_(std::move(other.addr_)),
-          non_blocking_(other.non_blocking_), ssl_(std::move(other.ssl_)) {
+          non_blocking_(other.non_blocking_), read_size_(other.read_size_),
+          connect_timeout_(other.connect_timeout_),
+          ssl_(std::move(other.ssl_)) {
       other.sock_ = INVALID;
       other.ssl_ = nullptr;
     }
 
     socket::socket(const std::string &host, const int port, bool secure)
-        : sock_(INVALID), non_blocking_(false), ssl_(nullptr) {
+        : sock_(INVALID), non_blocking_(false), read_size_(DEFAULT_READ_SIZE),
+          connect_timeout_(DEFAULT_CONNECT_TIMEOUT), ssl_(nullptr) {
       memset(&addr_, 0, sizeof(addr_));
 
       set_secure(secure);
@@ -45,6 +54,8 @@ namespace coda {
       sock_ = other.sock_;
       addr_ = std::move(other.addr_);
       non_blocking_ = other.non_blocking_;
+      read_size_ = other.read_size_;
+      connect_timeout_ = other.connect_timeout_;
       ssl_ = other.ssl_;
       other.sock_ = INVALID;
       other.ssl_ = nullptr;
@@ -84,13 +95,42 @@ namespace coda {
         return 0;
       }
 
-      if (ssl_) {
+      if (ssl_ && !ssl_->is_kernel_send()) {
         return ssl_->send(s, len);
       }
 
       return ::send(sock_, s, len, flags);
     }
 
+    int socket::sendv(const struct iovec *iov, int count, int flags) {
+      if (!is_valid()) {
+        return INVALID;
+      }
+
+      if (iov == NULL || count <= 0) {
+        return 0;
+      }
+
+      // the kernel makes records of whatever is written to the socket
+      if (ssl_ && !ssl_->is_kernel_send()) {
+        return ssl_->sendv(iov, count);
+      }
+
+      struct msghdr msg;
+
+      memset(&msg, 0, sizeof(msg));
+
+      msg.msg_iov = const_cast<struct iovec *>(iov);
+      msg.msg_iovlen = count;
+
+#ifdef MSG_NOSIGNAL
+      // a peer that reset fails the write, it doesn't kill the process
+      flags |= MSG_NOSIGNAL;
+#endif
+
+      return ::sendmsg(sock_, &msg, flags);
+    }
+
     bool socket::is_valid() const noexcept { return sock_ != INVALID; }
 
     SOCKET socket::raw_socket() const noexcept { return sock_; }
@@ -137,29 +177,64 @@ namespace coda {
         return INVALID;
       }
 
-      unsigned char buf[MAXRECV + 1] = {0};
+      // kept by the thread, so a short reply doesn't clear a whole read
+      static thread_local data_buffer scratch;
 
-      s.clear();
+      if (scratch.size() < read_size_) {
+        scratch.resize(read_size_);
+      }
 
-      int status;
+      int status = recv_into(buffer::span(scratch.data(), read_size_), flags);
 
-      if (ssl_) {
-        status = ssl_->read(buf, MAXRECV);
+      if (status > 0) {
+        s.assign(scratch.begin(), scratch.begin() + status);
+
+        on_recv(s);
       } else {
-        status = ::recv(sock_, buf, MAXRECV, flags);
+        s.clear();
       }
 
-      if (status > 0) {
-        s.insert(s.end(), &buf[0], &buf[status]);
+      return status;
+    }
 
-        on_recv(s);
+    int socket::recv_into(buffer::span dest, int flags) {
+      if (!is_valid()) {
+        return INVALID;
+      }
+
+      if (dest.empty()) {
+        return 0;
+      }
+
+      if (ssl_) {
+        return ssl_->read(dest.data(), dest.size());
+      }
+
+      return ::recv(sock_, dest.data(), dest.size(), flags);
+    }
+
+    int socket::recv_into(buffer &dest, int flags) {
+      auto space = dest.prepare(read_size_);
+
+      int status = recv_into(buffer::span(space.data(), read_size_), flags);
+
+      if (status > 0) {
+        dest.commit(on_recv(space.data(), status));
       }
 
       return status;
     }
 
+    size_t socket::read_size() const noexcept { return read_size_; }
+
+    void socket::set_read_size(size_t value) noexcept {
+      read_size_ = value > 0 ? value : DEFAULT_READ_SIZE;
+    }
+
     void socket::on_recv(data_buffer &s) {}
 
+    size_t socket::on_recv(data_type *, size_t size) { return size; }
+
     socket &socket::operator<<(const data_buffer &s) {
       if (send(s) < 0) {
         throw socket_exception("Could not write to socket.");
@@ -176,56 +251,252 @@ namespace coda {
       return *this;
     }
 
-    bool socket::connect(const string &host, const int port) {
-      struct addrinfo hints, *result, *p;
+    namespace detail {
+      void set_blocking(SOCKET sock, bool blocking) {
+#ifndef _WIN32
+        int opts = fcntl(sock, F_GETFL);
 
-      memset(&hints, 0, sizeof hints);
-      hints.ai_family = AF_UNSPEC; // use AF_INET6 to force IPv6
-      hints.ai_socktype = SOCK_STREAM;
-      hints.ai_flags = AI_PASSIVE;
+        if (opts >= 0) {
+          fcntl(sock, F_SETFL,
+                blocking ? (opts & ~O_NONBLOCK) : (opts | O_NONBLOCK));
+        }
+#else
+        u_long mode = blocking ? 0 : 1;
+        ioctlsocket(sock, FIONBIO, &mode);
+#endif
+      }
 
-      char servnam[101] = {0};
-      snprintf(servnam, 100, "%d", port);
+      /*!
+       * orders addresses so the families alternate, starting with the
+       * family the resolver preferred (RFC 8305 section 4)
+       */
+      vector<resolver::endpoint>
+      interleave(const vector<resolver::endpoint> &list, int port) {
+        vector<resolver::endpoint> preferred, others, ordered;
+
+        for (auto value : list) {
+          if (value.family == AF_INET) {
+            ((struct sockaddr_in *)&value.addr)->sin_port = htons(port);
+          } else if (value.family == AF_INET6) {
+            ((struct sockaddr_in6 *)&value.addr)->sin6_port = htons(port);
+          }
+
+          if (value.family == list.front().family) {
+            preferred.push_back(value);
+          } else {
+            others.push_back(value);
+          }
+        }
 
-      if (getaddrinfo(host.c_str(), servnam, &hints, &result) != 0) {
-        return false;
-      }
+        for (size_t i = 0; i < preferred.size() || i < others.size(); i++) {
+          if (i < preferred.size()) {
+            ordered.push_back(preferred[i]);
+          }
+          if (i < others.size()) {
+            ordered.push_back(others[i]);
+          }
+        }
 
-      if (is_valid()) {
-        close();
+        return ordered;
       }
 
-      for (p = result; p != NULL; p = p->ai_next) {
-        auto sock = ::socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+      /*!
+       * Races connections to the addresses, starting another each time the
+       * attempt delay passes or an attempt fails.
+       * @returns the first connected socket, or INVALID with errno set
+       */
+      SOCKET race(const vector<resolver::endpoint> &list, int port,
+                  chrono::milliseconds delay, chrono::milliseconds timeout,
+                  sockaddr_storage &addr) {
+        typedef chrono::steady_clock clock;
 
-        if (sock == INVALID) {
-          continue;
+        struct attempt {
+          SOCKET sock;
+          const resolver::endpoint *info;
+        };
+
+        auto candidates = interleave(list, port);
+
+        vector<attempt> running;
+
+        vector<pollfd> fds;
+
+        size_t next = 0;
+
+        SOCKET winner = socket::INVALID;
+
+        const resolver::endpoint *won = NULL;
+
+        int error = ECONNREFUSED;
+
+        auto now = clock::now();
+
+        auto deadline =
+            timeout.count() > 0 ? now + timeout : clock::time_point::max();
+
+        auto next_start = now;
+
+        while (winner == socket::INVALID) {
+          now = clock::now();
+
+          if (now >= deadline) {
+            error = ETIMEDOUT;
+            break;
+          }
+
+          if (next < candidates.size() &&
+              (running.empty() || now >= next_start)) {
+            auto info = &candidates[next++];
+
+            SOCKET sock =
+                ::socket(info->family, info->socktype, info->protocol);
+
+            if (sock == socket::INVALID) {
+              error = errno;
+              continue;
+            }
+
+            set_blocking(sock, false);
+
+            if (::connect(sock, (const struct sockaddr *)&info->addr,
+                          info->length) == 0) {
+              winner = sock;
+              won = info;
+              break;
+            }
+
+            if (errno != EINPROGRESS) {
+              error = errno;
+              closesocket(sock);
+              continue;
+            }
+
+            running.push_back({sock, info});
+
+            next_start = now + delay;
+            continue;
+          }
+
+          if (running.empty()) {
+            break;
+          }
+
+          // wake for a result, the next attempt or the deadline
+          auto until = deadline;
+
+          if (next < candidates.size()) {
+            until = min(until, next_start);
+          }
+
+          int wait = -1;
+
+          if (until != clock::time_point::max()) {
+            wait = static_cast<int>(
+                       chrono::duration_cast<chrono::milliseconds>(until - now)
+                           .count()) +
+                   1;
+          }
+
+          fds.clear();
+
+          for (const auto &value : running) {
+            fds.push_back({value.sock, POLLOUT, 0});
+          }
+
+#ifdef _WIN32
+          int n = WSAPoll(fds.data(), fds.size(), wait);
+#else
+          int n = ::poll(fds.data(), fds.size(), wait);
+#endif
+
+          if (n < 0) {
+            if (errno == EINTR) {
+              continue;
+            }
+            error = errno;
+            break;
+          }
+
+          for (size_t i = fds.size(); i-- > 0;) {
+            if (fds[i].revents == 0) {
+              continue;
+            }
+
+            int status = 0;
+            socklen_t length = sizeof(status);
+
+            if (getsockopt(running[i].sock, SOL_SOCKET, SO_ERROR,
+                           (char *)&status, &length) != 0) {
+              status = errno;
+            }
+
+            if (status == 0 && winner == socket::INVALID) {
+              winner = running[i].sock;
+              won = running[i].info;
+            } else {
+              if (status != 0) {
+                error = status;
+              }
+              closesocket(running[i].sock);
+              // a failure starts the next attempt straight away
+              next_start = now;
+            }
+
+            running.erase(running.begin() + i);
+          }
         }
 
-        if (::connect(sock, p->ai_addr, p->ai_addrlen) != INVALID) {
-          sock_ = sock;
-          break;
+        for (const auto &value : running) {
+          closesocket(value.sock);
         }
 
-        closesocket(sock);
+        if (winner == socket::INVALID) {
+          errno = error;
+          return socket::INVALID;
+        }
+
+        set_blocking(winner, true);
+
+        memset(&addr, 0, sizeof(addr));
+        memmove(&addr, &won->addr, won->length);
+
+        return winner;
       }
+    } // namespace detail
 
-      if (p == NULL || sock_ == INVALID) {
-        freeaddrinfo(result);
+    bool socket::connect(const string &host, const int port) {
+      resolver::endpoints_type endpoints;
+
+      if (resolver::shared().resolve(host, endpoints) != 0) {
         return false;
       }
 
-      memmove(&addr_, p->ai_addr, p->ai_addrlen);
+      if (is_valid()) {
+        close();
+      }
 
-      freeaddrinfo(result);
+      sock_ = detail::race(*endpoints, port, CONNECT_ATTEMPT_DELAY,
+                           connect_timeout_, addr_);
+
+      if (sock_ == INVALID) {
+        return false;
+      }
 
       if (ssl_) {
-        ssl_->attach(sock_);
+        ssl_->attach(sock_, host, port);
       }
 
       return true;
     }
 
+    chrono::milliseconds socket::connect_timeout() const noexcept {
+      return connect_timeout_;
+    }
+
+    void socket::set_connect_timeout(chrono::milliseconds value) noexcept {
+      connect_timeout_ = value;
+    }
+
     bool socket::listen(const int port, const int backlogSize) {
       struct addrinfo hints, *result = NULL, *p = NULL;
 
@@ -283,10 +554,6 @@ namespace coda {
         return false;
       }
 
-      if (ssl_) {
-        ssl_->attach(sock_);
-      }
-
       return true;
     }
 
@@ -337,5 +604,52 @@ namespace coda {
         ssl_ = nullptr;
       }
     }
+
+    void socket::set_secure(const std::shared_ptr<secure_layer> &layer) {
+      ssl_ = layer;
+    }
+
+    bool socket::handshake() {
+      if (!ssl_) {
+        return true;
+      }
+
+      return ssl_->handshake();
+    }
+
+    bool socket::is_handshaking() const noexcept {
+      return ssl_ && !ssl_->is_handshake_done();
+    }
+
+    bool socket::wants_write() const noexcept {
+      return ssl_ && (ssl_->read_wants() == secure_layer::WANTS_WRITE ||
+                      ssl_->send_wants() == secure_layer::WANTS_WRITE);
+    }
+
+    bool socket::send_wants_read() const noexcept {
+      return ssl_ && ssl_->send_wants() == secure_layer::WANTS_READ;
+    }
+
+    size_t socket::pending() const noexcept {
+      return ssl_ ? ssl_->pending() : 0;
+    }
+
+    size_t socket::pending_records() const noexcept {
+      return ssl_ ? ssl_->pending_output() : 0;
+    }
+
+    int socket::send_records() { return ssl_ ? ssl_->send_pending() : 0; }
+
+    bool socket::feed_records(const void *data, size_t size) {
+      return ssl_ && ssl_->feed(data, size);
+    }
+
+    bool socket::is_kernel_send() const noexcept {
+      return ssl_ && ssl_->is_kernel_send();
+    }
+
+    const std::shared_ptr<secure_layer> &socket::secure() const noexcept {
+      return ssl_;
+    }
   } // namespace net
 } // namespace coda
@@ -12,8 +12,11 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #endif
+#include "buffer.h"
+#include <chrono>
 #include <exception>
 #include <iostream>
 #include <memory>
@@ -38,7 +41,7 @@ namespace coda {
      */
     class socket {
       public:
-      static const int INVALID = -1;
+      static constexpr int INVALID = -1;
 
       /*!
        * the base data type for sockets
@@ -106,12 +109,40 @@ namespace coda {
        */
       virtual int send(const void *, size_t, int flags = 0);
 
+      /*!
+       * Will write several blocks of data to the socket in one call
+       * @return the number of bytes written
+       */
+      virtual int sendv(const struct iovec *iov, int count, int flags = 0);
+
       /*!
        * Recieves a block of input
        * @returns the number of bytes read
        */
       virtual int recv(data_buffer &, int flags = 0);
 
+      /*!
+       * Recieves input directly into caller owned memory, without filtering
+       * @returns the number of bytes read
+       */
+      virtual int recv_into(buffer::span dest, int flags = 0);
+
+      /*!
+       * Recieves up to read_size() bytes directly into the tail of a buffer
+       * @returns the number of bytes read
+       */
+      int recv_into(buffer &dest, int flags = 0);
+
+      /*!
+       * @returns the maximum number of bytes read per recieve
+       */
+      size_t read_size() const noexcept;
+
+      /*!
+       * sets the maximum number of bytes read per recieve
+       */
+      void set_read_size(size_t value) noexcept;
+
       /*!
        * @returns true if the socket is alive and connected
        */
@@ -148,10 +179,25 @@ namespace coda {
       virtual void close();
 
       /*!
-       * Client initialization, connects to a host and port
+       * Client initialization, connects to a host and port.  The host's
+       * addresses are raced, alternating between IPv6 and IPv4, with a new
+       * attempt started every CONNECT_ATTEMPT_DELAY until one succeeds.
+       * ip() and port() report the address that won.
+       * @returns false if none connected within the connect timeout
        */
       virtual bool connect(const std::string &host, const int port);
 
+      /*!
+       * @returns how long connect() may take, zero for no limit
+       */
+      std::chrono::milliseconds connect_timeout() const noexcept;
+
+      /*!
+       * sets how long connect() may take across all addresses, zero for no
+       * limit
+       */
+      void set_connect_timeout(std::chrono::milliseconds value) noexcept;
+
       /*!
        * Accepts a socket
        * @param addr the address structure to populate
@@ -175,13 +221,89 @@ namespace coda {
 
       void set_secure(bool value);
 
+      /*!
+       * Secures the socket with a layer of its own, such as one with a
+       * server certificate on a listening socket
+       */
+      void set_secure(const std::shared_ptr<secure_layer> &layer);
+
+      /*!
+       * Moves a secure handshake along without blocking
+       * @returns true once the session is ready for data
+       * @throws socket_exception if the handshake failed
+       */
+      bool handshake();
+
+      /*!
+       * @returns true while a secure session is still being set up
+       */
+      bool is_handshaking() const noexcept;
+
+      /*!
+       * @returns true if the secure layer can't go on, reading or sending,
+       * until the socket is writable
+       */
+      bool wants_write() const noexcept;
+
+      /*!
+       * @returns true if the last secure send can't go on until the socket
+       * is readable
+       */
+      bool send_wants_read() const noexcept;
+
+      /*!
+       * @returns bytes the secure layer has already decrypted, readable
+       * without waiting on the socket
+       */
+      size_t pending() const noexcept;
+
+      /*!
+       * @returns bytes the secure layer has already encrypted, waiting for
+       * room in the socket
+       */
+      size_t pending_records() const noexcept;
+
+      /*!
+       * Sends what the secure layer has already encrypted
+       * @returns 0 once nothing is left, or -1 with errno set
+       */
+      int send_records();
+
+      /*!
+       * @returns true if the kernel encrypts for the secure layer, so the
+       * raw socket can be written to directly
+       */
+      bool is_kernel_send() const noexcept;
+
+      /*!
+       * Hands records recieved elsewhere to the secure layer, which stops
+       * reading the socket itself
+       * @returns false if the socket has no layer that can be fed
+       */
+      bool feed_records(const void *data, size_t size);
+
       protected:
       static const int MAXHOSTNAME = 200;
-      static const int MAXRECV = 500;
       static const int BACKLOG_SIZE = 10;
+      static constexpr size_t DEFAULT_READ_SIZE = 64 * 1024;
+      static constexpr std::chrono::milliseconds DEFAULT_CONNECT_TIMEOUT =
+          std::chrono::seconds(30);
+      static constexpr std::chrono::milliseconds CONNECT_ATTEMPT_DELAY =
+          std::chrono::milliseconds(250);
 
       virtual void on_recv(data_buffer &s);
 
+      /*!
+       * filters bytes recieved into a buffer in place
+       * @returns the number of bytes to keep
+       */
+      virtual size_t on_recv(data_type *data, size_t size);
+
+      /*!
+       * @returns the secure layer, null if the socket is not secure
+       */
+      const std::shared_ptr<secure_layer> &secure() const noexcept;
+
       // the raw socket
       SOCKET sock_;
 
@@ -190,6 +312,8 @@ namespace coda {
 
       private:
       bool non_blocking_;
+      size_t read_size_;
+      std::chrono::milliseconds connect_timeout_;
       std::shared_ptr<secure_layer> ssl_;
     };
   } // namespace net
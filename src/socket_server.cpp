@@ -1,6 +1,7 @@
 
 #include "socket_server.h"
 #include "exception.h"
+#include "secure_layer.h"
 #include "socket_server_listener.h"
 #include <algorithm>
 #include <cassert>
@@ -147,6 +148,21 @@ namespace coda {
                                                         sockaddr_storage addr) {
       auto sock = factory_->create_socket(this, socket, addr);
 
+      // the server decides how the connection is driven, and it is told of
+      // the connection that way: a non-blocking one is served by the
+      // server's loop rather than a thread of its own
+      sock->set_non_blocking(is_non_blocking());
+
+      if (secure()) {
+        // each connection gets a session of the listener's context
+        try {
+          sock->set_secure(secure()->accept(socket));
+        } catch (const socket_exception &e) {
+          sock->close();
+          return nullptr;
+        }
+      }
+
       sock->notify_connect();
 
       return sock;
@@ -0,0 +1,193 @@
+#include "connection_table.h"
+#include <algorithm>
+
+namespace coda {
+  namespace net {
+    namespace sync {
+      connection_table::connection_table()
+          : owner_(std::thread::id()), size_(0), generation_(0),
+            has_pending_(false) {}
+
+      void connection_table::bind() {
+        if (is_owner() && !has_pending_.load(std::memory_order_acquire)) {
+          return;
+        }
+
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+
+        owner_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+        apply_pending();
+      }
+
+      void connection_table::unbind() {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+
+        apply_pending();
+
+        owner_.store(std::thread::id(), std::memory_order_relaxed);
+      }
+
+      connection_table::handle_type
+      connection_table::insert(
+          const socket_type &sock, uint32_t events,
+          const std::shared_ptr<connection_activity> &activity) {
+        if (!sock || !sock->is_valid()) {
+          return 0;
+        }
+
+        uint32_t generation = ++generation_;
+
+        SOCKET fd = sock->raw_socket();
+
+        submit({CHANGE_INSERT, fd, generation, sock, events, activity});
+
+        return (static_cast<handle_type>(generation) << 32) |
+               static_cast<uint32_t>(fd);
+      }
+
+      void connection_table::remove(SOCKET sock) {
+        submit({CHANGE_REMOVE, sock, 0, nullptr, 0, nullptr});
+      }
+
+      void connection_table::remove_handle(handle_type handle) {
+        submit({CHANGE_REMOVE, static_cast<SOCKET>(handle & 0xFFFFFFFF),
+                static_cast<uint32_t>(handle >> 32), nullptr, 0, nullptr});
+      }
+
+      void connection_table::clear() {
+        submit({CHANGE_CLEAR, socket::INVALID, 0, nullptr, 0, nullptr});
+      }
+
+      connection_table::socket_type connection_table::find(SOCKET sock) {
+        auto value = find_entry(sock);
+
+        return value == NULL ? nullptr : value->socket;
+      }
+
+      connection_table::entry *connection_table::find_entry(SOCKET sock) {
+        if (sock < 0) {
+          return NULL;
+        }
+
+        // a connection added by another thread may still be queued
+        if (static_cast<size_t>(sock) >= entries_.size() ||
+            !entries_[sock].socket) {
+          if (!has_pending_.load(std::memory_order_acquire)) {
+            return NULL;
+          }
+
+          std::lock_guard<std::mutex> lock(pending_mutex_);
+
+          apply_pending();
+
+          if (static_cast<size_t>(sock) >= entries_.size() ||
+              !entries_[sock].socket) {
+            return NULL;
+          }
+        }
+
+        return &entries_[sock];
+      }
+
+      size_t connection_table::size() const noexcept {
+        return size_.load(std::memory_order_relaxed);
+      }
+
+      void connection_table::submit(change &&value) {
+        if (is_owner()) {
+          // keep the order of changes queued before this one
+          if (has_pending_.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            apply_pending();
+          }
+          apply(value);
+          return;
+        }
+
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+
+        // no reactor is polling, so nothing else is reading the table
+        if (owner_.load(std::memory_order_relaxed) == std::thread::id()) {
+          apply(value);
+          return;
+        }
+
+        pending_.push_back(std::move(value));
+
+        has_pending_.store(true, std::memory_order_release);
+      }
+
+      void connection_table::apply(const change &value) {
+        switch (value.type) {
+        case CHANGE_INSERT: {
+          if (value.sock < 0) {
+            return;
+          }
+
+          size_t index = value.sock;
+
+          if (index >= entries_.size()) {
+            entries_.resize(std::max(index + 1, entries_.size() * 2));
+          }
+
+          auto &slot = entries_[index];
+
+          if (!slot.socket) {
+            size_++;
+          }
+
+          slot.socket = value.socket;
+          slot.generation = value.generation;
+          slot.events = value.events;
+          slot.activity = value.activity;
+          break;
+        }
+        case CHANGE_REMOVE: {
+          if (value.sock < 0 ||
+              static_cast<size_t>(value.sock) >= entries_.size()) {
+            return;
+          }
+
+          auto &slot = entries_[value.sock];
+
+          // no generation removes whatever is there
+          if (!slot.socket ||
+              (value.generation != 0 && value.generation != slot.generation)) {
+            return;
+          }
+
+          slot.socket = nullptr;
+          slot.events = 0;
+          slot.activity = nullptr;
+          size_--;
+          break;
+        }
+        case CHANGE_CLEAR:
+          for (auto &slot : entries_) {
+            slot.socket = nullptr;
+            slot.events = 0;
+            slot.activity = nullptr;
+          }
+          size_ = 0;
+          break;
+        }
+      }
+
+      void connection_table::apply_pending() {
+        for (const auto &value : pending_) {
+          apply(value);
+        }
+
+        pending_.clear();
+
+        has_pending_.store(false, std::memory_order_release);
+      }
+
+      bool connection_table::is_owner() const noexcept {
+        return owner_.load(std::memory_order_relaxed) ==
+               std::this_thread::get_id();
+      }
+    } // namespace sync
+  }   // namespace net
+} // namespace coda
@@ -0,0 +1,135 @@
+#ifndef CODA_NET_SERVER_SYNC_CONNECTION_TABLE_H
+#define CODA_NET_SERVER_SYNC_CONNECTION_TABLE_H
+
+#include "../buffered_socket.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    namespace sync {
+      struct connection_activity;
+
+      /*!
+       * A table of connections indexed by descriptor.  The reactor thread
+       * that owns the table reads and changes it without locking, while
+       * changes from other threads are queued and applied by the owner.
+       * Each entry has a generation, so a stale handle to a descriptor
+       * that has since been reused changes nothing.
+       */
+      class connection_table {
+        public:
+        typedef std::shared_ptr<buffered_socket> socket_type;
+
+        /*!
+         * identifies one connection, as the generation and the descriptor
+         */
+        typedef uint64_t handle_type;
+
+        struct entry {
+          socket_type socket;
+          uint32_t generation;
+          // free for the reactor to use, such as for registered events
+          uint32_t events;
+          std::shared_ptr<connection_activity> activity;
+        };
+
+        connection_table();
+        connection_table(const connection_table &other) = delete;
+        connection_table(connection_table &&other) = delete;
+        connection_table &operator=(const connection_table &other) = delete;
+        connection_table &operator=(connection_table &&other) = delete;
+
+        /*!
+         * Makes the calling thread the owner and applies queued changes
+         */
+        void bind();
+
+        /*!
+         * Applies queued changes and releases the table, so any thread
+         * may change it directly until it is bound again
+         */
+        void unbind();
+
+        /*!
+         * @returns true if the calling thread owns the table
+         */
+        bool is_owner() const noexcept;
+
+        /*!
+         * Adds a connection, replacing any for the same descriptor
+         * @returns the handle for the connection
+         */
+        handle_type
+        insert(const socket_type &sock, uint32_t events = 0,
+               const std::shared_ptr<connection_activity> &activity = nullptr);
+
+        /*!
+         * Removes whatever connection has the descriptor
+         */
+        void remove(SOCKET sock);
+
+        /*!
+         * Removes a connection if the handle is still current
+         */
+        void remove_handle(handle_type handle);
+
+        void clear();
+
+        /*!
+         * Only for the owner thread
+         * @returns the connection for a descriptor or nullptr
+         */
+        socket_type find(SOCKET sock);
+
+        /*!
+         * Only for the owner thread, and valid until the next change
+         * @returns the entry for a descriptor or NULL
+         */
+        entry *find_entry(SOCKET sock);
+
+        /*!
+         * @returns the number of connections
+         */
+        size_t size() const noexcept;
+
+        private:
+        typedef enum { CHANGE_INSERT, CHANGE_REMOVE, CHANGE_CLEAR } change_type;
+
+        struct change {
+          change_type type;
+          SOCKET sock;
+          uint32_t generation;
+          socket_type socket;
+          uint32_t events;
+          std::shared_ptr<connection_activity> activity;
+        };
+
+        /*!
+         * applies a change now or queues it for the owner
+         */
+        void submit(change &&value);
+
+        void apply(const change &value);
+
+        void apply_pending();
+
+        std::vector<entry> entries_;
+
+        std::atomic<std::thread::id> owner_;
+        std::atomic<size_t> size_;
+        std::atomic<uint32_t> generation_;
+
+        std::mutex pending_mutex_;
+        std::vector<change> pending_;
+        std::atomic<bool> has_pending_;
+      };
+    } // namespace sync
+  }   // namespace net
+} // namespace coda
+
+#endif
@@ -8,22 +8,46 @@
 
 #define MAXEVENTS 64
 
+#define CLIENT_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET)
+
 namespace coda {
   namespace net {
     namespace sync {
-      impl::impl() : socket_(socket::INVALID) {}
-      impl::impl(impl &&other) : socket_(std::move(other.socket_)) {}
-      impl::~impl() {
+      epoll_impl::epoll_impl() : socket_(socket::INVALID) {}
+      epoll_impl::epoll_impl(epoll_impl &&other)
+          : socket_(std::move(other.socket_)) {
+        other.socket_ = socket::INVALID;
+        watch_wakeup();
+      }
+      epoll_impl::~epoll_impl() {
         if (socket_ != socket::INVALID) {
           ::close(socket_);
           socket_ = socket::INVALID;
         }
       }
-      impl &impl::operator=(impl &&other) {
+      epoll_impl &epoll_impl::operator=(epoll_impl &&other) {
         socket_ = std::move(other.socket_);
+        other.socket_ = socket::INVALID;
+        watch_wakeup();
         return *this;
       }
-      bool impl::listen(server &server) {
+
+      bool epoll_impl::watch_wakeup() {
+        if (socket_ == socket::INVALID) {
+          return false;
+        }
+
+        struct epoll_event event;
+
+        memset(&event, 0, sizeof(epoll_event));
+
+        event.data.fd = wakeup_[0];
+        event.events = EPOLLIN;
+
+        return epoll_ctl(socket_, EPOLL_CTL_ADD, wakeup_[0], &event) !=
+               socket::INVALID;
+      }
+      bool epoll_impl::listen(server &server) {
         if (!server.is_valid()) {
           return false;
         }
@@ -41,75 +65,169 @@ namespace coda {
         event.data.fd = server.raw_socket();
         event.events = EPOLLIN | EPOLLET;
 
+#ifdef EPOLLEXCLUSIVE
+        // reactors share the listener, so only wake one per connection
+        if (server.threads() > 1) {
+          event.events |= EPOLLEXCLUSIVE;
+        }
+#endif
+
         int s = epoll_ctl(socket_, EPOLL_CTL_ADD, server.raw_socket(), &event);
 
         if (s == socket::INVALID) {
           return false;
         }
 
-        return true;
+        return watch_wakeup();
       }
 
-      void impl::poll(server &server, struct timeval *stall_time) {
+      void epoll_impl::poll(server &server, int timeout) {
         if (!server.is_valid() && socket_ != socket::INVALID) {
           return;
         }
 
         struct epoll_event events[MAXEVENTS] = {0};
 
-        int n =
-            epoll_wait(socket_, events, MAXEVENTS,
-                       stall_time == NULL ? -1 : stall_time->tv_usec / 1000);
+        int n = epoll_wait(socket_, events, MAXEVENTS, timeout);
 
         if (n == socket::INVALID) {
+          if (errno == EINTR) {
+            return;
+          }
           throw socket_exception(strerror(errno));
         }
 
         for (int i = 0; i < n; i++) {
-          if (events[i].events & EPOLLERR) {
-            auto socket = server.find_socket(events[i].data.fd);
+          if (server.raw_socket() == events[i].data.fd) {
+            sockaddr_storage addr;
 
-            if (socket != nullptr) {
-              socket->close();
+            // edge triggered, so accept until the backlog is empty
+            for (int infd = server.accept(addr); infd != socket::INVALID;
+                 infd = server.accept(addr)) {
+              server.accept_socket(*this, infd, addr);
             }
             continue;
           }
 
-          if (events[i].events & EPOLLIN) {
-            if (server.raw_socket() == events[i].data.fd) {
-              sockaddr_storage addr;
+          if (events[i].data.fd == wakeup_[0]) {
+            drain_wakeup();
+            continue;
+          }
+
+          auto c = find_socket(events[i].data.fd);
 
-              int infd = server.accept(addr);
-              if (infd != socket::INVALID) {
-                server.on_accept(infd, addr);
-              }
-              continue;
-            }
+          if (c == nullptr) {
+            continue;
+          }
 
-            auto c = server.find_socket(events[i].data.fd);
+          if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+            c->close();
+            continue;
+          }
 
-            if (c != nullptr) {
-              if (!c->read_to_buffer()) {
-                c->close();
-                continue;
-              }
+          // reads until the socket would block, or resumes a secure read or
+          // handshake that was waiting to write
+          if (((events[i].events & EPOLLIN) || c->wants_write()) &&
+              !c->is_read_closed()) {
+            if (!c->read_to_buffer()) {
+              c->close();
+              continue;
             }
           }
 
-          if (events[i].events & EPOLLOUT) {
-            auto c = server.find_socket(events[i].data.fd);
-            if (c != nullptr && c->has_output()) {
-              if (!c->write_from_buffer()) {
-                c->close();
-                continue;
-              }
+          // flush new output straight away, or resume a blocked write
+          if (c->has_output() &&
+              (!c->is_write_blocked() || (events[i].events & EPOLLOUT))) {
+            if (!c->write_from_buffer()) {
+              c->close();
+              continue;
             }
           }
+
+          // the peer has finished sending, but may still be waiting on
+          // output queued behind a blocked write
+          if (events[i].events & EPOLLRDHUP) {
+            c->stop_reading();
+          }
+
+          if (c->is_finished()) {
+            c->close();
+            continue;
+          }
+
+          update_interest(c);
         }
       }
 
-      std::shared_ptr<server_impl> create_server_impl() {
-        return std::make_shared<impl>();
+      void epoll_impl::add_socket(const socket_type &sock) {
+        if (!sock || !sock->is_valid()) {
+          return;
+        }
+
+        // edge triggered reads must drain until they would block
+        sock->set_non_blocking(true);
+
+        struct epoll_event event;
+
+        memset(&event, 0, sizeof(epoll_event));
+
+        event.data.fd = sock->raw_socket();
+        event.events = CLIENT_EVENTS;
+
+        if (sock->needs_writable()) {
+          event.events |= EPOLLOUT;
+        }
+
+        // in the table first, so the first event can find it
+        auto handle = insert_socket(sock, event.events);
+
+        if (epoll_ctl(socket_, EPOLL_CTL_ADD, sock->raw_socket(), &event) ==
+            socket::INVALID) {
+          // an unwatched socket would never be served, so drop it
+          sockets_.remove_handle(handle);
+        }
+      }
+
+      void epoll_impl::remove_socket(const SOCKET &sock) {
+        epoll_ctl(socket_, EPOLL_CTL_DEL, sock, NULL);
+
+        server_impl::remove_socket(sock);
+      }
+
+      void epoll_impl::update_interest(const socket_type &sock) {
+        if (!sock->is_valid()) {
+          return;
+        }
+
+        auto entry = sockets_.find_entry(sock->raw_socket());
+
+        if (entry == NULL || entry->socket != sock) {
+          return;
+        }
+
+        // a peer that has finished sending is only written to
+        uint32_t events = sock->is_read_closed() ? EPOLLET : CLIENT_EVENTS;
+
+        // only ask for writability while something is waiting on it
+        if (sock->needs_writable()) {
+          events |= EPOLLOUT;
+        }
+
+        if (events == entry->events) {
+          return;
+        }
+
+        struct epoll_event event;
+
+        memset(&event, 0, sizeof(epoll_event));
+
+        event.data.fd = sock->raw_socket();
+        event.events = events;
+
+        if (epoll_ctl(socket_, EPOLL_CTL_MOD, sock->raw_socket(), &event) !=
+            socket::INVALID) {
+          entry->events = events;
+        }
       }
     } // namespace sync
   }   // namespace net
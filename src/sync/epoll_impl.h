@@ -5,22 +5,43 @@
 
 #include "../socket.h"
 #include "server_impl.h"
+#include <cstdint>
 
 namespace coda {
   namespace net {
     namespace sync {
-      class impl : public server_impl {
+      class epoll_impl : public server_impl {
         public:
-        impl();
-        impl(const impl &other) = delete;
-        impl(impl &&other);
-        virtual ~impl();
-        impl &operator=(const impl &other) = delete;
-        impl &operator=(impl &&other);
+        epoll_impl();
+        epoll_impl(const epoll_impl &other) = delete;
+        epoll_impl(epoll_impl &&other);
+        virtual ~epoll_impl();
+        epoll_impl &operator=(const epoll_impl &other) = delete;
+        epoll_impl &operator=(epoll_impl &&other);
         bool listen(server &server);
-        void poll(server &server, struct timeval *stall_time);
+        void poll(server &server, int timeout);
+
+        /*!
+         * registers the socket with epoll as well
+         */
+        void add_socket(const socket_type &sock);
+
+        /*!
+         * deregisters the socket from epoll as well
+         */
+        void remove_socket(const SOCKET &sock);
 
         private:
+        /*!
+         * adds the wakeup pipe to the epoll set
+         */
+        bool watch_wakeup();
+
+        /*!
+         * arms or disarms write interest based on pending output
+         */
+        void update_interest(const socket_type &sock);
+
         SOCKET socket_;
       };
     } // namespace sync
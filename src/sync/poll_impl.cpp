@@ -0,0 +1,301 @@
+#include "poll_impl.h"
+#include "../exception.h"
+#include "server.h"
+#include <cstring>
+
+namespace coda {
+  namespace net {
+    namespace sync {
+      poll_impl::poll_impl() : polling_(false) {}
+
+      poll_impl::poll_impl(poll_impl &&other)
+          : fds_(std::move(other.fds_)), conns_(std::move(other.conns_)),
+            index_(std::move(other.index_)), polling_(false),
+            changes_(std::move(other.changes_)) {
+        if (fds_.size() > WAKEUP) {
+          fds_[WAKEUP].fd = wakeup_[0];
+        }
+      }
+
+      poll_impl::~poll_impl() {}
+
+      poll_impl &poll_impl::operator=(poll_impl &&other) {
+        fds_ = std::move(other.fds_);
+        conns_ = std::move(other.conns_);
+        index_ = std::move(other.index_);
+        changes_ = std::move(other.changes_);
+        polling_ = false;
+        if (fds_.size() > WAKEUP) {
+          fds_[WAKEUP].fd = wakeup_[0];
+        }
+        return *this;
+      }
+
+      bool poll_impl::listen(server &server) {
+        if (!server.is_valid()) {
+          return false;
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
+
+        struct pollfd listener;
+
+        memset(&listener, 0, sizeof(listener));
+
+        listener.fd = server.raw_socket();
+        listener.events = POLLIN;
+
+        struct pollfd wakeup;
+
+        memset(&wakeup, 0, sizeof(wakeup));
+
+        wakeup.fd = wakeup_[0];
+        wakeup.events = POLLIN;
+
+        fds_ = {listener, wakeup};
+        conns_.assign(FIRST_CONNECTION, nullptr);
+        index_.clear();
+
+        return true;
+      }
+
+      void poll_impl::poll(server &server, int timeout) {
+        if (!server.is_valid() || fds_.empty()) {
+          return;
+        }
+
+        {
+          std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
+          polling_ = true;
+        }
+
+        int n = ::poll(fds_.data(), fds_.size(), timeout);
+
+        int error = errno;
+
+        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
+
+        polling_ = false;
+
+        apply_changes();
+
+        if (n < 0) {
+          if (error == EINTR) {
+            return;
+          }
+          throw socket_exception(strerror(error));
+        }
+
+        // check for new connections
+        if (fds_[0].revents & POLLIN) {
+          sockaddr_storage addr;
+
+          for (int infd = server.accept(addr); infd != socket::INVALID;
+               infd = server.accept(addr)) {
+            server.accept_socket(*this, infd, addr);
+          }
+        }
+
+        fds_[0].revents = 0;
+
+        if (fds_[WAKEUP].revents != 0) {
+          drain_wakeup();
+        }
+
+        fds_[WAKEUP].revents = 0;
+
+        // walk backwards so a removal only moves an entry already visited
+        for (size_t i = fds_.size(); i-- > FIRST_CONNECTION;) {
+          // callbacks may have closed several connections
+          if (i >= fds_.size()) {
+            continue;
+          }
+
+          auto c = conns_[i];
+
+          auto revents = fds_[i].revents;
+
+          fds_[i].revents = 0;
+
+          // closed without telling the reactor
+          if (!c || !c->is_valid()) {
+            remove_at(i);
+            continue;
+          }
+
+          if (revents == 0) {
+            // output may have been written outside the reactor
+            fds_[i].events = events_for(c);
+            continue;
+          }
+
+          if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            c->close();
+            continue;
+          }
+
+          if (((revents & POLLIN) || c->wants_write()) &&
+              !c->is_read_closed()) {
+            if (!c->read_to_buffer()) {
+              c->close();
+              continue;
+            }
+          }
+
+          // flush new output straight away, or resume a blocked write
+          if (c->has_output() &&
+              (!c->is_write_blocked() || (revents & POLLOUT))) {
+            if (!c->write_from_buffer()) {
+              c->close();
+              continue;
+            }
+          }
+
+#ifdef POLLRDHUP
+          if (revents & POLLRDHUP) {
+            c->stop_reading();
+          }
+#endif
+
+          // the peer has finished sending, and has been sent everything
+          if (c->is_finished()) {
+            c->close();
+            continue;
+          }
+
+          if (!c->is_valid()) {
+            continue;
+          }
+
+          auto it = index_.find(c->raw_socket());
+
+          if (it != index_.end()) {
+            fds_[it->second].events = events_for(c);
+          }
+        }
+      }
+
+      void poll_impl::add_socket(const socket_type &sock) {
+        if (!sock || !sock->is_valid()) {
+          return;
+        }
+
+        // a readable socket is read until it would block
+        sock->set_non_blocking(true);
+
+        server_impl::add_socket(sock);
+
+        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
+
+        if (polling_) {
+          changes_.emplace_back(sock->raw_socket(), sock);
+
+          // a blocked poll won't see the new connection until it returns
+          wakeup();
+          return;
+        }
+
+        append(sock);
+      }
+
+      void poll_impl::remove_socket(const SOCKET &sock) {
+        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
+
+        if (polling_) {
+          changes_.emplace_back(sock, nullptr);
+        } else {
+          auto it = index_.find(sock);
+
+          if (it != index_.end()) {
+            remove_at(it->second);
+          }
+        }
+
+        server_impl::remove_socket(sock);
+      }
+
+      void poll_impl::append(const socket_type &sock) {
+        if (!sock->is_valid() || fds_.size() < FIRST_CONNECTION) {
+          return;
+        }
+
+        struct pollfd entry;
+
+        memset(&entry, 0, sizeof(entry));
+
+        entry.fd = sock->raw_socket();
+        entry.events = events_for(sock);
+
+        auto it = index_.find(entry.fd);
+
+        // the descriptor was reused before the old entry was removed
+        if (it != index_.end()) {
+          fds_[it->second] = entry;
+          conns_[it->second] = sock;
+          return;
+        }
+
+        index_[entry.fd] = fds_.size();
+        fds_.push_back(entry);
+        conns_.push_back(sock);
+      }
+
+      void poll_impl::remove_at(size_t index) {
+        if (index < FIRST_CONNECTION || index >= fds_.size()) {
+          return;
+        }
+
+        auto last = fds_.size() - 1;
+
+        index_.erase(fds_[index].fd);
+
+        if (index != last) {
+          fds_[index] = fds_[last];
+          conns_[index] = std::move(conns_[last]);
+          index_[fds_[index].fd] = index;
+        }
+
+        fds_.pop_back();
+        conns_.pop_back();
+      }
+
+      void poll_impl::apply_changes() {
+        for (const auto &change : changes_) {
+          if (change.second) {
+            append(change.second);
+            continue;
+          }
+
+          auto it = index_.find(change.first);
+
+          if (it != index_.end()) {
+            remove_at(it->second);
+          }
+        }
+
+        changes_.clear();
+      }
+
+      short poll_impl::events_for(const socket_type &sock) const {
+#ifdef POLLRDHUP
+        short events = POLLIN | POLLRDHUP;
+#else
+        short events = POLLIN;
+#endif
+
+        // readability is level triggered, so stop asking once the peer has
+        // finished sending
+        if (sock->is_read_closed()) {
+          events = 0;
+        }
+
+        // only ask for writability while something is waiting on it
+        if (sock->needs_writable()) {
+          events |= POLLOUT;
+        }
+
+        return events;
+      }
+    } // namespace sync
+  }   // namespace net
+} // namespace coda
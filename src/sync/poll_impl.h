@@ -0,0 +1,81 @@
+#ifndef CODA_NET_SERVER_SYNC_POLL_IMPL_H
+#define CODA_NET_SERVER_SYNC_POLL_IMPL_H
+
+#include "server_impl.h"
+#include <poll.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    namespace sync {
+      /*!
+       * A reactor using poll(), for systems without epoll or io_uring.  The
+       * poll set is kept as a compact array updated as connections come and
+       * go, so there is no limit on descriptor values.
+       */
+      class poll_impl : public server_impl {
+        public:
+        poll_impl();
+        poll_impl(const poll_impl &other) = delete;
+        poll_impl(poll_impl &&other);
+        virtual ~poll_impl();
+        poll_impl &operator=(const poll_impl &other) = delete;
+        poll_impl &operator=(poll_impl &&other);
+
+        bool listen(server &server);
+
+        void poll(server &server, int timeout);
+
+        /*!
+         * adds the socket to the poll set as well
+         */
+        void add_socket(const socket_type &sock);
+
+        /*!
+         * removes the socket from the poll set as well
+         */
+        void remove_socket(const SOCKET &sock);
+
+        private:
+        // the entries before the connections
+        static constexpr size_t WAKEUP = 1;
+        static constexpr size_t FIRST_CONNECTION = 2;
+
+        /*!
+         * adds an entry, replacing any for the same descriptor
+         */
+        void append(const socket_type &sock);
+
+        /*!
+         * removes an entry by moving the last one into its place
+         */
+        void remove_at(size_t index);
+
+        /*!
+         * applies changes made by other threads while polling
+         */
+        void apply_changes();
+
+        /*!
+         * @returns the events to wait for on a connection
+         */
+        short events_for(const socket_type &sock) const;
+
+        // the listener is always the first entry, then the wakeup pipe
+        std::vector<struct pollfd> fds_;
+        // the connection for each entry in fds_
+        std::vector<socket_type> conns_;
+        std::unordered_map<SOCKET, size_t> index_;
+
+        // the poll set can't change under a blocked poll() call, so
+        // other threads queue their changes, a null socket is a removal
+        bool polling_;
+        std::vector<std::pair<SOCKET, socket_type>> changes_;
+      };
+    } // namespace sync
+  }   // namespace net
+} // namespace coda
+
+#endif
@@ -2,64 +2,76 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <thread>
 
 #include "../exception.h"
+#include "epoll_impl.h"
 #include "listener.h"
+#include "poll_impl.h"
+#include "uring_impl.h"
 
 namespace coda {
   namespace net {
     namespace sync {
       namespace detail {
-        class cleanup_listener : public buffered_socket_listener {
-          private:
-          server &server_;
-
-          public:
-          cleanup_listener(server &server) : server_(server) {}
-
-          void on_close(const buffered_socket_listener::socket_type &socket) {
-            if (!socket || !socket->is_valid()) {
-              return;
+        std::shared_ptr<server_impl> create_server_impl(poller_type type) {
+          switch (type) {
+          case POLLER_URING:
+#ifdef URING_FOUND
+            if (uring_impl::is_supported()) {
+              return std::make_shared<uring_impl>();
             }
-
-            server_.remove_socket(socket->raw_socket());
-          }
-
-          void on_connect(const buffered_socket_listener::socket_type &sock) {}
-
-          void on_will_read(const buffered_socket_listener::socket_type &sock) {
+#endif
+            // fall through
+          case POLLER_DEFAULT:
+          case POLLER_EPOLL:
+#ifdef EPOLL_FOUND
+            return std::make_shared<epoll_impl>();
+#endif
+            // fall through
+          default:
+            return std::make_shared<poll_impl>();
           }
+        }
 
-          void on_did_read(const buffered_socket_listener::socket_type &sock) {}
-
-          void
-          on_will_write(const buffered_socket_listener::socket_type &sock) {}
-
-          void on_did_write(const buffered_socket_listener::socket_type &sock) {
+        /*!
+         * @returns the poller to try when another fails to start
+         */
+        poller_type fallback_poller(poller_type type) {
+          switch (type) {
+          case POLLER_URING:
+            return POLLER_EPOLL;
+          default:
+            return POLLER_POLL;
           }
-        };
+        }
       } // namespace detail
 
-      extern std::shared_ptr<server_impl> create_server_impl();
-
       server::server(const factory_type &factory)
-          : socket_server(factory), impl_(create_server_impl()),
-            frequency_(DEFAULT_FREQUENCY) {}
+          : socket_server(factory), frequency_(DEFAULT_FREQUENCY),
+            threads_(1), poller_(POLLER_DEFAULT), timeouts_() {}
 
       server::server(server &&other)
-          : socket_server(std::move(other)), impl_(std::move(other.impl_)),
-            frequency_(other.frequency_) {
-        other.impl_ = nullptr;
+          : socket_server(std::move(other)), impls_(std::move(other.impls_)),
+            frequency_(other.frequency_), threads_(other.threads_),
+            poller_(other.poller_) {
+        std::copy(std::begin(other.timeouts_), std::end(other.timeouts_),
+                  std::begin(timeouts_));
       }
 
       server &server::operator=(server &&other) {
         socket_server::operator=(std::move(other));
 
-        impl_ = std::move(other.impl_);
+        impls_ = std::move(other.impls_);
 
         frequency_ = other.frequency_;
 
-        other.impl_ = nullptr;
+        threads_ = other.threads_;
+
+        poller_ = other.poller_;
+
+        std::copy(std::begin(other.timeouts_), std::end(other.timeouts_),
+                  std::begin(timeouts_));
 
         return *this;
       }
@@ -87,77 +99,181 @@ namespace coda {
       bool server::listen(const int port, const int backlogSize) {
         bool rval = socket_server::listen(port, backlogSize);
 
-        if (rval && impl_) {
-          if (!impl_->listen(*this)) {
-            close();
-            return false;
+        if (!rval) {
+          return false;
+        }
+
+        impls_.clear();
+
+        for (unsigned i = 0; i < threads_; i++) {
+          auto type = poller_;
+
+          auto reactor = detail::create_server_impl(type);
+
+          // a poller may be compiled in but refused by the kernel
+          while (!reactor->listen(*this)) {
+            if (type == POLLER_POLL) {
+              impls_.clear();
+              close();
+              return false;
+            }
+
+            type = detail::fallback_poller(type);
+
+            reactor = detail::create_server_impl(type);
           }
+
+          for (size_t t = 0; t < connection_activity::TIMEOUT_TYPES; t++) {
+            reactor->set_timeout(static_cast<timeout_type>(t), timeouts_[t]);
+          }
+
+          impls_.push_back(reactor);
         }
 
         return rval;
       }
 
-      server::timer *server::wait_time(timer *last_time) const {
-        static timer stall_time;
-        timer now_time;
-        long secDelta;
-        long usecDelta;
-
+      int server::wait_time(timer *last_time) const {
         if (last_time == NULL || frequency_ <= 0) {
-          return NULL;
+          return -1;
         }
 
-        gettimeofday(&now_time, NULL);
+        auto now = timer_wheel::clock::now();
 
-        usecDelta =
-            (last_time->tv_usec - now_time.tv_usec + 1000000) / frequency_;
-        secDelta = (last_time->tv_sec - now_time.tv_sec);
+        duration period(1000 / frequency_);
 
-        while (usecDelta < 0) {
-          usecDelta += 1000000;
-          secDelta -= 1;
-        }
+        auto elapsed = std::chrono::duration_cast<duration>(now - *last_time);
+
+        *last_time = now;
 
-        while (usecDelta >= 1000000) {
-          usecDelta -= 1000000;
-          secDelta += 1;
+        // check if server should stall for a moment based on poll frequency
+        if (elapsed >= period) {
+          return 0;
         }
 
-        memset(&stall_time, 0, sizeof(timer));
+        return static_cast<int>((period - elapsed).count());
+      }
 
-        gettimeofday(last_time, NULL);
+      void server::set_frequency(unsigned value) { frequency_ = value; }
 
-        // check if server should stall for a moment based on poll frequency
-        if (secDelta > 0 || (secDelta == 0 && usecDelta > 0)) {
-          stall_time.tv_usec = usecDelta;
-          stall_time.tv_sec = secDelta;
+      void server::set_threads(unsigned value) {
+        threads_ = std::max(value, 1U);
+      }
+
+      unsigned server::threads() const noexcept { return threads_; }
+
+      void server::set_poller(poller_type value) { poller_ = value; }
+
+      poller_type server::poller() const noexcept { return poller_; }
+
+      void server::set_timeout(timeout_type type, duration value) {
+        timeouts_[type] = std::max(value, duration(0));
+      }
+
+      server::duration server::timeout(timeout_type type) const noexcept {
+        return timeouts_[type];
+      }
+
+      void server::set_timeout(const socket_type &sock, timeout_type type,
+                               duration value) {
+        // only the reactor with the connection will find it
+        for (const auto &reactor : impls_) {
+          std::weak_ptr<server_impl> weak = reactor;
+
+          reactor->schedule(duration(0), [weak, sock, type, value]() {
+            auto reactor = weak.lock();
+            if (reactor) {
+              reactor->set_timeout(sock, type, value);
+            }
+          });
+        }
+      }
+
+      server::timer_id server::schedule(duration delay,
+                                        const std::function<void()> &callback) {
+        if (impls_.empty()) {
+          return 0;
         }
 
-        return &stall_time;
+        auto reactor = std::min_element(
+            impls_.begin(), impls_.end(),
+            [](const std::shared_ptr<server_impl> &a,
+               const std::shared_ptr<server_impl> &b) {
+              return a->connections() < b->connections();
+            });
+
+        return (*reactor)->schedule(delay, callback);
       }
 
-      void server::set_frequency(unsigned value) { frequency_ = value; }
+      bool server::cancel(timer_id id) {
+        for (const auto &reactor : impls_) {
+          if (reactor->cancel(id)) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      void server::poll(timer *last_time) {
+        if (impls_.empty()) {
+          return;
+        }
+
+        poll(*impls_.front(), last_time);
+      }
 
-      void server::poll(struct timeval *last_time) {
+      void server::poll(server_impl &reactor, timer *last_time) {
         if (!is_valid())
           return;
 
-        if (impl_) {
-          impl_->poll(*this, wait_time(last_time));
+        reactor.bind();
+
+        int timeout = wait_time(last_time);
+
+        // wake for the next timer if it comes first
+        int next = reactor.next_timeout();
 
-          notify_poll();
+        if (next >= 0 && (timeout < 0 || next < timeout)) {
+          timeout = next;
         }
+
+        reactor.poll(*this, timeout);
+
+        reactor.expire_timers();
+
+        notify_poll();
       }
 
       void server::on_poll() {}
 
+      void server::run_reactor(const std::shared_ptr<server_impl> &reactor) {
+        timer last_time = timer_wheel::clock::now();
+
+        while (is_valid()) {
+          poll(*reactor, &last_time);
+        }
+
+        reactor->unbind();
+      }
+
       void server::run() {
-        struct timeval last_time;
+        if (impls_.empty()) {
+          return;
+        }
 
-        gettimeofday(&last_time, NULL);
+        std::vector<std::thread> workers;
 
-        while (is_valid()) {
-          poll(&last_time);
+        // the calling thread runs the first reactor
+        for (size_t i = 1; i < impls_.size(); i++) {
+          workers.emplace_back(&server::run_reactor, this, impls_[i]);
+        }
+
+        run_reactor(impls_.front());
+
+        for (auto &worker : workers) {
+          if (worker.joinable()) {
+            worker.join();
+          }
         }
       }
 
@@ -167,49 +283,54 @@ namespace coda {
         clear_sockets();
       }
 
-      server::socket_type server::on_accept(SOCKET sock,
-                                            sockaddr_storage addr) {
-        auto socket = socket_server::on_accept(sock, addr);
+      void server::close() {
+        socket_server::close();
 
-        add_socket(socket);
+        for (const auto &reactor : impls_) {
+          reactor->wakeup();
+        }
+      }
 
-        return socket;
+      server::socket_type server::on_accept(SOCKET sock,
+                                            sockaddr_storage addr) {
+        return socket_server::on_accept(sock, addr);
       }
 
-      socket_server::socket_type server::find_socket(SOCKET value) const {
-        auto it = sockets_.find(value);
+      server::socket_type server::accept_socket(server_impl &reactor,
+                                                SOCKET sock,
+                                                const sockaddr_storage &addr) {
+        auto socket = on_accept(sock, addr);
 
-        if (it == sockets_.end()) {
-          return nullptr;
-        }
+        reactor.add_socket(socket);
 
-        return it->second;
+        return socket;
       }
 
       void server::add_socket(const socket_type &sock) {
-        if (!sock || !sock->is_valid()) {
+        if (impls_.empty()) {
           return;
         }
 
-        // TODO: recursive mutex could get heavy
-        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
-
-        sock->add_listener(std::make_shared<detail::cleanup_listener>(*this));
+        auto reactor = std::min_element(
+            impls_.begin(), impls_.end(),
+            [](const std::shared_ptr<server_impl> &a,
+               const std::shared_ptr<server_impl> &b) {
+              return a->connections() < b->connections();
+            });
 
-        sockets_[sock->raw_socket()] = sock;
+        (*reactor)->add_socket(sock);
       }
 
       void server::remove_socket(const SOCKET &sock) {
-        // TODO: recursive mutex could get heavy
-        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
-
-        sockets_.erase(sock);
+        for (const auto &reactor : impls_) {
+          reactor->remove_socket(sock);
+        }
       }
 
       void server::clear_sockets() {
-        // TODO: recursive mutex could get heavy
-        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
-        sockets_.clear();
+        for (const auto &reactor : impls_) {
+          reactor->clear_sockets();
+        }
       }
     } // namespace sync
   }   // namespace net
@@ -3,20 +3,23 @@
 
 #include "../socket_server.h"
 #include "server_impl.h"
+#include <chrono>
+#include <functional>
+#include <vector>
 
 namespace coda {
   namespace net {
     namespace sync {
-      namespace detail {
-        class cleanup_listener;
-      }
-
       /*!
-       * A syncronous server has a poll frequency and no threads
+       * A syncronous server has a poll frequency.  By default it runs a
+       * single reactor on one thread, but it can run one reactor per thread,
+       * each with its own poller and connection table.
        */
       class server : public socket_server {
         public:
-        typedef struct timeval timer;
+        typedef timer_wheel::clock::time_point timer;
+        typedef timer_wheel::duration duration;
+        typedef timer_wheel::timer_id timer_id;
 
         /*!
          * default constructor
@@ -60,9 +63,73 @@ namespace coda {
          */
         void set_frequency(unsigned cyclesPerSecond);
 
+        /*!
+         * Sets the number of reactor threads. Each thread accepts from the
+         * shared listening socket into its own connection table.  Must be
+         * set before the server starts.
+         * @param value the number of threads, at least one
+         */
+        void set_threads(unsigned value);
+
+        /*!
+         * @returns the number of reactor threads
+         */
+        unsigned threads() const noexcept;
+
+        /*!
+         * Sets the poller used by the reactors.  An unavailable poller falls
+         * back to the next best one when the server starts.  Must be set
+         * before the server starts.
+         */
+        void set_poller(poller_type value);
+
+        /*!
+         * @returns the requested poller
+         */
+        poller_type poller() const noexcept;
+
+        /*!
+         * Sets a timeout for new connections, zero to disable.  A
+         * connection that passes it is closed.  Must be set before the
+         * server starts.
+         */
+        void set_timeout(timeout_type type, duration value);
+
+        /*!
+         * @returns a timeout for new connections
+         */
+        duration timeout(timeout_type type) const noexcept;
+
+        /*!
+         * Sets a timeout for one connection, or negative to use the
+         * server's.  Applied on the reactor polling the connection.
+         */
+        void set_timeout(const socket_type &sock, timeout_type type,
+                         duration value);
+
+        /*!
+         * Runs a callback on a reactor thread once the delay has passed
+         * @returns the id to cancel the timer with
+         */
+        timer_id schedule(duration delay, const std::function<void()> &callback);
+
+        /*!
+         * @returns true if the timer was cancelled before running
+         */
+        bool cancel(timer_id id);
+
         void stop();
 
+        /*!
+         * closes the listener and wakes the reactors, so they stop polling
+         * even without a poll frequency
+         */
+        void close();
+
         protected:
+        /*!
+         * adds a socket to the least busy reactor
+         */
         void add_socket(const socket_type &sock);
 
         void remove_socket(const SOCKET &sock);
@@ -71,15 +138,25 @@ namespace coda {
 
         virtual socket_type on_accept(SOCKET socket, sockaddr_storage addr);
 
-        timer *wait_time(timer *last_time) const;
+        /*!
+         * @returns milliseconds to wait to keep to the poll frequency, or -1
+         */
+        int wait_time(timer *last_time) const;
 
         private:
         static const unsigned DEFAULT_FREQUENCY = 4;
 
-        std::recursive_mutex sockets_mutex_;
-        socket_type find_socket(SOCKET value) const;
+        /*!
+         * accepts a connection into a reactor's connection table
+         */
+        socket_type accept_socket(server_impl &reactor, SOCKET socket,
+                                  const sockaddr_storage &addr);
+
+        void poll(server_impl &reactor, timer *last_time);
 
-        std::shared_ptr<server_impl> impl_;
+        void run_reactor(const std::shared_ptr<server_impl> &reactor);
+
+        std::vector<std::shared_ptr<server_impl>> impls_;
 
         void run();
 
@@ -89,12 +166,17 @@ namespace coda {
 
         void notify_poll();
 
-        std::map<SOCKET, socket_type> sockets_;
-
         unsigned frequency_;
 
-        friend class impl;
-        friend class detail::cleanup_listener;
+        unsigned threads_;
+
+        poller_type poller_;
+
+        duration timeouts_[connection_activity::TIMEOUT_TYPES];
+
+        friend class epoll_impl;
+        friend class poll_impl;
+        friend class uring_impl;
       };
     } // namespace sync
   }   // namespace net
@@ -0,0 +1,273 @@
+#include "server_impl.h"
+#include "../exception.h"
+#include <algorithm>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace coda {
+  namespace net {
+    namespace sync {
+      namespace detail {
+        /*!
+         * removes a connection from its reactor when closed, and records
+         * its activity for the timeouts
+         */
+        class connection_listener : public buffered_socket_listener {
+          private:
+          server_impl &reactor_;
+          std::shared_ptr<connection_activity> activity_;
+
+          public:
+          connection_listener(server_impl &reactor,
+                              const std::shared_ptr<connection_activity> &activity)
+              : reactor_(reactor), activity_(activity) {}
+
+          void on_close(const buffered_socket_listener::socket_type &socket) {
+            if (!socket || !socket->is_valid()) {
+              return;
+            }
+
+            reactor_.cancel(activity_->timer.exchange(0));
+
+            reactor_.remove_socket(socket->raw_socket());
+          }
+
+          void on_connect(const buffered_socket_listener::socket_type &sock) {}
+
+          void on_will_read(const buffered_socket_listener::socket_type &sock) {
+          }
+
+          void on_did_read(const buffered_socket_listener::socket_type &sock) {
+            activity_->last_read = connection_activity::now();
+          }
+
+          void on_will_write(const buffered_socket_listener::socket_type &sock) {
+            int64_t none = -1;
+
+            activity_->write_started.compare_exchange_strong(
+                none, connection_activity::now());
+          }
+
+          void on_did_write(const buffered_socket_listener::socket_type &sock) {
+            activity_->write_started = -1;
+            activity_->last_write = connection_activity::now();
+          }
+        };
+      } // namespace detail
+
+      connection_activity::connection_activity()
+          : last_read(now()), last_write(last_read.load()), write_started(-1),
+            timer(0) {
+        for (auto &value : timeouts) {
+          value = -1;
+        }
+      }
+
+      int64_t connection_activity::now() {
+        return std::chrono::duration_cast<timer_wheel::duration>(
+                   timer_wheel::clock::now().time_since_epoch())
+            .count();
+      }
+
+      server_impl::server_impl() {
+        for (auto &value : timeouts_) {
+          value = 0;
+        }
+
+        if (::pipe(wakeup_) != 0) {
+          throw socket_exception("unable to create reactor wakeup");
+        }
+
+        fcntl(wakeup_[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakeup_[1], F_SETFL, O_NONBLOCK);
+      }
+
+      server_impl::~server_impl() {
+        ::close(wakeup_[0]);
+        ::close(wakeup_[1]);
+      }
+
+      void server_impl::bind() { sockets_.bind(); }
+
+      void server_impl::unbind() { sockets_.unbind(); }
+
+      void server_impl::add_socket(const socket_type &sock) {
+        insert_socket(sock, 0);
+      }
+
+      connection_table::handle_type
+      server_impl::insert_socket(const socket_type &sock, uint32_t events) {
+        if (!sock || !sock->is_valid()) {
+          return 0;
+        }
+
+        auto activity = std::make_shared<connection_activity>();
+
+        sock->add_listener(
+            std::make_shared<detail::connection_listener>(*this, activity));
+
+        auto handle = sockets_.insert(sock, events, activity);
+
+        bool timeouts = std::any_of(
+            std::begin(timeouts_), std::end(timeouts_),
+            [](const std::atomic<int64_t> &value) { return value > 0; });
+
+        if (timeouts) {
+          std::weak_ptr<buffered_socket> weak = sock;
+
+          activity->timer = schedule(duration(0), [this, weak, activity]() {
+            check_deadlines(weak, activity);
+          });
+        }
+
+        return handle;
+      }
+
+      void server_impl::remove_socket(const SOCKET &sock) {
+        sockets_.remove(sock);
+      }
+
+      void server_impl::clear_sockets() { sockets_.clear(); }
+
+      server_impl::socket_type server_impl::find_socket(SOCKET value) {
+        return sockets_.find(value);
+      }
+
+      size_t server_impl::connections() const { return sockets_.size(); }
+
+      timer_wheel::timer_id
+      server_impl::schedule(duration delay,
+                            const timer_wheel::callback_type &callback) {
+        auto id = timers_.schedule(delay, callback);
+
+        // the poll may be waiting on a later timer, or none at all
+        wakeup();
+
+        return id;
+      }
+
+      bool server_impl::cancel(timer_wheel::timer_id id) {
+        return id != 0 && timers_.cancel(id);
+      }
+
+      void server_impl::wakeup() {
+        if (sockets_.is_owner()) {
+          return;
+        }
+
+        char c = 0;
+
+        // a full pipe already has a wakeup waiting
+        if (::write(wakeup_[1], &c, 1) < 0) {
+          return;
+        }
+      }
+
+      void server_impl::drain_wakeup() {
+        char drain[64];
+
+        while (::read(wakeup_[0], drain, sizeof(drain)) > 0) {
+        }
+      }
+
+      void server_impl::expire_timers() { timers_.expire(); }
+
+      int server_impl::next_timeout() const { return timers_.next_timeout(); }
+
+      void server_impl::set_timeout(timeout_type type, duration value) {
+        timeouts_[type] = std::max<int64_t>(value.count(), 0);
+      }
+
+      void server_impl::set_timeout(const socket_type &sock, timeout_type type,
+                                    duration value) {
+        if (!sock || !sock->is_valid()) {
+          return;
+        }
+
+        auto entry = sockets_.find_entry(sock->raw_socket());
+
+        if (entry == NULL || entry->socket != sock || !entry->activity) {
+          return;
+        }
+
+        auto activity = entry->activity;
+
+        activity->timeouts[type] = value.count();
+
+        // check straight away, the new deadline may be sooner
+        cancel(activity->timer.exchange(0));
+
+        std::weak_ptr<buffered_socket> weak = sock;
+
+        activity->timer = schedule(duration(0), [this, weak, activity]() {
+          check_deadlines(weak, activity);
+        });
+      }
+
+      void server_impl::check_deadlines(
+          const std::weak_ptr<buffered_socket> &weak,
+          const std::shared_ptr<connection_activity> &activity) {
+        auto sock = weak.lock();
+
+        if (!sock || !sock->is_valid()) {
+          return;
+        }
+
+        auto now = connection_activity::now();
+
+        int64_t next = LLONG_MAX;
+
+        for (size_t i = 0; i < connection_activity::TIMEOUT_TYPES; i++) {
+          int64_t timeout = activity->timeouts[i];
+
+          if (timeout < 0) {
+            timeout = timeouts_[i];
+          }
+
+          if (timeout <= 0) {
+            continue;
+          }
+
+          int64_t since = now;
+
+          switch (i) {
+          case TIMEOUT_READ:
+            since = activity->last_read;
+            break;
+          case TIMEOUT_WRITE:
+            since = activity->write_started;
+            // nothing to flush, so look again a timeout from now
+            if (since < 0 || !sock->has_output()) {
+              since = now;
+            }
+            break;
+          case TIMEOUT_IDLE:
+            since = std::max(activity->last_read.load(),
+                             activity->last_write.load());
+            break;
+          }
+
+          if (now - since >= timeout) {
+            activity->timer = 0;
+            sock->close();
+            return;
+          }
+
+          next = std::min(next, since + timeout - now);
+        }
+
+        if (next == LLONG_MAX) {
+          activity->timer = 0;
+          return;
+        }
+
+        std::weak_ptr<buffered_socket> reschedule = sock;
+
+        activity->timer = schedule(duration(next), [this, reschedule, activity]() {
+          check_deadlines(reschedule, activity);
+        });
+      }
+    } // namespace sync
+  }   // namespace net
+} // namespace coda
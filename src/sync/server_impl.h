@@ -1,19 +1,192 @@
 #ifndef CODA_NET_SERVER_SYNC_IMPL_H
 #define CODA_NET_SERVER_SYNC_IMPL_H
 
-#include <sys/time.h>
+#include "../buffered_socket.h"
+#include "connection_table.h"
+#include "timer_wheel.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 namespace coda {
   namespace net {
     namespace sync {
       class server;
 
+      /*!
+       * the kinds of poller a reactor can use
+       */
+      typedef enum {
+        /* epoll where available, poll otherwise */
+        POLLER_DEFAULT,
+        /* io_uring, only when asked for, falling back to epoll where the
+           kernel can't do everything it needs */
+        POLLER_URING,
+        POLLER_EPOLL,
+        POLLER_POLL
+      } poller_type;
+
+      /*!
+       * the timeouts a connection can have
+       */
+      typedef enum {
+        /* no data recieved */
+        TIMEOUT_READ,
+        /* pending output has not drained */
+        TIMEOUT_WRITE,
+        /* neither read nor written */
+        TIMEOUT_IDLE
+      } timeout_type;
+
+      /*!
+       * Activity on a connection, in milliseconds on the steady clock,
+       * recorded by its reactor to enforce timeouts
+       */
+      struct connection_activity {
+        static const size_t TIMEOUT_TYPES = 3;
+
+        std::atomic<int64_t> last_read;
+        std::atomic<int64_t> last_write;
+        // when the pending output started flushing, or -1
+        std::atomic<int64_t> write_started;
+        // overrides the reactor's timeouts when not negative
+        std::atomic<int64_t> timeouts[TIMEOUT_TYPES];
+        // the timer checking the deadlines
+        std::atomic<timer_wheel::timer_id> timer;
+
+        connection_activity();
+
+        static int64_t now();
+      };
+
+      /*!
+       * A reactor that polls the server and its own table of connections.
+       * A server runs one per thread.
+       */
       class server_impl {
         public:
-        typedef struct timeval timer;
+        typedef std::shared_ptr<buffered_socket> socket_type;
+        typedef timer_wheel::duration duration;
+
+        server_impl();
+
+        virtual ~server_impl();
+
+        /*!
+         * Makes the calling thread the one polling this reactor, so it can
+         * use the connection table without locking
+         */
+        void bind();
+
+        /*!
+         * Called when the polling thread stops
+         */
+        void unbind();
 
         virtual bool listen(server &server) = 0;
-        virtual void poll(server &server, timer *stall_time) = 0;
+        /*!
+         * waits for and handles events on the listener and connections
+         * @param timeout milliseconds to wait, or -1 to wait for an event
+         */
+        virtual void poll(server &server, int timeout) = 0;
+
+        /*!
+         * adds a connection to this reactor
+         */
+        virtual void add_socket(const socket_type &sock);
+
+        /*!
+         * removes a connection from this reactor
+         */
+        virtual void remove_socket(const SOCKET &sock);
+
+        /*!
+         * removes all connections from this reactor
+         */
+        void clear_sockets();
+
+        /*!
+         * Only for the polling thread
+         * @returns the connection for a raw socket or nullptr
+         */
+        socket_type find_socket(SOCKET value);
+
+        /*!
+         * @returns the number of connections on this reactor
+         */
+        size_t connections() const;
+
+        /*!
+         * Runs a callback on the polling thread once the delay has passed
+         * @returns the id to cancel the timer with
+         */
+        timer_wheel::timer_id schedule(duration delay,
+                                       const timer_wheel::callback_type &callback);
+
+        /*!
+         * @returns true if the timer was cancelled before running
+         */
+        bool cancel(timer_wheel::timer_id id);
+
+        /*!
+         * Interrupts a poll blocked on the polling thread, so it sees new
+         * timers and connections.  Does nothing on the polling thread.
+         */
+        void wakeup();
+
+        /*!
+         * runs the timers that are due
+         */
+        void expire_timers();
+
+        /*!
+         * @returns milliseconds until the next timer, or -1 for none
+         */
+        int next_timeout() const;
+
+        /*!
+         * Sets a timeout for connections added after, zero to disable
+         */
+        void set_timeout(timeout_type type, duration value);
+
+        /*!
+         * Sets a timeout for one connection, or negative to use the
+         * reactor's.  Only for the polling thread.
+         */
+        void set_timeout(const socket_type &sock, timeout_type type,
+                         duration value);
+
+        protected:
+        /*!
+         * adds a connection to the table with events for the reactor
+         * @returns the handle for the connection
+         */
+        connection_table::handle_type insert_socket(const socket_type &sock,
+                                                    uint32_t events);
+
+        /*!
+         * empties the wakeup pipe once a poll has returned for it
+         */
+        void drain_wakeup();
+
+        // guards state a reactor keeps beside the connection table
+        mutable std::recursive_mutex sockets_mutex_;
+        connection_table sockets_;
+
+        // each poller watches the read end, other threads write to wake it
+        SOCKET wakeup_[2];
+
+        private:
+        /*!
+         * closes the connection if a deadline has passed, or checks again
+         * at the next one
+         */
+        void check_deadlines(const std::weak_ptr<buffered_socket> &sock,
+                             const std::shared_ptr<connection_activity> &activity);
+
+        timer_wheel timers_;
+
+        std::atomic<int64_t> timeouts_[connection_activity::TIMEOUT_TYPES];
       };
     } // namespace sync
   }   // namespace net
@@ -0,0 +1,198 @@
+#include "timer_wheel.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+
+namespace coda {
+  namespace net {
+    namespace sync {
+      namespace detail {
+        std::atomic<timer_wheel::timer_id> next_timer_id(1);
+      }
+
+      timer_wheel::timer_wheel() : start_(clock::now()), current_(0) {}
+
+      timer_wheel::timer_id timer_wheel::schedule(duration delay,
+                                                  const callback_type &callback) {
+        if (!callback) {
+          return 0;
+        }
+
+        auto id = detail::next_timer_id++;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        uint64_t deadline = now() + std::max<int64_t>(delay.count(), 0);
+
+        timers_[id] = {deadline, callback};
+
+        place(id, deadline);
+
+        return id;
+      }
+
+      bool timer_wheel::cancel(timer_id id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        return timers_.erase(id) > 0;
+      }
+
+      size_t timer_wheel::expire() {
+        std::vector<callback_type> ready;
+
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+
+          uint64_t target = now();
+
+          // nothing to cascade, so skip straight to now
+          if (timers_.empty()) {
+            current_ = std::max(current_, target + 1);
+            return 0;
+          }
+
+          while (current_ <= target) {
+            // cascade from the highest level whose turn starts on this tick
+            unsigned level = 0;
+
+            while (level + 1 < LEVELS &&
+                   (current_ & ((1ULL << (SLOT_BITS * (level + 1))) - 1)) ==
+                       0) {
+              level++;
+            }
+
+            for (; level > 0; level--) {
+              cascade(level);
+            }
+
+            std::vector<timer_id> due;
+
+            due.swap(slots_[0][current_ & (SLOTS - 1)]);
+
+            for (auto id : due) {
+              auto it = timers_.find(id);
+
+              // cancelled
+              if (it == timers_.end()) {
+                continue;
+              }
+
+              if (it->second.deadline > current_) {
+                place(id, it->second.deadline);
+                continue;
+              }
+
+              ready.push_back(std::move(it->second.callback));
+
+              timers_.erase(it);
+            }
+
+            current_++;
+          }
+        }
+
+        for (const auto &callback : ready) {
+          callback();
+        }
+
+        return ready.size();
+      }
+
+      int timer_wheel::next_timeout() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (timers_.empty()) {
+          return -1;
+        }
+
+        uint64_t next = UINT64_MAX;
+
+        for (uint64_t i = 0; i < SLOTS; i++) {
+          if (!slots_[0][(current_ + i) & (SLOTS - 1)].empty()) {
+            next = current_ + i;
+            break;
+          }
+        }
+
+        // higher levels only need a wake up to cascade
+        for (unsigned level = 1; level < LEVELS; level++) {
+          auto shift = SLOT_BITS * level;
+          auto block = current_ >> shift;
+
+          for (uint64_t i = 0; i <= SLOTS; i++) {
+            uint64_t start = (block + i) << shift;
+
+            if (start < current_) {
+              continue;
+            }
+
+            if (!slots_[level][(block + i) & (SLOTS - 1)].empty()) {
+              next = std::min(next, start);
+              break;
+            }
+          }
+        }
+
+        if (next == UINT64_MAX) {
+          return -1;
+        }
+
+        auto n = now();
+
+        if (next <= n) {
+          return 0;
+        }
+
+        return static_cast<int>(std::min<uint64_t>(next - n, INT_MAX));
+      }
+
+      size_t timer_wheel::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        return timers_.size();
+      }
+
+      uint64_t timer_wheel::now() const {
+        return std::chrono::duration_cast<duration>(clock::now() - start_)
+            .count();
+      }
+
+      void timer_wheel::place(timer_id id, uint64_t deadline) {
+        uint64_t when = std::max(deadline, current_);
+
+        uint64_t delta = when - current_;
+
+        unsigned level = 0;
+
+        while (level + 1 < LEVELS &&
+               delta >= (1ULL << (SLOT_BITS * (level + 1)))) {
+          level++;
+        }
+
+        // beyond the top level, wait in its furthest slot and cascade again
+        uint64_t limit = (1ULL << (SLOT_BITS * LEVELS)) - 1;
+
+        if (delta > limit) {
+          when = current_ + limit;
+        }
+
+        slots_[level][(when >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(
+            id);
+      }
+
+      void timer_wheel::cascade(unsigned level) {
+        std::vector<timer_id> ids;
+
+        ids.swap(slots_[level][(current_ >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+
+        for (auto id : ids) {
+          auto it = timers_.find(id);
+
+          if (it != timers_.end()) {
+            place(id, it->second.deadline);
+          }
+        }
+      }
+    } // namespace sync
+  }   // namespace net
+} // namespace coda
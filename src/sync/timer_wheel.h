@@ -0,0 +1,98 @@
+#ifndef CODA_NET_SERVER_SYNC_TIMER_WHEEL_H
+#define CODA_NET_SERVER_SYNC_TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    namespace sync {
+      /*!
+       * A hierarchical timer wheel with millisecond ticks on a monotonic
+       * clock.  Each level has 64 slots, a slot on one level spanning a
+       * whole turn of the level below, and timers cascade down a level as
+       * their slot comes round.  Scheduling and cancelling are constant
+       * time, and cancelled timers are dropped when their slot is reached.
+       */
+      class timer_wheel {
+        public:
+        typedef std::chrono::steady_clock clock;
+        typedef std::chrono::milliseconds duration;
+        typedef std::function<void()> callback_type;
+
+        /*!
+         * identifies a timer, unique across wheels, zero is never used
+         */
+        typedef uint64_t timer_id;
+
+        static const unsigned LEVELS = 4;
+        static const unsigned SLOT_BITS = 6;
+        static const unsigned SLOTS = 1 << SLOT_BITS;
+
+        timer_wheel();
+        timer_wheel(const timer_wheel &other) = delete;
+        timer_wheel(timer_wheel &&other) = delete;
+        timer_wheel &operator=(const timer_wheel &other) = delete;
+        timer_wheel &operator=(timer_wheel &&other) = delete;
+
+        /*!
+         * Runs a callback once the delay has passed
+         * @returns the id of the timer
+         */
+        timer_id schedule(duration delay, const callback_type &callback);
+
+        /*!
+         * @returns true if the timer was waiting and will no longer run
+         */
+        bool cancel(timer_id id);
+
+        /*!
+         * Runs the timers that are due, outside of any lock so they can
+         * schedule more
+         * @returns the number of timers run
+         */
+        size_t expire();
+
+        /*!
+         * @returns milliseconds until the wheel next needs to advance, or -1
+         * when there are no timers
+         */
+        int next_timeout() const;
+
+        /*!
+         * @returns the number of waiting timers
+         */
+        size_t size() const;
+
+        private:
+        struct node {
+          uint64_t deadline;
+          callback_type callback;
+        };
+
+        uint64_t now() const;
+
+        void place(timer_id id, uint64_t deadline);
+
+        void cascade(unsigned level);
+
+        clock::time_point start_;
+
+        // the next tick to process
+        uint64_t current_;
+
+        std::vector<timer_id> slots_[LEVELS][SLOTS];
+
+        std::unordered_map<timer_id, node> timers_;
+
+        mutable std::mutex mutex_;
+      };
+    } // namespace sync
+  }   // namespace net
+} // namespace coda
+
+#endif
@@ -0,0 +1,677 @@
+#ifdef URING_FOUND
+
+#include "uring_impl.h"
+#include "../exception.h"
+#include "server.h"
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace coda {
+  namespace net {
+    namespace sync {
+      namespace detail {
+        /*!
+         * Tries a multishot recv into a provided buffer.  The buffer ring
+         * came with 5.19, but multishot recv needs 6.0, and before that
+         * every recv would fail with -EINVAL.
+         */
+        bool can_recv_multishot(struct io_uring &ring) {
+          int ret = 0;
+
+          auto buffers = io_uring_setup_buf_ring(&ring, 1, 0, 0, &ret);
+
+          if (buffers == NULL) {
+            return false;
+          }
+
+          char data[64];
+
+          io_uring_buf_ring_add(buffers, data, sizeof(data), 0,
+                                io_uring_buf_ring_mask(1), 0);
+
+          io_uring_buf_ring_advance(buffers, 1);
+
+          bool value = false;
+
+          SOCKET fds[2];
+
+          if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0) {
+            auto sqe = io_uring_get_sqe(&ring);
+
+            io_uring_prep_recv_multishot(sqe, fds[0], NULL, 0, 0);
+
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->buf_group = 0;
+
+            char c = 0;
+
+            struct io_uring_cqe *cqe = NULL;
+
+            struct __kernel_timespec ts = {1, 0};
+
+            if (::send(fds[1], &c, 1, 0) == 1 && io_uring_submit(&ring) >= 0 &&
+                io_uring_wait_cqe_timeout(&ring, &cqe, &ts) == 0) {
+              value = cqe->res > 0 && (cqe->flags & IORING_CQE_F_MORE);
+
+              io_uring_cq_advance(&ring, 1);
+            }
+
+            closesocket(fds[0]);
+            closesocket(fds[1]);
+          }
+
+          io_uring_free_buf_ring(&ring, buffers, 1, 0);
+
+          return value;
+        }
+      } // namespace detail
+
+      uring_impl::uring_impl()
+          : buffers_(NULL), initialized_(false), multishot_accept_(true),
+            listener_(socket::INVALID), next_id_(1) {
+        memset(&ring_, 0, sizeof(ring_));
+      }
+
+      uring_impl::~uring_impl() {
+        if (!initialized_) {
+          return;
+        }
+
+        if (buffers_ != NULL) {
+          io_uring_free_buf_ring(&ring_, buffers_, BUFFER_COUNT, BUFFER_GROUP);
+          buffers_ = NULL;
+        }
+
+        io_uring_queue_exit(&ring_);
+        initialized_ = false;
+      }
+
+      bool uring_impl::is_supported() {
+        static const bool supported = []() {
+          struct io_uring ring;
+
+          if (io_uring_queue_init(8, &ring, 0) < 0) {
+            return false;
+          }
+
+          auto probe = io_uring_get_probe_ring(&ring);
+
+          bool value = probe != NULL &&
+                       io_uring_opcode_supported(probe, IORING_OP_ACCEPT) &&
+                       io_uring_opcode_supported(probe, IORING_OP_RECV) &&
+                       io_uring_opcode_supported(probe, IORING_OP_SENDMSG) &&
+                       io_uring_opcode_supported(probe, IORING_OP_POLL_ADD) &&
+                       io_uring_opcode_supported(probe, IORING_OP_ASYNC_CANCEL);
+
+          if (probe != NULL) {
+            io_uring_free_probe(probe);
+          }
+
+          // the opcodes can be there without the multishot flavours
+          value = value && detail::can_recv_multishot(ring);
+
+          io_uring_queue_exit(&ring);
+
+          return value;
+        }();
+
+        return supported;
+      }
+
+      bool uring_impl::listen(server &server) {
+        if (!server.is_valid()) {
+          return false;
+        }
+
+        listener_ = server.raw_socket();
+
+        if (io_uring_queue_init(RING_ENTRIES, &ring_, 0) < 0) {
+          return false;
+        }
+
+        initialized_ = true;
+
+        int ret = 0;
+
+        buffers_ =
+            io_uring_setup_buf_ring(&ring_, BUFFER_COUNT, BUFFER_GROUP, 0, &ret);
+
+        if (buffers_ == NULL) {
+          return false;
+        }
+
+        buffer_data_.resize(BUFFER_COUNT * BUFFER_SIZE);
+
+        for (unsigned i = 0; i < BUFFER_COUNT; i++) {
+          io_uring_buf_ring_add(buffers_, &buffer_data_[i * BUFFER_SIZE],
+                                BUFFER_SIZE, i,
+                                io_uring_buf_ring_mask(BUFFER_COUNT), i);
+        }
+
+        io_uring_buf_ring_advance(buffers_, BUFFER_COUNT);
+
+        arm_accept();
+
+        arm_wakeup();
+
+        return io_uring_submit(&ring_) >= 0;
+      }
+
+      void uring_impl::poll(server &server, int timeout) {
+        if (!server.is_valid() || !initialized_) {
+          return;
+        }
+
+        {
+          std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
+          io_uring_submit(&ring_);
+        }
+
+        struct io_uring_cqe *cqe = NULL;
+
+        int rc;
+
+        if (timeout >= 0) {
+          struct __kernel_timespec ts;
+
+          ts.tv_sec = timeout / 1000;
+          ts.tv_nsec = (timeout % 1000) * 1000000L;
+
+          rc = io_uring_wait_cqe_timeout(&ring_, &cqe, &ts);
+        } else {
+          rc = io_uring_wait_cqe(&ring_, &cqe);
+        }
+
+        if (rc < 0) {
+          if (rc == -ETIME || rc == -EINTR) {
+            return;
+          }
+          throw socket_exception(strerror(-rc));
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
+
+        unsigned head;
+        unsigned count = 0;
+
+        io_uring_for_each_cqe(&ring_, head, cqe) {
+          complete(server, cqe);
+          count++;
+        }
+
+        io_uring_cq_advance(&ring_, count);
+
+        io_uring_submit(&ring_);
+      }
+
+      void uring_impl::add_socket(const socket_type &sock) {
+        if (!sock || !sock->is_valid()) {
+          return;
+        }
+
+        sock->set_non_blocking(true);
+
+        server_impl::add_socket(sock);
+
+        auto conn = std::make_shared<connection>();
+
+        conn->socket = sock;
+        conn->pending = 0;
+        conn->sends = 0;
+        conn->sent = 0;
+        conn->failed = false;
+        conn->waiting = false;
+
+        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
+
+        // ids tell apart completions for a reused file descriptor
+        conn->id = next_id_;
+        next_id_ = (next_id_ + 1) & 0xFFFFFF;
+        if (next_id_ == 0) {
+          next_id_ = 1;
+        }
+
+        connections_[sock->raw_socket()] = conn;
+
+        // secure sockets must read through the secure layer, unless it takes
+        // the records the ring recieves
+        if (sock->is_secure() && !sock->feed_records(NULL, 0)) {
+          arm_poll(conn);
+        } else {
+          arm_recv(conn);
+        }
+
+        flush(conn);
+
+        // submissions from another thread wait for the poll to return
+        wakeup();
+      }
+
+      void uring_impl::remove_socket(const SOCKET &sock) {
+        std::lock_guard<std::recursive_mutex> lock(sockets_mutex_);
+
+        auto it = connections_.find(sock);
+
+        if (it != connections_.end()) {
+          auto conn = it->second;
+
+          connections_.erase(it);
+
+          // keep the socket and its output alive until the kernel lets go
+          if (conn->pending > 0) {
+            cancel(conn);
+            closing_[conn->id] = conn;
+            io_uring_submit(&ring_);
+          }
+        }
+
+        server_impl::remove_socket(sock);
+      }
+
+      struct io_uring_sqe *uring_impl::next_sqe() {
+        auto sqe = io_uring_get_sqe(&ring_);
+
+        if (sqe == NULL) {
+          io_uring_submit(&ring_);
+          sqe = io_uring_get_sqe(&ring_);
+        }
+
+        if (sqe == NULL) {
+          throw socket_exception("io_uring submission queue is full");
+        }
+
+        return sqe;
+      }
+
+      uint64_t uring_impl::encode(op type, const connection_type &conn) const {
+        uint64_t id = conn ? conn->id : 0;
+        uint32_t fd = conn ? conn->socket->raw_socket() : listener_;
+
+        return (static_cast<uint64_t>(type) << 56) | (id << 32) | fd;
+      }
+
+      void uring_impl::arm_accept() {
+        auto sqe = next_sqe();
+
+        if (multishot_accept_) {
+          io_uring_prep_multishot_accept(sqe, listener_, NULL, NULL, 0);
+        } else {
+          io_uring_prep_accept(sqe, listener_, NULL, NULL, 0);
+        }
+
+        io_uring_sqe_set_data64(sqe, encode(OP_ACCEPT, nullptr));
+      }
+
+      void uring_impl::arm_wakeup() {
+        auto sqe = next_sqe();
+
+        io_uring_prep_poll_multishot(sqe, wakeup_[0], POLLIN);
+
+        io_uring_sqe_set_data64(sqe, encode(OP_WAKEUP, nullptr));
+      }
+
+      void uring_impl::arm_recv(const connection_type &conn) {
+        auto sqe = next_sqe();
+
+        io_uring_prep_recv_multishot(sqe, conn->socket->raw_socket(), NULL, 0,
+                                     0);
+
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+
+        io_uring_sqe_set_data64(sqe, encode(OP_RECV, conn));
+
+        conn->pending++;
+      }
+
+      void uring_impl::arm_poll(const connection_type &conn) {
+        auto sqe = next_sqe();
+
+        io_uring_prep_poll_multishot(sqe, conn->socket->raw_socket(),
+                                     POLLIN | POLLRDHUP);
+
+        io_uring_sqe_set_data64(sqe, encode(OP_POLL, conn));
+
+        conn->pending++;
+      }
+
+      void uring_impl::arm_writable(const connection_type &conn) {
+        if (conn->waiting) {
+          return;
+        }
+
+        auto sqe = next_sqe();
+
+        io_uring_prep_poll_add(sqe, conn->socket->raw_socket(), POLLOUT);
+
+        io_uring_sqe_set_data64(sqe, encode(OP_WRITABLE, conn));
+
+        conn->waiting = true;
+        conn->pending++;
+      }
+
+      void uring_impl::arm_send(const connection_type &conn) {
+        if (conn->sends > 0) {
+          return;
+        }
+
+        conn->iov.resize(MAX_IOV * MAX_LINKED);
+
+        int count =
+            conn->socket->prepare_write(conn->iov.data(), conn->iov.size());
+
+        if (count <= 0) {
+          return;
+        }
+
+        int links = (count + MAX_IOV - 1) / MAX_IOV;
+
+        conn->msgs.resize(links);
+
+        conn->sent = 0;
+        conn->failed = false;
+
+        // linked so the chunks go out in order.  A short send only breaks
+        // a link with MSG_WAITALL, which every kernel with multishot
+        // recieves honours: a send completes once all of it went out or it
+        // failed, the rest are then cancelled, and the bytes counted are
+        // always from the front of the queue
+        for (int i = 0; i < links; i++) {
+          auto &msg = conn->msgs[i];
+
+          memset(&msg, 0, sizeof(msg));
+
+          msg.msg_iov = &conn->iov[i * MAX_IOV];
+          msg.msg_iovlen = std::min(MAX_IOV, count - i * MAX_IOV);
+
+          auto sqe = next_sqe();
+
+          io_uring_prep_sendmsg(sqe, conn->socket->raw_socket(), &msg,
+                                MSG_NOSIGNAL | MSG_WAITALL);
+
+          if (i < links - 1) {
+            sqe->flags |= IOSQE_IO_LINK;
+          }
+
+          io_uring_sqe_set_data64(sqe, encode(OP_SEND, conn));
+
+          conn->sends++;
+          conn->pending++;
+        }
+      }
+
+      void uring_impl::cancel(const connection_type &conn) {
+        static const op ops[] = {OP_RECV, OP_POLL, OP_WRITABLE, OP_SEND};
+
+        for (auto type : ops) {
+          auto sqe = next_sqe();
+
+          io_uring_prep_cancel64(sqe, encode(type, conn),
+                                 IORING_ASYNC_CANCEL_ALL);
+
+          io_uring_sqe_set_data64(sqe, encode(OP_CANCEL, conn));
+        }
+      }
+
+      void uring_impl::recycle(unsigned short bid) {
+        io_uring_buf_ring_add(buffers_, &buffer_data_[bid * BUFFER_SIZE],
+                              BUFFER_SIZE, bid,
+                              io_uring_buf_ring_mask(BUFFER_COUNT), 0);
+
+        io_uring_buf_ring_advance(buffers_, 1);
+      }
+
+      void uring_impl::flush(const connection_type &conn) {
+        auto &sock = conn->socket;
+
+        if (!sock->is_valid()) {
+          return;
+        }
+
+        // the peer has finished sending, and has been sent everything
+        if (sock->is_finished()) {
+          sock->close();
+          return;
+        }
+
+        // the kernel encrypts for a secure socket with kTLS, so its output
+        // can be sent by the ring too
+        if (!sock->is_secure() || sock->is_kernel_send()) {
+          if (sock->has_output()) {
+            arm_send(conn);
+          }
+          return;
+        }
+
+        if (!sock->write_from_buffer() || sock->is_finished()) {
+          sock->close();
+          return;
+        }
+
+        // the secure layer may be waiting to write for a read or handshake
+        if (sock->needs_writable()) {
+          arm_writable(conn);
+        }
+      }
+
+      void uring_impl::complete(server &server, struct io_uring_cqe *cqe) {
+        auto data = io_uring_cqe_get_data64(cqe);
+
+        auto type = static_cast<op>(data >> 56);
+        uint32_t id = (data >> 32) & 0xFFFFFF;
+        SOCKET fd = static_cast<SOCKET>(data & 0xFFFFFFFF);
+
+        if (type == OP_ACCEPT) {
+          on_accept(server, cqe);
+          return;
+        }
+
+        if (type == OP_CANCEL) {
+          return;
+        }
+
+        if (type == OP_WAKEUP) {
+          drain_wakeup();
+
+          // the kernel can end a multishot poll at any time
+          if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            arm_wakeup();
+          }
+          return;
+        }
+
+        bool finished = !(cqe->flags & IORING_CQE_F_MORE);
+
+        auto it = connections_.find(fd);
+
+        if (it != connections_.end() && it->second->id == id) {
+          auto conn = it->second;
+
+          if (finished) {
+            conn->pending--;
+          }
+
+          switch (type) {
+          case OP_RECV:
+            on_recv(conn, cqe);
+            break;
+          case OP_POLL:
+          case OP_WRITABLE:
+            on_poll(conn, cqe);
+            break;
+          case OP_SEND:
+            on_send(conn, cqe);
+            break;
+          default:
+            break;
+          }
+          return;
+        }
+
+        // a late completion for a closed connection
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+          recycle(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+
+        auto closed = closing_.find(id);
+
+        if (closed == closing_.end()) {
+          return;
+        }
+
+        if (finished && --closed->second->pending == 0) {
+          closing_.erase(closed);
+        }
+      }
+
+      void uring_impl::on_accept(server &server, struct io_uring_cqe *cqe) {
+        if (cqe->res >= 0) {
+          sockaddr_storage addr;
+          socklen_t length = sizeof(addr);
+
+          memset(&addr, 0, sizeof(addr));
+
+          getpeername(cqe->res, (struct sockaddr *)&addr, &length);
+
+          server.accept_socket(*this, cqe->res, addr);
+        } else if (cqe->res == -EINVAL && multishot_accept_) {
+          // older kernels only support a single accept per submission
+          multishot_accept_ = false;
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE) && server.is_valid()) {
+          arm_accept();
+        }
+      }
+
+      void uring_impl::on_recv(const connection_type &conn,
+                               struct io_uring_cqe *cqe) {
+        auto &sock = conn->socket;
+
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+          unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+          bool success = true;
+
+          if (cqe->res > 0) {
+            success = sock->read_to_buffer(&buffer_data_[bid * BUFFER_SIZE],
+                                           cqe->res);
+          }
+
+          recycle(bid);
+
+          if (!success) {
+            sock->close();
+            return;
+          }
+        }
+
+        // the recieve failed
+        if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -EINTR &&
+            cqe->res != -EAGAIN) {
+          sock->close();
+          return;
+        }
+
+        // the peer has finished sending, what is queued for it is still sent
+        if (cqe->res == 0) {
+          sock->stop_reading();
+
+          flush(conn);
+          return;
+        }
+
+        flush(conn);
+
+        // a multishot recieve stops when it runs out of buffers
+        if (!(cqe->flags & IORING_CQE_F_MORE) && sock->is_valid()) {
+          arm_recv(conn);
+        }
+      }
+
+      void uring_impl::on_poll(const connection_type &conn,
+                               struct io_uring_cqe *cqe) {
+        auto &sock = conn->socket;
+
+        int events = cqe->res;
+
+        if (events < 0) {
+          if (events != -ECANCELED) {
+            sock->close();
+          }
+          return;
+        }
+
+        if (events & (POLLERR | POLLHUP)) {
+          sock->close();
+          return;
+        }
+
+        if (((events & POLLIN) || sock->wants_write()) &&
+            !sock->is_read_closed()) {
+          if (!sock->read_to_buffer()) {
+            sock->close();
+            return;
+          }
+        }
+
+        if (events & POLLOUT) {
+          conn->waiting = false;
+        }
+
+        // the peer has finished sending, the flush closes once it has been
+        // sent everything
+        if (events & POLLRDHUP) {
+          sock->stop_reading();
+        }
+
+        flush(conn);
+
+        if (!sock->is_valid() || sock->is_read_closed()) {
+          return;
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE) &&
+            io_uring_cqe_get_data64(cqe) == encode(OP_POLL, conn)) {
+          arm_poll(conn);
+        }
+      }
+
+      void uring_impl::on_send(const connection_type &conn,
+                               struct io_uring_cqe *cqe) {
+        conn->sends--;
+
+        if (cqe->res > 0) {
+          conn->sent += cqe->res;
+        } else if (cqe->res < 0 && cqe->res != -ECANCELED &&
+                   cqe->res != -EAGAIN && cqe->res != -EINTR) {
+          conn->failed = true;
+        }
+
+        // wait for the rest of the chain
+        if (conn->sends > 0) {
+          return;
+        }
+
+        auto sent = conn->sent;
+
+        conn->sent = 0;
+
+        conn->socket->commit_write(sent);
+
+        if (conn->failed) {
+          conn->socket->close();
+          return;
+        }
+
+        // send whatever is left or was queued meanwhile
+        flush(conn);
+      }
+    } // namespace sync
+  }   // namespace net
+} // namespace coda
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef CODA_NET_SERVER_SYNC_URING_IMPL_H
+#define CODA_NET_SERVER_SYNC_URING_IMPL_H
+
+#ifdef URING_FOUND
+
+#include "../socket.h"
+#include "server_impl.h"
+#include <cstdint>
+#include <liburing.h>
+#include <unordered_map>
+#include <vector>
+
+namespace coda {
+  namespace net {
+    namespace sync {
+      /*!
+       * A completion based reactor using io_uring.  Connections are accepted
+       * with a multishot accept, plain sockets recieve with a multishot recv
+       * into a ring of provided buffers, and output is sent as a chain of
+       * linked sendmsg submissions.  Secure sockets wait on readiness instead
+       * and do their i/o through the secure layer, unless the kernel encrypts
+       * for them, when their output is sent like any other.  A secure layer
+       * that can be fed is handed the records the ring recieves.  Servers
+       * only use it when asked for with POLLER_URING.
+       */
+      class uring_impl : public server_impl {
+        public:
+        uring_impl();
+        uring_impl(const uring_impl &other) = delete;
+        uring_impl(uring_impl &&other) = delete;
+        virtual ~uring_impl();
+        uring_impl &operator=(const uring_impl &other) = delete;
+        uring_impl &operator=(uring_impl &&other) = delete;
+
+        /*!
+         * @returns true if the kernel supports the operations used
+         */
+        static bool is_supported();
+
+        bool listen(server &server);
+        void poll(server &server, int timeout);
+
+        /*!
+         * starts recieving on the socket
+         */
+        void add_socket(const socket_type &sock);
+
+        /*!
+         * cancels any operations on the socket
+         */
+        void remove_socket(const SOCKET &sock);
+
+        private:
+        static constexpr unsigned RING_ENTRIES = 1024;
+        static constexpr unsigned BUFFER_COUNT = 256;
+        static constexpr unsigned BUFFER_SIZE = 16 * 1024;
+        static constexpr unsigned BUFFER_GROUP = 0;
+        static constexpr int MAX_IOV = 64;
+        static constexpr int MAX_LINKED = 4;
+
+        typedef enum {
+          OP_ACCEPT = 1,
+          OP_RECV,
+          OP_POLL,
+          OP_WRITABLE,
+          OP_SEND,
+          OP_CANCEL,
+          OP_WAKEUP
+        } op;
+
+        struct connection {
+          socket_type socket;
+          uint32_t id;
+          // operations the kernel still owns
+          unsigned pending;
+          // linked sends in flight and the bytes they have sent so far
+          unsigned sends;
+          size_t sent;
+          bool failed;
+          // waiting for a secure socket to become writable
+          bool waiting;
+          std::vector<struct iovec> iov;
+          std::vector<struct msghdr> msgs;
+        };
+
+        typedef std::shared_ptr<connection> connection_type;
+
+        struct io_uring_sqe *next_sqe();
+
+        uint64_t encode(op type, const connection_type &conn) const;
+
+        void arm_accept();
+        void arm_wakeup();
+        void arm_recv(const connection_type &conn);
+        void arm_poll(const connection_type &conn);
+        void arm_writable(const connection_type &conn);
+        void arm_send(const connection_type &conn);
+        void cancel(const connection_type &conn);
+        void recycle(unsigned short bid);
+
+        void on_accept(server &server, struct io_uring_cqe *cqe);
+        void on_recv(const connection_type &conn, struct io_uring_cqe *cqe);
+        void on_poll(const connection_type &conn, struct io_uring_cqe *cqe);
+        void on_send(const connection_type &conn, struct io_uring_cqe *cqe);
+
+        void flush(const connection_type &conn);
+
+        void complete(server &server, struct io_uring_cqe *cqe);
+
+        struct io_uring ring_;
+        struct io_uring_buf_ring *buffers_;
+        std::vector<unsigned char> buffer_data_;
+        bool initialized_;
+        bool multishot_accept_;
+        SOCKET listener_;
+        uint32_t next_id_;
+
+        std::unordered_map<SOCKET, connection_type> connections_;
+
+        // closed connections waiting for the kernel to release them
+        std::unordered_map<uint32_t, connection_type> closing_;
+      };
+    } // namespace sync
+  }   // namespace net
+} // namespace coda
+
+#endif
+
+#endif
@@ -80,6 +80,17 @@ namespace coda {
       }
     }
 
+    size_t telnet_socket::on_recv(data_type *data, size_t size) {
+      // commands only ever shrink the input, so filter a copy and write back
+      data_buffer s(data, data + size);
+
+      on_recv(s);
+
+      std::copy(s.begin(), s.end(), data);
+
+      return s.size();
+    }
+
     void telnet_socket::send_telopt(socket::data_type action,
                                     socket::data_type option_value) {
       assert(action == telnet::WILL || action == telnet::DO ||
@@ -18,6 +18,8 @@ namespace coda {
 
       void on_recv(data_buffer &s);
 
+      size_t on_recv(data_type *data, size_t size);
+
       void send_telopt(socket::data_type type, socket::data_type option);
 
       private:
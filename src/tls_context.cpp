@@ -0,0 +1,377 @@
+#include "tls_context.h"
+#include "exception.h"
+
+#ifdef OPENSSL_FOUND
+
+#include <arpa/inet.h>
+#include <openssl/err.h>
+
+namespace coda {
+  namespace net {
+    namespace detail {
+      void free_peer(void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *) {
+        delete static_cast<std::string *>(ptr);
+      }
+
+      /*!
+       * @returns the index a connection's host and port are kept at
+       */
+      int peer_index() {
+        static int index =
+            SSL_get_ex_new_index(0, NULL, NULL, NULL, free_peer);
+
+        return index;
+      }
+
+      /*!
+       * SNI names hosts, never addresses
+       */
+      bool is_address(const std::string &host) {
+        unsigned char buf[sizeof(struct in6_addr)];
+
+        return inet_pton(AF_INET, host.c_str(), buf) == 1 ||
+               inet_pton(AF_INET6, host.c_str(), buf) == 1;
+      }
+
+      std::string last_error() {
+        return ERR_error_string(ERR_get_error(), NULL);
+      }
+
+      // the same for every server, as sessions never leave the process
+      const unsigned char SESSION_ID_CONTEXT[] = "coda_net";
+    } // namespace detail
+
+    std::string tls_context::options::key() const {
+      return std::to_string(verify_peer) + '\n' + ca_file + '\n' + ciphers +
+             '\n' + std::to_string(server) + '\n' + certificate_file + '\n' +
+             private_key_file + '\n' + std::to_string(kernel_tls);
+    }
+
+    tls_context::tls_context(const options &opts)
+        : handle_(NULL), server_(opts.server),
+          max_sessions_(DEFAULT_MAX_SESSIONS), full_(0), resumed_(0),
+          kernel_send_(0), kernel_recv_(0) {
+      static std::once_flag initialized;
+
+      std::call_once(initialized, []() { OPENSSL_init_ssl(0, NULL); });
+
+      handle_ = SSL_CTX_new(server_ ? TLS_server_method() : TLS_client_method());
+
+      if (handle_ == NULL) {
+        throw socket_exception(detail::last_error());
+      }
+
+      SSL_CTX_set_app_data(handle_, this);
+
+      if (server_) {
+        if (opts.certificate_file.empty() || opts.private_key_file.empty()) {
+          SSL_CTX_free(handle_);
+          throw socket_exception("a server needs a certificate and a key");
+        }
+
+        if (!SSL_CTX_use_certificate_chain_file(
+                handle_, opts.certificate_file.c_str()) ||
+            !SSL_CTX_use_PrivateKey_file(handle_, opts.private_key_file.c_str(),
+                                         SSL_FILETYPE_PEM) ||
+            !SSL_CTX_check_private_key(handle_)) {
+          SSL_CTX_free(handle_);
+          throw socket_exception(detail::last_error());
+        }
+
+        // tickets are on by default, the cache covers clients without them
+        SSL_CTX_set_session_cache_mode(handle_, SSL_SESS_CACHE_SERVER);
+
+        SSL_CTX_set_session_id_context(handle_, detail::SESSION_ID_CONTEXT,
+                                       sizeof(detail::SESSION_ID_CONTEXT) - 1);
+
+        SSL_CTX_set_tlsext_servername_callback(handle_, on_server_name);
+
+        SSL_CTX_set_tlsext_servername_arg(handle_, this);
+      } else {
+        // sessions are kept here, by peer, rather than in OpenSSL's cache
+        SSL_CTX_set_session_cache_mode(handle_,
+                                       SSL_SESS_CACHE_CLIENT |
+                                           SSL_SESS_CACHE_NO_INTERNAL_STORE);
+
+        SSL_CTX_sess_set_new_cb(handle_, on_new_session);
+      }
+
+#ifdef SSL_OP_ENABLE_KTLS
+      // OpenSSL quietly stays in user space if the kernel can't take over
+      if (opts.kernel_tls) {
+        SSL_CTX_set_options(handle_, SSL_OP_ENABLE_KTLS);
+      }
+#endif
+
+      if (!opts.ciphers.empty() &&
+          !SSL_CTX_set_cipher_list(handle_, opts.ciphers.c_str())) {
+        SSL_CTX_free(handle_);
+        throw socket_exception(detail::last_error());
+      }
+
+      if (opts.verify_peer) {
+        int loaded = opts.ca_file.empty()
+                         ? SSL_CTX_set_default_verify_paths(handle_)
+                         : SSL_CTX_load_verify_locations(
+                               handle_, opts.ca_file.c_str(), NULL);
+
+        if (!loaded) {
+          SSL_CTX_free(handle_);
+          throw socket_exception(detail::last_error());
+        }
+
+        // a server asks clients for a certificate, and insists on one
+        SSL_CTX_set_verify(handle_,
+                           server_ ? SSL_VERIFY_PEER |
+                                         SSL_VERIFY_FAIL_IF_NO_PEER_CERT
+                                   : SSL_VERIFY_PEER,
+                           NULL);
+      }
+    }
+
+    tls_context::~tls_context() {
+      clear_sessions();
+
+      SSL_CTX_free(handle_);
+    }
+
+    std::shared_ptr<tls_context> tls_context::get(const options &opts) {
+      static std::mutex mutex;
+
+      // whoever holds a context keeps it, and its sessions, alive
+      static std::unordered_map<std::string, std::weak_ptr<tls_context>>
+          contexts;
+
+      auto key = opts.key();
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      auto it = contexts.find(key);
+
+      if (it != contexts.end()) {
+        auto value = it->second.lock();
+
+        if (value) {
+          return value;
+        }
+      }
+
+      auto value = std::make_shared<tls_context>(opts);
+
+      // forget the contexts that have been freed
+      for (auto entry = contexts.begin(); entry != contexts.end();) {
+        if (entry->second.expired()) {
+          entry = contexts.erase(entry);
+        } else {
+          ++entry;
+        }
+      }
+
+      contexts[key] = value;
+
+      return value;
+    }
+
+    SSL_CTX *tls_context::handle() const noexcept { return handle_; }
+
+    bool tls_context::is_server() const noexcept { return server_; }
+
+    void tls_context::prepare(SSL *ssl, const std::string &host,
+                              const std::string &peer) {
+      if (!host.empty() && !detail::is_address(host)) {
+        SSL_set_tlsext_host_name(ssl, host.c_str());
+
+        if (SSL_CTX_get_verify_mode(handle_) & SSL_VERIFY_PEER) {
+          SSL_set1_host(ssl, host.c_str());
+        }
+      }
+
+      if (peer.empty()) {
+        return;
+      }
+
+      SSL_set_ex_data(ssl, detail::peer_index(), new std::string(peer));
+
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      auto it = sessions_.find(peer);
+
+      if (it == sessions_.end()) {
+        return;
+      }
+
+      SSL_set_session(ssl, it->second.session);
+
+#ifdef TLS1_3_VERSION
+      // TLS 1.3 tickets are meant to be used once, and the connection will
+      // be handed new ones
+      if (SSL_SESSION_get_protocol_version(it->second.session) >=
+          TLS1_3_VERSION) {
+        SSL_SESSION_free(it->second.session);
+
+        recent_.erase(it->second.position);
+
+        sessions_.erase(it);
+      }
+#endif
+    }
+
+    void tls_context::on_handshake(SSL *ssl) {
+      if (SSL_session_reused(ssl)) {
+        resumed_++;
+      } else {
+        full_++;
+      }
+
+      if (BIO_get_ktls_send(SSL_get_wbio(ssl))) {
+        kernel_send_++;
+      }
+
+      if (BIO_get_ktls_recv(SSL_get_rbio(ssl))) {
+        kernel_recv_++;
+      }
+    }
+
+    void tls_context::add_server_name(
+        const std::string &name, const std::shared_ptr<tls_context> &context) {
+      if (!context || context.get() == this) {
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      names_[name] = context;
+    }
+
+    int tls_context::on_server_name(SSL *ssl, int *, void *arg) {
+      auto self = static_cast<tls_context *>(arg);
+
+      auto name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+
+      if (self == NULL || name == NULL) {
+        return SSL_TLSEXT_ERR_NOACK;
+      }
+
+      std::string host(name);
+
+      std::lock_guard<std::mutex> lock(self->mutex_);
+
+      auto it = self->names_.find(host);
+
+      if (it == self->names_.end()) {
+        auto dot = host.find('.');
+
+        // a wildcard covers a single label
+        if (dot != std::string::npos) {
+          it = self->names_.find('*' + host.substr(dot));
+        }
+      }
+
+      if (it == self->names_.end()) {
+        // the default certificate it is
+        return SSL_TLSEXT_ERR_NOACK;
+      }
+
+      // sessions and tickets stay with the context that accepted
+      SSL_set_SSL_CTX(ssl, it->second->handle());
+
+      return SSL_TLSEXT_ERR_OK;
+    }
+
+    int tls_context::on_new_session(SSL *ssl, SSL_SESSION *session) {
+      auto self = static_cast<tls_context *>(
+          SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+
+      auto peer =
+          static_cast<std::string *>(SSL_get_ex_data(ssl, detail::peer_index()));
+
+      if (self == NULL || peer == NULL) {
+        return 0;
+      }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+      if (!SSL_SESSION_is_resumable(session)) {
+        return 0;
+      }
+#endif
+
+      std::lock_guard<std::mutex> lock(self->mutex_);
+
+      if (self->max_sessions_ == 0) {
+        return 0;
+      }
+
+      auto it = self->sessions_.find(*peer);
+
+      if (it != self->sessions_.end()) {
+        SSL_SESSION_free(it->second.session);
+
+        it->second.session = session;
+
+        self->recent_.splice(self->recent_.begin(), self->recent_,
+                             it->second.position);
+      } else {
+        self->recent_.push_front(*peer);
+
+        self->sessions_.emplace(*peer,
+                                session_entry{session, self->recent_.begin()});
+      }
+
+      self->evict();
+
+      // the reference OpenSSL handed over is ours now
+      return 1;
+    }
+
+    void tls_context::evict() {
+      while (sessions_.size() > max_sessions_) {
+        auto it = sessions_.find(recent_.back());
+
+        SSL_SESSION_free(it->second.session);
+
+        sessions_.erase(it);
+
+        recent_.pop_back();
+      }
+    }
+
+    void tls_context::set_max_sessions(size_t value) {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      max_sessions_ = value;
+
+      if (server_) {
+        SSL_CTX_sess_set_cache_size(handle_, value);
+      }
+
+      evict();
+    }
+
+    void tls_context::clear_sessions() {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      for (auto &it : sessions_) {
+        SSL_SESSION_free(it.second.session);
+      }
+
+      sessions_.clear();
+
+      recent_.clear();
+
+      if (server_) {
+        SSL_CTX_flush_sessions(handle_, 0);
+      }
+    }
+
+    tls_context::statistics tls_context::stats() const {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      return {full_, resumed_,
+              server_ ? static_cast<size_t>(SSL_CTX_sess_number(handle_))
+                      : sessions_.size(),
+              kernel_send_, kernel_recv_};
+    }
+  } // namespace net
+} // namespace coda
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef CODA_NET_TLS_CONTEXT_H
+#define CODA_NET_TLS_CONTEXT_H
+
+#ifdef OPENSSL_FOUND
+
+#include <openssl/ssl.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace coda {
+  namespace net {
+    /*!
+     * An SSL_CTX shared by every connection with the same configuration,
+     * so ciphers and certificates are loaded once.  The registry only hands
+     * out a context while something holds it, and a context nothing holds is
+     * freed with its sessions.  Kept alive, the sessions servers hand out,
+     * tickets included, let the next connection to the same host and port
+     * resume instead of doing a full handshake.
+     *
+     * A server context presents a certificate instead, and may hand a
+     * connection to another context by the name the client asked for.  Its
+     * sessions stay in OpenSSL's cache, and its tickets are sealed with keys
+     * every connection accepted on the context shares.
+     */
+    class tls_context {
+      public:
+      /*!
+       * what makes one context different from another
+       */
+      struct options {
+        // verify the peer's certificate against the trusted CAs
+        bool verify_peer = false;
+
+        // trusted CAs, the system's if empty
+        std::string ca_file;
+
+        // the cipher list, OpenSSL's default if empty
+        std::string ciphers;
+
+        // accept connections instead of making them
+        bool server = false;
+
+        // the PEM certificate chain a server presents
+        std::string certificate_file;
+
+        // the PEM private key of the certificate
+        std::string private_key_file;
+
+        // hand record encryption to the kernel after the handshake where
+        // the kernel and the cipher allow it, user space otherwise
+        bool kernel_tls = true;
+
+        /*!
+         * @returns a string unique to the configuration
+         */
+        std::string key() const;
+      };
+
+      /*!
+       * counts of how handshakes went
+       */
+      struct statistics {
+        // handshakes that had to start from scratch
+        size_t full;
+        // handshakes that resumed a cached session
+        size_t resumed;
+        // sessions waiting to be resumed
+        size_t cached;
+        // handshakes after which the kernel encrypted sends, the rest
+        // stayed in user space
+        size_t kernel_send;
+        // handshakes after which the kernel decrypted reads
+        size_t kernel_recv;
+      };
+
+      static const size_t DEFAULT_MAX_SESSIONS = 256;
+
+      tls_context(const options &opts);
+
+      tls_context(const tls_context &other) = delete;
+      tls_context(tls_context &&other) = delete;
+
+      virtual ~tls_context();
+
+      tls_context &operator=(const tls_context &other) = delete;
+      tls_context &operator=(tls_context &&other) = delete;
+
+      /*!
+       * @returns the context shared by every connection with these options,
+       * created if none is in use
+       */
+      static std::shared_ptr<tls_context> get(const options &opts);
+
+      SSL_CTX *handle() const noexcept;
+
+      bool is_server() const noexcept;
+
+      /*!
+       * Prepares a new connection to a server, naming the host for SNI and
+       * offering a session cached for it
+       * @param peer the host and port the session cache is keyed by
+       */
+      void prepare(SSL *ssl, const std::string &host, const std::string &peer);
+
+      /*!
+       * counts a finished handshake
+       */
+      void on_handshake(SSL *ssl);
+
+      /*!
+       * Serves clients asking for a name with another context, so one
+       * listener can present several certificates
+       * @param name a host name, or a wildcard like *.example.com
+       */
+      void add_server_name(const std::string &name,
+                           const std::shared_ptr<tls_context> &context);
+
+      /*!
+       * sets the most sessions cached, the least recently used go first on
+       * a client
+       */
+      void set_max_sessions(size_t value);
+
+      /*!
+       * forgets every cached session
+       */
+      void clear_sessions();
+
+      statistics stats() const;
+
+      private:
+      struct session_entry {
+        SSL_SESSION *session;
+        std::list<std::string>::iterator position;
+      };
+
+      /*!
+       * called by OpenSSL whenever a server hands out a session
+       * @returns 1 if the session was kept
+       */
+      static int on_new_session(SSL *ssl, SSL_SESSION *session);
+
+      /*!
+       * called by OpenSSL with the name a client asked a server for
+       */
+      static int on_server_name(SSL *ssl, int *alert, void *arg);
+
+      /*!
+       * drops the least recently used sessions over the limit, with the
+       * lock held
+       */
+      void evict();
+
+      SSL_CTX *handle_;
+
+      bool server_;
+
+      // by host and port
+      std::unordered_map<std::string, session_entry> sessions_;
+
+      // most recently used first
+      std::list<std::string> recent_;
+
+      size_t max_sessions_;
+
+      // contexts serving other names, by name
+      std::unordered_map<std::string, std::shared_ptr<tls_context>> names_;
+
+      std::atomic<size_t> full_;
+
+      std::atomic<size_t> resumed_;
+
+      std::atomic<size_t> kernel_send_;
+
+      std::atomic<size_t> kernel_recv_;
+
+      mutable std::mutex mutex_;
+    };
+  } // namespace net
+} // namespace coda
+
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+#include <cstring>
+#include <string>
+
+#include <bandit/bandit.h>
+#include "buffer.h"
+#include "output_queue.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+go_bandit([]() {
+
+    describe("a buffer", []() {
+
+        it("can append and consume", []() {
+            buffer buf;
+
+            string value = "Hello, World!";
+
+            buf.append(value.data(), value.size());
+
+            Assert::That(buf.size(), Equals(value.size()));
+
+            buf.consume(7);
+
+            Assert::That(string(buf.begin(), buf.end()), Equals("World!"));
+
+            buf.consume(100);
+
+            Assert::That(buf.empty(), IsTrue());
+        });
+
+        it("can write into prepared space", []() {
+            buffer buf;
+
+            auto space = buf.prepare(5);
+
+            Assert::That(space.size() >= 5, IsTrue());
+
+            memcpy(space.data(), "abcde", 5);
+
+            buf.commit(5);
+
+            auto view = buf.readable();
+
+            Assert::That(string(view.begin(), view.end()), Equals("abcde"));
+        });
+
+        it("keeps unread data when reclaiming space", []() {
+            buffer buf(8);
+
+            buf.append("12345678", 8);
+
+            buf.consume(6);
+
+            buf.append("9012345678", 10);
+
+            Assert::That(string(buf.begin(), buf.end()), Equals("789012345678"));
+        });
+    });
+
+    describe("an output queue", []() {
+
+        it("can gather copied and shared segments", []() {
+            output_queue queue;
+
+            queue.append("ab", 2);
+
+            queue.append(std::make_shared<const string>(1000, 'x'));
+
+            queue.append("cd", 2);
+
+            struct iovec iov[8];
+
+            Assert::That(queue.gather(iov, 8), Equals(3));
+
+            Assert::That(queue.size(), Equals(1004u));
+
+            queue.consume(500);
+
+            Assert::That(queue.gather(iov, 8), Equals(2));
+
+            Assert::That(iov[0].iov_len, Equals(502u));
+        });
+
+        it("can flatten segments", []() {
+            output_queue queue;
+
+            queue.append(string(output_queue::COPY_THRESHOLD, 'x'));
+
+            queue.append("yz", 2);
+
+            auto view = queue.flatten();
+
+            Assert::That(view.size(), Equals(output_queue::COPY_THRESHOLD + 2));
+
+            Assert::That(string(view.end() - 2, view.end()), Equals("yz"));
+        });
+    });
+
+});
@@ -0,0 +1,104 @@
+#include <memory>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include <bandit/bandit.h>
+#include "buffered_socket.h"
+#include "sync/connection_table.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+namespace test
+{
+    // a connected socket at the descriptor given, or a new one if invalid
+    shared_ptr<buffered_socket> socket_at(SOCKET fd = socket::INVALID)
+    {
+        SOCKET fds[2];
+
+        sockaddr_storage addr = {};
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            return nullptr;
+        }
+
+        ::close(fds[1]);
+
+        if (fd != socket::INVALID && fds[0] != fd) {
+            dup2(fds[0], fd);
+            ::close(fds[0]);
+            fds[0] = fd;
+        }
+
+        return make_shared<buffered_socket>(fds[0], addr);
+    }
+}
+
+go_bandit([]() {
+
+    describe("a connection table", []() {
+
+        it("ignores a stale handle once the descriptor is reused", []() {
+            sync::connection_table table;
+
+            auto first = test::socket_at();
+
+            SOCKET fd = first->raw_socket();
+
+            auto stale = table.insert(first);
+
+            first->close();
+
+            auto second = test::socket_at(fd);
+
+            Assert::That(second->raw_socket(), Equals(fd));
+
+            auto current = table.insert(second);
+
+            Assert::That(current != stale, IsTrue());
+
+            table.remove_handle(stale);
+
+            Assert::That(table.find(fd) == second, IsTrue());
+
+            Assert::That(table.size(), Equals(1U));
+
+            table.remove_handle(current);
+
+            Assert::That(table.find(fd) == nullptr, IsTrue());
+
+            Assert::That(table.size(), Equals(0U));
+        });
+
+        it("applies changes from other threads for its owner", []() {
+            sync::connection_table table;
+
+            table.bind();
+
+            auto sock = test::socket_at();
+
+            sync::connection_table::handle_type handle = 0;
+
+            thread([&table, &sock, &handle]() { handle = table.insert(sock); }).join();
+
+            Assert::That(table.find(sock->raw_socket()) == sock, IsTrue());
+
+            thread([&table, handle]() { table.remove_handle(handle); }).join();
+
+            table.bind();
+
+            Assert::That(table.find(sock->raw_socket()) == nullptr, IsTrue());
+
+            Assert::That(table.size(), Equals(0U));
+
+            table.unbind();
+        });
+    });
+
+});
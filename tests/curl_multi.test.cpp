@@ -0,0 +1,182 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bandit/bandit.h>
+#include "http/client.h"
+#include "http/curl_multi.h"
+#include "http/server.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+#ifdef CURL_FOUND
+
+namespace test
+{
+    // the outcome of a request made with a completion
+    struct outcome
+    {
+        atomic<bool> done;
+        string content;
+        string error;
+
+        outcome() : done(false)
+        {
+        }
+    };
+
+    // polls until a request has completed, for up to two seconds
+    bool wait_until_done(const shared_ptr<outcome> &value)
+    {
+        for (int i = 0; i < 200 && !value->done; i++) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+
+        return value->done;
+    }
+
+    http::curl::multi::completion_type record(const shared_ptr<outcome> &value)
+    {
+        return [value](const http::response &response, const char *error) {
+            value->content = response.content();
+
+            if (error != nullptr) {
+                value->error = error;
+            }
+
+            value->done = true;
+        };
+    }
+}
+
+go_bandit([]() {
+
+    http::server testServer;
+
+    testServer.routes()
+        .get("/hello/:name",
+             [](const http::server_request &request, http::server_response &response) {
+                 response.write("Hello, ").write(request.param("name")).write("!");
+             })
+        .get("/slow", [](const http::server_request &, http::server_response &response) {
+            this_thread::sleep_for(chrono::milliseconds(500));
+            response.write("slow");
+        });
+
+    describe("a curl multi", [&]() {
+        before_each([&testServer]() {
+            try {
+                testServer.start_in_background(9898);
+            } catch (const exception &e) {
+                std::cerr << typeid(e).name() << ": " << e.what() << std::endl;
+            }
+        });
+
+        after_each([&testServer]() { testServer.stop(); });
+
+        it("runs many requests at once", []() {
+            http::curl::multi multi;
+
+            vector<future<http::response>> responses;
+
+            for (int i = 0; i < 20; i++) {
+                http::client client("localhost:9898/hello/" + to_string(i));
+
+                responses.push_back(multi.add(client, http::GET, ""));
+            }
+
+            for (int i = 0; i < 20; i++) {
+                Assert::That(responses[i].get().content(), Equals("Hello, " + to_string(i) + "!"));
+            }
+
+            Assert::That(multi.pending(), Equals(0U));
+        });
+
+        it("fails the future of a request that can't connect", []() {
+            http::curl::multi multi;
+
+            http::client client("localhost:9899/hello/nobody");
+
+            auto response = multi.add(client, http::GET, "");
+
+            bool failed = false;
+
+            try {
+                response.get();
+            } catch (const socket_exception &) {
+                failed = true;
+            }
+
+            Assert::That(failed, IsTrue());
+
+            Assert::That(multi.pending(), Equals(0U));
+        });
+
+        it("keeps going after a completion throws", []() {
+            http::curl::multi multi;
+
+            http::client client("localhost:9898/hello/again");
+
+            multi.add(client, http::GET, "",
+                      [](const http::response &, const char *) { throw runtime_error("completion"); });
+
+            auto value = make_shared<test::outcome>();
+
+            multi.add(client, http::GET, "", test::record(value));
+
+            Assert::That(test::wait_until_done(value), IsTrue());
+
+            Assert::That(value->content, Equals("Hello, again!"));
+        });
+
+        it("fails requests still running when destroyed", []() {
+            auto value = make_shared<test::outcome>();
+
+            {
+                http::curl::multi multi;
+
+                http::client client("localhost:9898/slow");
+
+                multi.add(client, http::GET, "", test::record(value));
+
+                // long enough for the request to be sent
+                this_thread::sleep_for(chrono::milliseconds(100));
+            }
+
+            Assert::That(value->done.load(), IsTrue());
+
+            Assert::That(value->error.empty(), IsFalse());
+
+            Assert::That(value->content.empty(), IsTrue());
+        });
+
+        it("runs asynchronous client requests on the shared instance", []() {
+            auto value = make_shared<test::outcome>();
+
+            http::client client("localhost:9898/slow");
+
+            http::curl::request_async(client, http::GET, "", test::record(value));
+
+            Assert::That(http::curl::multi::shared().pending(), Equals(1U));
+
+            Assert::That(test::wait_until_done(value), IsTrue());
+
+            Assert::That(value->content, Equals("slow"));
+
+            Assert::That(http::curl::multi::shared().pending(), Equals(0U));
+        });
+    });
+
+});
+
+#endif
@@ -0,0 +1,185 @@
+#if defined(COROUTINES_FOUND) && defined(EPOLL_FOUND)
+
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+
+#include <bandit/bandit.h>
+#include "async/event_loop.h"
+#include "async/operations.h"
+#include "async/task.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+namespace test
+{
+    // a connected pair of sockets
+    struct socket_pair {
+        socket_pair()
+        {
+            SOCKET fds[2];
+
+            sockaddr_storage addr = {};
+
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0) {
+                first = coda::net::socket(fds[0], addr);
+                second = coda::net::socket(fds[1], addr);
+            }
+        }
+
+        coda::net::socket first;
+        coda::net::socket second;
+    };
+
+    async::task<int> answer()
+    {
+        co_return 42;
+    }
+
+    async::task<int> fail()
+    {
+        throw runtime_error("failed");
+        co_return 0;
+    }
+
+    async::task<void> awaits(int &value, bool &thrown)
+    {
+        value = co_await answer();
+
+        try {
+            co_await fail();
+        } catch (const runtime_error &) {
+            thrown = true;
+        }
+    }
+
+    async::task<void> read_line(async::event_loop &loop, coda::net::socket &sock, string &line)
+    {
+        buffer input;
+
+        auto size = co_await async::async_read_until(loop, sock, input, "\n");
+
+        line.assign(input.begin(), input.begin() + size);
+    }
+
+    async::task<void> write_all(async::event_loop &loop, coda::net::socket &sock, const string &data, bool &written)
+    {
+        written = co_await async::async_write_all(loop, sock, data.data(), data.size());
+    }
+
+    async::task<void> read_all(async::event_loop &loop, coda::net::socket &sock, size_t size, string &data)
+    {
+        buffer input;
+
+        while (input.size() < size) {
+            if (co_await async::async_read_some(loop, sock, input) <= 0) {
+                break;
+            }
+        }
+
+        data.assign(input.begin(), input.end());
+    }
+
+    async::task<void> wait_readable(async::event_loop &loop, SOCKET sock, int &result)
+    {
+        result = (co_await loop.readable(sock)) ? 1 : 0;
+    }
+}
+
+go_bandit([]() {
+
+    describe("a coroutine event loop", []() {
+
+        it("returns values and exceptions from tasks", []() {
+            async::event_loop loop;
+
+            int value = 0;
+            bool thrown = false;
+
+            loop.spawn(test::awaits(value, thrown));
+
+            loop.run();
+
+            Assert::That(value, Equals(42));
+
+            Assert::That(thrown, IsTrue());
+
+            Assert::That(loop.tasks(), Equals(0U));
+        });
+
+        it("resumes a reader once data arrives", []() {
+            async::event_loop loop;
+
+            test::socket_pair pair;
+
+            string line;
+
+            loop.spawn(test::read_line(loop, pair.first, line));
+
+            // suspended, as nothing has been sent
+            loop.poll(0);
+
+            Assert::That(line.empty(), IsTrue());
+
+            string hello = "hello\nworld";
+
+            pair.second.send(hello.data(), hello.size());
+
+            loop.run();
+
+            Assert::That(line, Equals("hello\n"));
+        });
+
+        it("writes through a full socket", []() {
+            async::event_loop loop;
+
+            test::socket_pair pair;
+
+            string data(4 * 1024 * 1024, 'x'), received;
+
+            bool written = false;
+
+            loop.spawn(test::write_all(loop, pair.first, data, written));
+
+            loop.spawn(test::read_all(loop, pair.second, data.size(), received));
+
+            loop.run();
+
+            Assert::That(written, IsTrue());
+
+            Assert::That(received == data, IsTrue());
+        });
+
+        it("resumes waiters with failure when a socket is closed", []() {
+            async::event_loop loop;
+
+            test::socket_pair pair;
+
+            int result = -1;
+
+            loop.spawn(test::wait_readable(loop, pair.first.raw_socket(), result));
+
+            loop.poll(0);
+
+            Assert::That(result, Equals(-1));
+
+            loop.close(pair.first);
+
+            // returns, as nothing is left waiting
+            loop.run();
+
+            Assert::That(result, Equals(0));
+
+            Assert::That(loop.tasks(), Equals(0U));
+        });
+    });
+
+});
+
+#endif
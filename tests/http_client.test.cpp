@@ -1,12 +1,15 @@
 #include <string>
 
 #include <bandit/bandit.h>
+#include <chrono>
 #include <thread>
 #include "socket_server.h"
 #include "uri.h"
 #include "async/client.h"
 #include "async/server.h"
 #include "http/client.h"
+#include "http/connection_pool.h"
+#include "http/server.h"
 #include "socket_server.h"
 
 using namespace bandit;
@@ -148,4 +151,145 @@ go_bandit([]() {
         });
     });
 
+    http::server poolServer;
+
+    poolServer.routes().get("/hello/:name",
+                            [](const http::server_request &request, http::server_response &response) {
+                                response.write("Hello, ").write(request.param("name")).write("!");
+                            });
+
+    describe("a connection pool", [&]() {
+        before_each([&poolServer]() {
+            try {
+                poolServer.start_in_background(9904);
+            } catch (const exception &e) {
+                std::cerr << typeid(e).name() << ": " << e.what() << std::endl;
+            }
+        });
+
+        after_each([&poolServer]() { poolServer.stop(); });
+
+        it("reuses a keep-alive connection for repeated requests", []() {
+            auto &pool = http::connection_pool::shared();
+
+            pool.clear();
+
+            auto before = pool.stats();
+
+            for (int i = 0; i < 3; i++) {
+                http::client client("localhost:9904/hello/pool");
+
+                auto response = http::socket::request(client, http::GET, "");
+
+                Assert::That(response.find("Hello, pool!"), !Equals(string::npos));
+            }
+
+            auto after = pool.stats();
+
+            Assert::That(after.misses - before.misses, Equals(1U));
+
+            Assert::That(after.hits - before.hits, Equals(2U));
+
+            Assert::That(after.idle, Equals(1U));
+        });
+
+        it("closes connections over the limit for one server", []() {
+            http::connection_pool pool;
+
+            pool.set_max_per_host(1);
+
+            bool reused = false;
+
+            auto first = pool.acquire("http", "localhost", 9904, reused);
+
+            auto second = pool.acquire("http", "localhost", 9904, reused);
+
+            pool.release("http", "localhost", 9904, first);
+
+            pool.release("http", "localhost", 9904, second);
+
+            auto stats = pool.stats();
+
+            Assert::That(stats.misses, Equals(2U));
+
+            Assert::That(stats.idle, Equals(1U));
+
+            Assert::That(stats.evictions, Equals(1U));
+
+            // the most recently released is kept
+            Assert::That(pool.take_idle("http", "localhost", 9904) == second, IsTrue());
+        });
+
+        it("closes the longest idle connections over the total limit", []() {
+            http::connection_pool pool;
+
+            pool.set_max_idle(1);
+
+            bool reused = false;
+
+            auto first = pool.acquire("http", "localhost", 9904, reused);
+
+            auto second = pool.acquire("http", "127.0.0.1", 9904, reused);
+
+            pool.release("http", "localhost", 9904, first);
+
+            pool.release("http", "127.0.0.1", 9904, second);
+
+            auto stats = pool.stats();
+
+            Assert::That(stats.idle, Equals(1U));
+
+            Assert::That(stats.evictions, Equals(1U));
+
+            Assert::That(pool.take_idle("http", "localhost", 9904) == nullptr, IsTrue());
+
+            Assert::That(pool.take_idle("http", "127.0.0.1", 9904) == second, IsTrue());
+        });
+
+        it("closes connections idle past the timeout", []() {
+            http::connection_pool pool;
+
+            pool.set_idle_timeout(chrono::milliseconds(50));
+
+            bool reused = false;
+
+            pool.release("http", "localhost", 9904, pool.acquire("http", "localhost", 9904, reused));
+
+            this_thread::sleep_for(chrono::milliseconds(100));
+
+            Assert::That(pool.take_idle("http", "localhost", 9904) == nullptr, IsTrue());
+
+            auto stats = pool.stats();
+
+            Assert::That(stats.hits, Equals(0U));
+
+            Assert::That(stats.misses, Equals(2U));
+
+            Assert::That(stats.evictions, Equals(1U));
+
+            Assert::That(stats.idle, Equals(0U));
+        });
+
+        it("does not reuse a connection the server closed", [&poolServer]() {
+            http::connection_pool pool;
+
+            bool reused = false;
+
+            pool.release("http", "localhost", 9904, pool.acquire("http", "localhost", 9904, reused));
+
+            poolServer.stop();
+
+            // long enough for the close to arrive
+            this_thread::sleep_for(chrono::milliseconds(50));
+
+            Assert::That(pool.take_idle("http", "localhost", 9904) == nullptr, IsTrue());
+
+            auto stats = pool.stats();
+
+            Assert::That(stats.hits, Equals(0U));
+
+            Assert::That(stats.evictions, Equals(1U));
+        });
+    });
+
 });
@@ -0,0 +1,377 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <bandit/bandit.h>
+#include "exception.h"
+#include "http/parser.h"
+#include "http/response_parser.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+namespace test
+{
+    // decodes a whole chunked body
+    string decode(const string &value, bool *complete = nullptr)
+    {
+        http::chunked_decoder decoder;
+
+        string body;
+
+        decoder.decode(value.data(), value.size(), [&body](const char *data, size_t size) { body.append(data, size); });
+
+        if (complete != nullptr) {
+            *complete = decoder.is_complete();
+        }
+
+        return body;
+    }
+
+    bool rejects_chunks(const string &value)
+    {
+        try {
+            decode(value);
+        } catch (const socket_exception &) {
+            return true;
+        }
+        return false;
+    }
+
+    // feeds a response a byte at a time
+    void feed(http::response_parser &parser, const string &value)
+    {
+        for (size_t i = 0; i < value.size() && !parser.is_complete(); i++) {
+            parser.parse(value.data() + i, 1);
+        }
+    }
+
+    bool rejects_response(const string &value)
+    {
+        http::response_parser parser;
+
+        try {
+            parser.parse(value.data(), value.size());
+        } catch (const socket_exception &) {
+            return true;
+        }
+        return false;
+    }
+}
+
+go_bandit([]() {
+
+    describe("an http parser", []() {
+
+        it("can parse a request", []() {
+            string value = "GET /index.html HTTP/1.1\r\nHost: example.com\r\nAccept:  */* \r\n\r\n";
+
+            http::request_head head;
+
+            int length = http::parse_request(value.data(), value.size(), head);
+
+            Assert::That(length, Equals((int) value.size()));
+
+            Assert::That(string(head.method), Equals("GET"));
+
+            Assert::That(string(head.target), Equals("/index.html"));
+
+            Assert::That(head.minor_version, Equals(1));
+
+            Assert::That(head.header_count, Equals(2U));
+
+            Assert::That(string(head.header("host")), Equals("example.com"));
+
+            Assert::That(string(head.header("Accept")), Equals("*/*"));
+
+            Assert::That(head.has_header("Content-Length"), IsFalse());
+        });
+
+        it("points into the buffer", []() {
+            string value = "GET / HTTP/1.0\r\nHost: example.com\r\n\r\n";
+
+            http::request_head head;
+
+            http::parse_request(value.data(), value.size(), head);
+
+            Assert::That(head.method.data(), Equals(value.data()));
+
+            Assert::That(head.headers[0].value.data(), Equals(value.data() + 22));
+        });
+
+        it("can parse partial input", []() {
+            string value = "POST /form HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+
+            http::request_head head;
+
+            size_t last = 0;
+
+            int length = http::PARSE_INCOMPLETE;
+
+            for (size_t size = 1; size <= value.size() && length == http::PARSE_INCOMPLETE; size++) {
+                length = http::parse_request(value.data(), size, head, last);
+
+                last = size;
+            }
+
+            Assert::That(length, Equals((int) value.size() - 5));
+
+            Assert::That(string(head.header("content-length")), Equals("5"));
+        });
+
+        it("can parse pipelined requests", []() {
+            string value = "GET /a HTTP/1.1\r\nHost: x\r\n\r\nGET /b HTTP/1.1\r\nHost: x\r\n\r\nGET /c HTTP/1.1\r\n";
+
+            http::request_head head;
+
+            size_t pos = 0;
+
+            string targets;
+
+            for (;;) {
+                int length = http::parse_request(value.data() + pos, value.size() - pos, head);
+
+                if (length < 0) {
+                    Assert::That(length, Equals(http::PARSE_INCOMPLETE));
+                    break;
+                }
+
+                targets += string(head.target);
+
+                pos += length;
+            }
+
+            Assert::That(targets, Equals("/a/b"));
+        });
+
+        it("accepts bare line feeds", []() {
+            string value = "GET / HTTP/1.1\nHost: x\n\n";
+
+            http::request_head head;
+
+            Assert::That(http::parse_request(value.data(), value.size(), head), Equals((int) value.size()));
+
+            Assert::That(string(head.header("Host")), Equals("x"));
+        });
+
+        it("rejects malformed requests", []() {
+            const char *values[] = {
+                "GET / HTTP/2.0\r\n\r\n",
+                "GET  HTTP/1.1\r\n\r\n",
+                "G(T / HTTP/1.1\r\n\r\n",
+                "GET / HTTP/1.1\r\nHost : x\r\n\r\n",
+                "GET / HTTP/1.1\r\nHost: x\r\n folded\r\n\r\n",
+                "GET / HTTP/1.1\r\nHost: x\ry\r\n\r\n",
+                "GET / HTTP/1.1\r\nNo colon\r\n\r\n",
+            };
+
+            for (auto value : values) {
+                http::request_head head;
+
+                Assert::That(http::parse_request(value, strlen(value), head), Equals(http::PARSE_ERROR));
+            }
+        });
+
+        it("rejects too many headers", []() {
+            string value = "GET / HTTP/1.1\r\n";
+
+            for (size_t i = 0; i <= http::MAX_HEADERS; i++) {
+                value += "X-" + to_string(i) + ": y\r\n";
+            }
+
+            value += "\r\n";
+
+            http::request_head head;
+
+            Assert::That(http::parse_request(value.data(), value.size(), head), Equals(http::PARSE_ERROR));
+        });
+
+        it("can parse a response", []() {
+            string value = "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n\r\nmissing";
+
+            http::response_head head;
+
+            int length = http::parse_response(value.data(), value.size(), head);
+
+            Assert::That(value.substr(length), Equals("missing"));
+
+            Assert::That(head.code, Equals(404));
+
+            Assert::That(head.minor_version, Equals(0));
+
+            Assert::That(string(head.reason), Equals("Not Found"));
+
+            Assert::That(string(head.header("content-type")), Equals("text/plain"));
+        });
+
+        it("rejects malformed responses", []() {
+            const char *values[] = {
+                "HTTP/1.1 20 OK\r\n\r\n",
+                "HTTP/1.1 2x0 OK\r\n\r\n",
+                "ICY 200 OK\r\n\r\n",
+            };
+
+            for (auto value : values) {
+                http::response_head head;
+
+                Assert::That(http::parse_response(value, strlen(value), head), Equals(http::PARSE_ERROR));
+            }
+        });
+
+        it("parses content lengths", []() {
+            size_t length = 0;
+
+            Assert::That(http::parse_content_length("18446744073709551615", length), IsTrue());
+
+            Assert::That(length, Equals(SIZE_MAX));
+
+            Assert::That(http::parse_content_length("18446744073709551617", length), IsFalse());
+
+            Assert::That(http::parse_content_length("99999999999999999999999", length), IsFalse());
+
+            Assert::That(http::parse_content_length("", length), IsFalse());
+
+            Assert::That(http::parse_content_length("+5", length), IsFalse());
+
+            Assert::That(http::parse_content_length("5, 5", length), IsFalse());
+        });
+
+        it("finds the chunked coding as the last token", []() {
+            Assert::That(http::is_chunked("chunked"), IsTrue());
+
+            Assert::That(http::is_chunked("gzip, Chunked "), IsTrue());
+
+            Assert::That(http::is_chunked("xchunked"), IsFalse());
+
+            Assert::That(http::is_chunked("chunked, gzip"), IsFalse());
+
+            Assert::That(http::is_chunked(""), IsFalse());
+        });
+    });
+
+    describe("a chunked decoder", []() {
+
+        it("decodes chunks with extensions and trailers", []() {
+            bool complete = false;
+
+            auto body = test::decode("5;name=value\r\nhello\r\nA \r\n, world!!!\r\n0\r\nX-Trailer: y\r\n\r\n", &complete);
+
+            Assert::That(body, Equals("hello, world!!!"));
+
+            Assert::That(complete, IsTrue());
+        });
+
+        it("only accepts hex digits as a size", []() {
+            const char *values[] = {
+                "0x5\r\nhello\r\n0\r\n\r\n",
+                " 5\r\nhello\r\n0\r\n\r\n",
+                "+5\r\nhello\r\n0\r\n\r\n",
+                "-1\r\nhello\r\n0\r\n\r\n",
+                "5x\r\nhello\r\n0\r\n\r\n",
+                "\r\nhello\r\n0\r\n\r\n",
+                "10000000000000000\r\n",
+            };
+
+            for (auto value : values) {
+                Assert::That(test::rejects_chunks(value), IsTrue());
+            }
+        });
+    });
+
+    describe("a response parser", []() {
+
+        it("reads a body of known length", []() {
+            http::response_parser parser;
+
+            string value = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhelloHTTP/1.1";
+
+            Assert::That(parser.parse(value.data(), value.size()), Equals(value.size() - 8));
+
+            Assert::That(parser.is_complete(), IsTrue());
+
+            Assert::That(parser.body(), Equals("hello"));
+
+            Assert::That(parser.is_persistent(), IsTrue());
+        });
+
+        it("reads a chunked body split across reads", []() {
+            http::response_parser parser;
+
+            test::feed(parser, "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"
+                               "5\r\nhello\r\n7\r\n, world\r\n0\r\n\r\n");
+
+            Assert::That(parser.is_complete(), IsTrue());
+
+            Assert::That(parser.body(), Equals("hello, world"));
+        });
+
+        it("reads until the connection closes", []() {
+            http::response_parser parser;
+
+            test::feed(parser, "HTTP/1.1 200 OK\r\nTransfer-Encoding: xchunked\r\n\r\n5\r\nhello");
+
+            Assert::That(parser.is_complete(), IsFalse());
+
+            Assert::That(parser.finish(), IsTrue());
+
+            Assert::That(parser.body(), Equals("5\r\nhello"));
+
+            Assert::That(parser.is_persistent(), IsFalse());
+        });
+
+        it("reads no body where there can't be one", []() {
+            const char *values[] = {
+                "HTTP/1.1 100 Continue\r\n\r\n",
+                "HTTP/1.1 204 No Content\r\nContent-Length: 5\r\n\r\n",
+                "HTTP/1.1 304 Not Modified\r\nTransfer-Encoding: chunked\r\n\r\n",
+            };
+
+            for (auto value : values) {
+                http::response_parser parser;
+
+                parser.parse(value, strlen(value));
+
+                Assert::That(parser.is_complete(), IsTrue());
+            }
+
+            http::response_parser head(http::HEAD);
+
+            string value = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n";
+
+            head.parse(value.data(), value.size());
+
+            Assert::That(head.is_complete(), IsTrue());
+
+            Assert::That(head.body().empty(), IsTrue());
+        });
+
+        it("is incomplete when cut short", []() {
+            http::response_parser length;
+
+            test::feed(length, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nhello");
+
+            Assert::That(length.finish(), IsFalse());
+
+            http::response_parser chunked;
+
+            test::feed(chunked, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel");
+
+            Assert::That(chunked.finish(), IsFalse());
+        });
+
+        it("rejects malformed framing", []() {
+            Assert::That(test::rejects_response("HTTP/1.1 200 OK\r\nContent-Length: 18446744073709551617\r\n\r\n"),
+                         IsTrue());
+
+            Assert::That(test::rejects_response("HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n"), IsTrue());
+
+            Assert::That(test::rejects_response("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n0x5\r\n"),
+                         IsTrue());
+        });
+    });
+});
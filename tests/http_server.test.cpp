@@ -0,0 +1,256 @@
+#include <chrono>
+#include <future>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+#include <bandit/bandit.h>
+#include "http/client.h"
+#include "http/server.h"
+#include "socket.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+namespace test
+{
+    // sends raw requests and reads until the server closes, optionally
+    // telling it nothing more will be sent and reading a while later
+    string exchange(int port, const string &requests, bool half_close = false)
+    {
+        coda::net::socket sock;
+
+        if (!sock.connect("localhost", port)) {
+            return string();
+        }
+
+        sock.send(requests.data(), requests.size());
+
+        if (half_close) {
+            ::shutdown(sock.raw_socket(), SHUT_WR);
+
+            // long enough for the server's writes to block
+            this_thread::sleep_for(chrono::milliseconds(200));
+        }
+
+        string response;
+
+        socket::data_buffer chunk;
+
+        while (sock.recv(chunk) > 0) {
+            response.append(chunk.begin(), chunk.end());
+        }
+
+        return response;
+    }
+
+    size_t count(const string &value, const string &what)
+    {
+        size_t n = 0;
+
+        for (auto pos = value.find(what); pos != string::npos; pos = value.find(what, pos + what.size())) {
+            n++;
+        }
+
+        return n;
+    }
+
+    // pipelines requests without ever reading a response
+    // @returns the bytes sent before the server hung up
+    size_t flood(int port, size_t limit)
+    {
+        coda::net::socket sock;
+
+        if (!sock.connect("localhost", port)) {
+            return 0;
+        }
+
+        string request = "GET /big HTTP/1.1\r\nHost: x\r\nX-Padding: " + string(8 * 1024, 'p') + "\r\n\r\n";
+
+        size_t total = 0;
+
+        while (total < limit) {
+            auto n = ::send(sock.raw_socket(), request.data(), request.size(), MSG_NOSIGNAL);
+
+            if (n <= 0) {
+                break;
+            }
+
+            total += n;
+        }
+
+        return total;
+    }
+}
+
+go_bandit([]() {
+
+    http::server testServer;
+
+    testServer.routes()
+        .get("/hello/:name",
+             [](const http::server_request &request, http::server_response &response) {
+                 response.write("Hello, ").write(request.param("name")).write("!");
+             })
+        .post("/echo",
+              [](const http::server_request &request, http::server_response &response) {
+                  response.add_header("Content-Type", "text/plain").write(request.body());
+              })
+        .get("/fail", [](const http::server_request &, http::server_response &) { throw runtime_error("fail"); })
+        .get("/big",
+             [](const http::server_request &, http::server_response &response) {
+                 response.write(string(4 * 1024 * 1024, 'x'));
+             });
+
+    describe("an http server", [&]() {
+        before_each([&testServer]() {
+            try {
+                testServer.start_in_background(9877, 1024);
+            } catch (const exception &e) {
+                std::cerr << typeid(e).name() << ": " << e.what() << std::endl;
+            }
+        });
+
+        after_each([&testServer]() { testServer.stop(); });
+
+        it("can route a request", []() {
+            http::client client("localhost:9877/hello/world");
+
+            client.get();
+
+            Assert::That(client.response().code(), Equals(200));
+
+            Assert::That(client.response().content(), Equals("Hello, world!"));
+        });
+
+        it("can receive a body", []() {
+            http::client client("localhost:9877/echo");
+
+            client.set_content("Hello, World!");
+
+            client.post();
+
+            Assert::That(client.response().content(), Equals("Hello, World!"));
+        });
+
+        it("answers unknown paths and failed handlers", []() {
+            http::client client("localhost:9877/missing");
+
+            client.get();
+
+            Assert::That(client.response().code(), Equals(404));
+
+            http::client failed("localhost:9877/fail");
+
+            failed.get();
+
+            Assert::That(failed.response().code(), Equals(500));
+        });
+
+        it("can be requested asynchronously", []() {
+            vector<future<http::response>> responses;
+
+            for (int i = 0; i < 50; i++) {
+                http::client client("localhost:9877/hello/" + to_string(i));
+
+                responses.push_back(client.request_async(http::GET, ""));
+            }
+
+            for (int i = 0; i < 50; i++) {
+                Assert::That(responses[i].get().content(), Equals("Hello, " + to_string(i) + "!"));
+            }
+        });
+
+        it("answers pipelined requests in order", []() {
+            auto response = test::exchange(9877,
+                                           "GET /hello/a HTTP/1.1\r\nHost: x\r\n\r\n"
+                                           "GET /hello/b HTTP/1.1\r\nHost: x\r\n\r\n"
+                                           "GET /hello/c HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+
+            Assert::That(test::count(response, "HTTP/1.1 200 OK"), Equals(3U));
+
+            auto a = response.find("Hello, a!");
+            auto b = response.find("Hello, b!");
+            auto c = response.find("Hello, c!");
+
+            Assert::That(a < b && b < c && c != string::npos, IsTrue());
+        });
+
+        it("can receive a chunked body", []() {
+            auto response = test::exchange(9877,
+                                           "POST /echo HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n"
+                                           "Connection: close\r\n\r\n"
+                                           "5\r\nHello\r\n8;ext=1\r\n, World!\r\n0\r\n\r\n");
+
+            Assert::That(response.find("Content-Length: 13\r\n"), !Equals(string::npos));
+
+            Assert::That(response.substr(response.size() - 13), Equals("Hello, World!"));
+        });
+
+        it("answers a client that has finished sending", []() {
+            auto response = test::exchange(9877, "GET /big HTTP/1.1\r\nHost: x\r\n\r\n", true);
+
+            Assert::That(response.find("Content-Length: 4194304\r\n"), !Equals(string::npos));
+
+            Assert::That(response.size() - response.find("\r\n\r\n"), Equals(4194304U + 4));
+        });
+
+        it("rejects malformed requests", []() {
+            auto response = test::exchange(9877,
+                                           "POST /echo HTTP/1.1\r\nHost: x\r\nContent-Length: 5\r\n"
+                                           "Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n");
+
+            Assert::That(response.find("HTTP/1.1 400 Bad Request"), Equals(0U));
+        });
+
+        it("rejects a content length that overflows", []() {
+            auto response = test::exchange(9877,
+                                           "POST /echo HTTP/1.1\r\nHost: x\r\n"
+                                           "Content-Length: 18446744073709551617\r\n\r\nx");
+
+            Assert::That(response.find("HTTP/1.1 400 Bad Request"), Equals(0U));
+        });
+
+        it("rejects repeated framing headers", []() {
+            const char *requests[] = {
+                "POST /echo HTTP/1.1\r\nHost: x\r\nContent-Length: 5\r\nContent-Length: 5\r\n\r\nhello",
+                "POST /echo HTTP/1.1\r\nHost: x\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\nhello!",
+                "POST /echo HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n"
+                "Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n",
+            };
+
+            for (auto request : requests) {
+                auto response = test::exchange(9877, request);
+
+                Assert::That(response.find("HTTP/1.1 400 Bad Request"), Equals(0U));
+            }
+        });
+
+        it("only takes chunked as the whole last coding", []() {
+            auto response = test::exchange(9877,
+                                           "POST /echo HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: xchunked\r\n\r\n"
+                                           "0\r\n\r\n");
+
+            Assert::That(response.find("HTTP/1.1 400 Bad Request"), Equals(0U));
+
+            response = test::exchange(9877,
+                                      "POST /echo HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: gzip , chunked\r\n"
+                                      "Connection: close\r\n\r\n0\r\n\r\n");
+
+            Assert::That(response.find("HTTP/1.1 200 OK"), Equals(0U));
+        });
+
+        it("disconnects a pipelining client that never reads", []() {
+            size_t limit = 64 * 1024 * 1024;
+
+            Assert::That(test::flood(9877, limit) < limit, IsTrue());
+        });
+    });
+
+});
@@ -14,6 +14,8 @@ int main(int argc, char *argv[])
 #ifdef CURL_FOUND
     http::client::set_request_type(http::curl::request);
 
+    http::client::set_async_request_type(http::curl::request_async);
+
     if (bandit::run(argc, argv)) {
         return EXIT_FAILURE;
     }
@@ -21,5 +23,7 @@ int main(int argc, char *argv[])
 
     http::client::set_request_type(http::socket::request);
 
+    http::client::set_async_request_type(http::socket::request_async);
+
     return bandit::run(argc, argv);
 }
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bandit/bandit.h>
+#include "resolver.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+/*!
+ * answers for "stub.test" only, counting how often it is asked
+ */
+static resolver::lookup_type stub_lookup(atomic<int> &calls,
+                                         chrono::milliseconds delay =
+                                             chrono::milliseconds(0)) {
+    return [&calls, delay](const string &host,
+                           vector<resolver::endpoint> &endpoints) {
+        calls++;
+
+        this_thread::sleep_for(delay);
+
+        if (host != "stub.test") {
+            return EAI_NONAME;
+        }
+
+        resolver::endpoint value;
+
+        memset(&value, 0, sizeof(value));
+
+        auto addr = reinterpret_cast<sockaddr_in *>(&value.addr);
+
+        addr->sin_family = AF_INET;
+        addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        value.family = AF_INET;
+        value.socktype = SOCK_STREAM;
+        value.length = sizeof(sockaddr_in);
+
+        endpoints.push_back(value);
+
+        return 0;
+    };
+}
+
+go_bandit([]() {
+
+    describe("a resolver", []() {
+
+        it("caches answers", []() {
+            atomic<int> calls(0);
+
+            resolver dns;
+
+            dns.set_lookup(stub_lookup(calls));
+
+            resolver::endpoints_type endpoints;
+
+            Assert::That(dns.resolve("stub.test", endpoints), Equals(0));
+
+            Assert::That(endpoints->size(), Equals(1U));
+
+            Assert::That(dns.resolve("stub.test", endpoints), Equals(0));
+
+            Assert::That(calls.load(), Equals(1));
+        });
+
+        it("caches failures", []() {
+            atomic<int> calls(0);
+
+            resolver dns;
+
+            dns.set_lookup(stub_lookup(calls));
+
+            resolver::endpoints_type endpoints;
+
+            Assert::That(dns.resolve("missing.test", endpoints), Equals(EAI_NONAME));
+
+            Assert::That(dns.resolve("missing.test", endpoints), Equals(EAI_NONAME));
+
+            Assert::That(calls.load(), Equals(1));
+        });
+
+        it("expires answers", []() {
+            atomic<int> calls(0);
+
+            resolver dns;
+
+            dns.set_lookup(stub_lookup(calls));
+
+            dns.set_ttl(chrono::milliseconds(20));
+
+            resolver::endpoints_type endpoints;
+
+            dns.resolve("stub.test", endpoints);
+
+            this_thread::sleep_for(chrono::milliseconds(40));
+
+            dns.resolve("stub.test", endpoints);
+
+            Assert::That(calls.load(), Equals(2));
+        });
+
+        it("forgets the least recently used", []() {
+            atomic<int> calls(0);
+
+            resolver dns;
+
+            dns.set_lookup(stub_lookup(calls));
+
+            dns.set_capacity(2);
+
+            resolver::endpoints_type endpoints;
+
+            dns.resolve("a.test", endpoints);
+            dns.resolve("b.test", endpoints);
+            dns.resolve("a.test", endpoints);
+            dns.resolve("c.test", endpoints);
+
+            Assert::That(dns.size(), Equals(2U));
+
+            int error = 0;
+
+            Assert::That(dns.find("a.test", error, endpoints), IsTrue());
+
+            Assert::That(dns.find("b.test", error, endpoints), IsFalse());
+        });
+
+        it("shares a lookup between concurrent callers", []() {
+            atomic<int> calls(0);
+
+            resolver dns;
+
+            dns.set_lookup(stub_lookup(calls, chrono::milliseconds(50)));
+
+            vector<thread> threads;
+
+            atomic<int> found(0);
+
+            for (int i = 0; i < 4; i++) {
+                threads.emplace_back([&dns, &found]() {
+                    resolver::endpoints_type endpoints;
+
+                    if (dns.resolve("stub.test", endpoints) == 0 && endpoints) {
+                        found++;
+                    }
+                });
+            }
+
+            for (auto &t : threads) {
+                t.join();
+            }
+
+            Assert::That(found.load(), Equals(4));
+
+            Assert::That(calls.load(), Equals(1));
+        });
+
+        it("can resolve without blocking", []() {
+            atomic<int> calls(0);
+
+            resolver dns;
+
+            dns.set_lookup(stub_lookup(calls, chrono::milliseconds(20)));
+
+            mutex m;
+            condition_variable cv;
+            int answers = 0;
+
+            for (int i = 0; i < 2; i++) {
+                dns.resolve("stub.test", [&](int error, const resolver::endpoints_type &endpoints) {
+                    lock_guard<mutex> lock(m);
+                    if (error == 0 && endpoints) {
+                        answers++;
+                    }
+                    cv.notify_all();
+                });
+            }
+
+            unique_lock<mutex> lock(m);
+
+            cv.wait_for(lock, chrono::seconds(5), [&answers]() { return answers == 2; });
+
+            Assert::That(answers, Equals(2));
+
+            Assert::That(calls.load(), Equals(1));
+        });
+
+        it("can resolve from the hosts file", []() {
+            resolver dns;
+
+            resolver::endpoints_type endpoints;
+
+            Assert::That(dns.resolve("localhost", endpoints), Equals(0));
+
+            Assert::That(endpoints->empty(), IsFalse());
+        });
+    });
+});
@@ -0,0 +1,354 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+
+#include <bandit/bandit.h>
+#include "async/client.h"
+#include "async/server.h"
+#include "buffered_socket.h"
+#include "socket_factory.h"
+#include "sync/server.h"
+#include "sync/uring_impl.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+namespace test
+{
+    // counts the connections a server has closed
+    class closing_socket : public buffered_socket
+    {
+       public:
+        closing_socket(SOCKET sock, const sockaddr_storage &addr, atomic<int> &closed)
+            : buffered_socket(sock, addr), closed_(closed)
+        {
+        }
+
+       protected:
+        void on_close()
+        {
+            closed_++;
+        }
+
+       private:
+        atomic<int> &closed_;
+    };
+
+    class closing_factory : public socket_factory
+    {
+       public:
+        socket_type create_socket(const server_type &server, SOCKET sock, const sockaddr_storage &addr)
+        {
+            auto socket = make_shared<closing_socket>(sock, addr, closed);
+
+            socket->set_non_blocking(server->is_non_blocking());
+
+            return socket;
+        }
+
+        atomic<int> closed{0};
+    };
+
+    // sends back whatever arrives
+    class echoing_socket : public buffered_socket
+    {
+       public:
+        echoing_socket(SOCKET sock, const sockaddr_storage &addr) : buffered_socket(sock, addr)
+        {
+        }
+
+       protected:
+        void on_did_read()
+        {
+            auto input = inBuffer_.readable();
+
+            write(string(input.begin(), input.end()));
+
+            inBuffer_.consume(input.size());
+        }
+    };
+
+    class echoing_factory : public socket_factory
+    {
+       public:
+        socket_type create_socket(const server_type &server, SOCKET sock, const sockaddr_storage &addr)
+        {
+            auto socket = make_shared<echoing_socket>(sock, addr);
+
+            socket->set_non_blocking(server->is_non_blocking());
+
+            return socket;
+        }
+    };
+
+    // sends data and reads as much back
+    string echo_from(int port, const string &data)
+    {
+        coda::net::socket sock;
+
+        if (!sock.connect("localhost", port)) {
+            return string();
+        }
+
+        for (size_t sent = 0; sent < data.size();) {
+            int status = sock.send(data.data() + sent, data.size() - sent);
+
+            if (status <= 0) {
+                return string();
+            }
+
+            sent += status;
+        }
+
+        string response;
+
+        socket::data_buffer chunk;
+
+        while (response.size() < data.size() && sock.recv(chunk) > 0) {
+            response.append(chunk.begin(), chunk.end());
+        }
+
+        return response;
+    }
+
+    // creates clients without choosing their blocking mode, as examples do
+    class client_factory : public socket_factory
+    {
+       public:
+        socket_type create_socket(const server_type &, SOCKET sock, const sockaddr_storage &addr)
+        {
+            return make_shared<async::default_client>(sock, addr);
+        }
+    };
+
+    // the number of threads in the process
+    size_t threads()
+    {
+        size_t count = 0;
+
+        auto dir = opendir("/proc/self/task");
+
+        if (dir == nullptr) {
+            return 0;
+        }
+
+        while (auto entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') {
+                count++;
+            }
+        }
+
+        closedir(dir);
+
+        return count;
+    }
+
+    // polls a condition for up to two seconds
+    bool wait_for(const function<bool()> &condition)
+    {
+        for (int i = 0; i < 200; i++) {
+            if (condition()) {
+                return true;
+            }
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+
+        return condition();
+    }
+
+    // connects, sends a little and hangs up
+    bool disconnect_from(int port)
+    {
+        coda::net::socket sock;
+
+        if (!sock.connect("localhost", port)) {
+            return false;
+        }
+
+        string hello = "hello";
+
+        sock.send(hello.data(), hello.size());
+
+        sock.close();
+
+        return true;
+    }
+
+    // schedules a timer from this thread once the server is idle
+    bool schedule_on(sync::server &server)
+    {
+        // long enough for the reactor to block
+        this_thread::sleep_for(chrono::milliseconds(100));
+
+        auto fired = make_shared<atomic<bool>>(false);
+
+        server.schedule(sync::server::duration(0), [fired]() { *fired = true; });
+
+        return wait_for([fired]() { return fired->load(); });
+    }
+}
+
+go_bandit([]() {
+
+    describe("a sync server", []() {
+
+        it("closes connections the peer closed with epoll", []() {
+            auto factory = make_shared<test::closing_factory>();
+
+            sync::server server(factory);
+
+            server.set_poller(sync::POLLER_EPOLL);
+
+            server.start_in_background(9878);
+
+            Assert::That(test::disconnect_from(9878), IsTrue());
+
+            Assert::That(test::wait_for([&factory]() { return factory->closed == 1; }), IsTrue());
+
+            server.stop();
+        });
+
+        it("closes connections the peer closed with poll", []() {
+            auto factory = make_shared<test::closing_factory>();
+
+            sync::server server(factory);
+
+            server.set_poller(sync::POLLER_POLL);
+
+            server.start_in_background(9879);
+
+            Assert::That(test::disconnect_from(9879), IsTrue());
+
+            Assert::That(test::wait_for([&factory]() { return factory->closed == 1; }), IsTrue());
+
+            server.stop();
+        });
+
+        it("runs timers from other threads without a poll frequency with epoll", []() {
+            sync::server server(make_shared<test::closing_factory>());
+
+            server.set_poller(sync::POLLER_EPOLL);
+
+            server.set_frequency(0);
+
+            server.start_in_background(9895);
+
+            Assert::That(test::schedule_on(server), IsTrue());
+
+            server.stop();
+        });
+
+        it("runs timers from other threads without a poll frequency with poll", []() {
+            sync::server server(make_shared<test::closing_factory>());
+
+            server.set_poller(sync::POLLER_POLL);
+
+            server.set_frequency(0);
+
+            server.start_in_background(9896);
+
+            Assert::That(test::schedule_on(server), IsTrue());
+
+            server.stop();
+        });
+
+#ifdef URING_FOUND
+        it("closes connections the peer closed with io_uring", []() {
+            if (!sync::uring_impl::is_supported()) {
+                return;
+            }
+
+            auto factory = make_shared<test::closing_factory>();
+
+            sync::server server(factory);
+
+            server.set_poller(sync::POLLER_URING);
+
+            server.start_in_background(9891);
+
+            Assert::That(test::disconnect_from(9891), IsTrue());
+
+            Assert::That(test::wait_for([&factory]() { return factory->closed == 1; }), IsTrue());
+
+            server.stop();
+        });
+
+        it("keeps a large echo in order with io_uring", []() {
+            if (!sync::uring_impl::is_supported()) {
+                return;
+            }
+
+            sync::server server(make_shared<test::echoing_factory>());
+
+            server.set_poller(sync::POLLER_URING);
+
+            server.start_in_background(9892);
+
+            string data(8 * 1024 * 1024, 'x');
+
+            for (size_t i = 0; i < data.size(); i++) {
+                data[i] = static_cast<char>('a' + i % 26);
+            }
+
+            Assert::That(test::echo_from(9892, data) == data, IsTrue());
+
+            server.stop();
+        });
+
+        it("runs timers from other threads without a poll frequency with io_uring", []() {
+            if (!sync::uring_impl::is_supported()) {
+                return;
+            }
+
+            sync::server server(make_shared<test::closing_factory>());
+
+            server.set_poller(sync::POLLER_URING);
+
+            server.set_frequency(0);
+
+            server.start_in_background(9897);
+
+            Assert::That(test::schedule_on(server), IsTrue());
+
+            server.stop();
+        });
+#endif
+    });
+
+    describe("an async server", []() {
+
+        it("serves connections on its workers, not threads of their own", []() {
+            async::server server(make_shared<test::client_factory>());
+
+            server.set_threads(2);
+
+            server.start_in_background(9880);
+
+            auto before = test::threads();
+
+            coda::net::socket client;
+
+            Assert::That(client.connect("localhost", 9880), IsTrue());
+
+            Assert::That(test::wait_for([&server]() { return server.connections() == 1; }), IsTrue());
+
+            Assert::That(test::threads(), Equals(before));
+
+            client.close();
+
+            Assert::That(test::wait_for([&server]() { return server.connections() == 0; }), IsTrue());
+
+            server.stop();
+        });
+    });
+
+});
@@ -0,0 +1,408 @@
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <netdb.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <bandit/bandit.h>
+#include "buffer.h"
+#include "buffered_socket.h"
+#include "resolver.h"
+#include "socket.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+namespace test
+{
+    // an address for the stub resolver, without a port
+    resolver::endpoint endpoint_of(const string &ip)
+    {
+        resolver::endpoint value;
+
+        memset(&value, 0, sizeof(value));
+
+        value.socktype = SOCK_STREAM;
+
+        if (ip.find(':') != string::npos) {
+            auto addr = reinterpret_cast<sockaddr_in6 *>(&value.addr);
+
+            addr->sin6_family = AF_INET6;
+
+            inet_pton(AF_INET6, ip.c_str(), &addr->sin6_addr);
+
+            value.family = AF_INET6;
+            value.length = sizeof(sockaddr_in6);
+        } else {
+            auto addr = reinterpret_cast<sockaddr_in *>(&value.addr);
+
+            addr->sin_family = AF_INET;
+
+            inet_pton(AF_INET, ip.c_str(), &addr->sin_addr);
+
+            value.family = AF_INET;
+            value.length = sizeof(sockaddr_in);
+        }
+
+        return value;
+    }
+
+    // listens on one address only, without ever accepting
+    SOCKET listen_on(const string &ip, int port, int backlog = 16)
+    {
+        auto value = endpoint_of(ip);
+
+        if (value.family == AF_INET) {
+            reinterpret_cast<sockaddr_in *>(&value.addr)->sin_port = htons(port);
+        } else {
+            reinterpret_cast<sockaddr_in6 *>(&value.addr)->sin6_port = htons(port);
+        }
+
+        SOCKET sock = ::socket(value.family, SOCK_STREAM, 0);
+
+        int on = 1;
+
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        if (::bind(sock, reinterpret_cast<sockaddr *>(&value.addr), value.length) != 0 ||
+            ::listen(sock, backlog) != 0) {
+            ::close(sock);
+            return socket::INVALID;
+        }
+
+        return sock;
+    }
+
+    // fills a listener's accept queue, so the next connects are never answered
+    vector<SOCKET> fill_backlog(const string &ip, int port)
+    {
+        vector<SOCKET> fillers;
+
+        auto value = endpoint_of(ip);
+
+        reinterpret_cast<sockaddr_in *>(&value.addr)->sin_port = htons(port);
+
+        for (int i = 0; i < 2; i++) {
+            SOCKET sock = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+            ::connect(sock, reinterpret_cast<sockaddr *>(&value.addr), value.length);
+
+            fillers.push_back(sock);
+        }
+
+        // long enough for the handshakes to land in the queue
+        this_thread::sleep_for(chrono::milliseconds(50));
+
+        return fillers;
+    }
+
+    // answers "race.test" with the addresses in order
+    void race_between(const vector<string> &ips)
+    {
+        resolver::shared().clear();
+
+        resolver::shared().set_lookup([ips](const string &host, vector<resolver::endpoint> &endpoints) {
+            if (host != "race.test") {
+                return EAI_NONAME;
+            }
+
+            for (const auto &ip : ips) {
+                endpoints.push_back(endpoint_of(ip));
+            }
+
+            return 0;
+        });
+    }
+
+    // keeps all but the last byte of each read
+    class trimming_socket : public coda::net::socket
+    {
+       public:
+        using coda::net::socket::socket;
+
+       protected:
+        size_t on_recv(data_type *data, size_t size)
+        {
+            return size - 1;
+        }
+    };
+
+    // counts the times its output drained
+    class draining_socket : public buffered_socket
+    {
+       public:
+        using buffered_socket::buffered_socket;
+
+        int drained = 0;
+
+       protected:
+        void on_did_write()
+        {
+            drained++;
+        }
+    };
+
+    // connects two sockets to each other
+    bool connect_pair(coda::net::socket &first, coda::net::socket &second)
+    {
+        SOCKET fds[2];
+
+        sockaddr_storage addr = {};
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            return false;
+        }
+
+        first = coda::net::socket(fds[0], addr);
+        second = coda::net::socket(fds[1], addr);
+
+        return true;
+    }
+
+    chrono::milliseconds elapsed_since(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    }
+}
+
+go_bandit([]() {
+
+    describe("a socket", []() {
+
+        after_each([]() {
+            resolver::shared().set_lookup(nullptr);
+            resolver::shared().clear();
+        });
+
+        it("reads a short reply onto the end of a buffer", []() {
+            coda::net::socket first, second;
+
+            Assert::That(test::connect_pair(first, second), IsTrue());
+
+            buffer value;
+
+            value.append("abc", 3);
+
+            Assert::That(second.send("hello", 5), Equals(5));
+
+            Assert::That(first.recv_into(value), Equals(5));
+
+            Assert::That(value.size(), Equals(8U));
+
+            Assert::That(string(value.begin(), value.end()), Equals("abchello"));
+        });
+
+        it("reads a short reply into a span", []() {
+            coda::net::socket first, second;
+
+            Assert::That(test::connect_pair(first, second), IsTrue());
+
+            char data[64];
+
+            Assert::That(second.send("hello", 5), Equals(5));
+
+            Assert::That(first.recv_into(buffer::span(reinterpret_cast<buffer::data_type *>(data), sizeof(data))), Equals(5));
+
+            Assert::That(string(data, 5), Equals("hello"));
+        });
+
+        it("keeps only the bytes its filter returns", []() {
+            test::trimming_socket first;
+            coda::net::socket second;
+
+            Assert::That(test::connect_pair(first, second), IsTrue());
+
+            buffer value;
+
+            Assert::That(second.send("hello", 5), Equals(5));
+
+            Assert::That(first.recv_into(value), Equals(5));
+
+            Assert::That(string(value.begin(), value.end()), Equals("hell"));
+        });
+
+        it("connects to a later address straight away when the first refuses", []() {
+            SOCKET live = test::listen_on("127.0.0.1", 9900);
+
+            test::race_between({"127.0.0.2", "127.0.0.1"});
+
+            coda::net::socket sock;
+
+            auto start = chrono::steady_clock::now();
+
+            Assert::That(sock.connect("race.test", 9900), IsTrue());
+
+            // well inside the attempt delay
+            Assert::That(test::elapsed_since(start) < chrono::milliseconds(200), IsTrue());
+
+            Assert::That(string(sock.ip()), Equals("127.0.0.1"));
+
+            Assert::That(sock.port(), Equals(9900));
+
+            ::close(live);
+        });
+
+        it("starts the next address once the attempt delay passes", []() {
+            SOCKET full = test::listen_on("127.0.0.3", 9901, 0);
+
+            auto fillers = test::fill_backlog("127.0.0.3", 9901);
+
+            SOCKET live = test::listen_on("127.0.0.1", 9901);
+
+            test::race_between({"127.0.0.3", "127.0.0.1"});
+
+            coda::net::socket sock;
+
+            auto start = chrono::steady_clock::now();
+
+            Assert::That(sock.connect("race.test", 9901), IsTrue());
+
+            auto elapsed = test::elapsed_since(start);
+
+            Assert::That(elapsed >= chrono::milliseconds(250), IsTrue());
+
+            Assert::That(elapsed < chrono::milliseconds(1000), IsTrue());
+
+            Assert::That(string(sock.ip()), Equals("127.0.0.1"));
+
+            for (auto filler : fillers) {
+                ::close(filler);
+            }
+
+            ::close(full);
+            ::close(live);
+        });
+
+        it("alternates address families", []() {
+            SOCKET full = test::listen_on("127.0.0.3", 9902, 0);
+
+            auto fillers = test::fill_backlog("127.0.0.3", 9902);
+
+            SOCKET live4 = test::listen_on("127.0.0.1", 9902);
+
+            SOCKET live6 = test::listen_on("::1", 9902);
+
+            // the IPv6 address is tried second, before the other IPv4 one
+            test::race_between({"127.0.0.3", "127.0.0.1", "::1"});
+
+            coda::net::socket sock;
+
+            Assert::That(sock.connect("race.test", 9902), IsTrue());
+
+            Assert::That(string(sock.ip()), Equals("::1"));
+
+            Assert::That(sock.port(), Equals(9902));
+
+            for (auto filler : fillers) {
+                ::close(filler);
+            }
+
+            ::close(full);
+            ::close(live4);
+            ::close(live6);
+        });
+
+        it("gives up at the connect timeout", []() {
+            SOCKET full = test::listen_on("127.0.0.3", 9903, 0);
+
+            auto fillers = test::fill_backlog("127.0.0.3", 9903);
+
+            test::race_between({"127.0.0.3"});
+
+            coda::net::socket sock;
+
+            sock.set_connect_timeout(chrono::milliseconds(300));
+
+            auto start = chrono::steady_clock::now();
+
+            bool connected = sock.connect("race.test", 9903);
+
+            int error = errno;
+
+            auto elapsed = test::elapsed_since(start);
+
+            Assert::That(connected, IsFalse());
+
+            Assert::That(error, Equals(ETIMEDOUT));
+
+            Assert::That(elapsed >= chrono::milliseconds(300), IsTrue());
+
+            Assert::That(elapsed < chrono::milliseconds(1000), IsTrue());
+
+            Assert::That(sock.is_valid(), IsFalse());
+
+            for (auto filler : fillers) {
+                ::close(filler);
+            }
+
+            ::close(full);
+        });
+    });
+
+    describe("a buffered socket", []() {
+
+        it("keeps what a short send left queued until the socket is writable", []() {
+            coda::net::socket peer;
+            test::draining_socket sock;
+
+            Assert::That(test::connect_pair(sock, peer), IsTrue());
+
+            int size = 16 * 1024;
+
+            setsockopt(sock.raw_socket(), SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+            sock.set_non_blocking(true);
+
+            peer.set_non_blocking(true);
+
+            string data(1024 * 1024, 'x');
+
+            for (size_t i = 0; i < data.size(); i++) {
+                data[i] = static_cast<char>('a' + i % 26);
+            }
+
+            sock.write(data);
+
+            Assert::That(sock.write_from_buffer(), IsTrue());
+
+            Assert::That(sock.is_write_blocked(), IsTrue());
+
+            Assert::That(sock.has_output(), IsTrue());
+
+            Assert::That(sock.pending_output() < data.size(), IsTrue());
+
+            Assert::That(sock.drained, Equals(0));
+
+            string received;
+
+            coda::net::socket::data_buffer chunk;
+
+            // read what was sent, and resume as a reactor would
+            for (int i = 0; i < 10000 && received.size() < data.size(); i++) {
+                if (peer.recv(chunk) > 0) {
+                    received.append(chunk.begin(), chunk.end());
+                } else {
+                    Assert::That(sock.write_from_buffer(), IsTrue());
+                }
+            }
+
+            Assert::That(received == data, IsTrue());
+
+            Assert::That(sock.has_output(), IsFalse());
+
+            Assert::That(sock.is_write_blocked(), IsFalse());
+
+            Assert::That(sock.drained, Equals(1));
+        });
+    });
+
+});
@@ -0,0 +1,87 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <bandit/bandit.h>
+#include "sync/timer_wheel.h"
+
+using namespace bandit;
+
+using namespace coda::net::sync;
+
+using namespace std;
+
+using namespace snowhouse;
+
+static void run_until_empty(timer_wheel &wheel) {
+    while (wheel.size() > 0) {
+        int timeout = wheel.next_timeout();
+
+        if (timeout > 0) {
+            this_thread::sleep_for(chrono::milliseconds(timeout));
+        }
+
+        wheel.expire();
+    }
+}
+
+go_bandit([]() {
+
+    describe("a timer wheel", []() {
+
+        it("runs timers in order of their deadlines", []() {
+            timer_wheel wheel;
+
+            vector<int> order;
+
+            wheel.schedule(timer_wheel::duration(70), [&order]() { order.push_back(3); });
+            wheel.schedule(timer_wheel::duration(0), [&order]() { order.push_back(1); });
+            wheel.schedule(timer_wheel::duration(20), [&order]() { order.push_back(2); });
+
+            run_until_empty(wheel);
+
+            Assert::That(order, Equals(vector<int>{1, 2, 3}));
+        });
+
+        it("does not run timers early", []() {
+            timer_wheel wheel;
+
+            auto start = timer_wheel::clock::now();
+
+            timer_wheel::duration elapsed(0);
+
+            // long enough to cascade from the second level
+            wheel.schedule(timer_wheel::duration(130), [&]() {
+                elapsed = chrono::duration_cast<timer_wheel::duration>(timer_wheel::clock::now() - start);
+            });
+
+            run_until_empty(wheel);
+
+            Assert::That(elapsed.count(), IsGreaterThanOrEqualTo(130));
+        });
+
+        it("can cancel a timer", []() {
+            timer_wheel wheel;
+
+            bool ran = false;
+
+            auto id = wheel.schedule(timer_wheel::duration(10), [&ran]() { ran = true; });
+
+            Assert::That(wheel.cancel(id), IsTrue());
+
+            Assert::That(wheel.cancel(id), IsFalse());
+
+            this_thread::sleep_for(chrono::milliseconds(20));
+
+            Assert::That(wheel.expire(), Equals(0U));
+
+            Assert::That(ran, IsFalse());
+        });
+
+        it("has no timeout when empty", []() {
+            timer_wheel wheel;
+
+            Assert::That(wheel.next_timeout(), Equals(-1));
+        });
+    });
+});
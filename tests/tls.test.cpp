@@ -0,0 +1,527 @@
+#ifdef OPENSSL_FOUND
+
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <unistd.h>
+
+#include <bandit/bandit.h>
+#include "exception.h"
+#include "http/client.h"
+#include "http/server.h"
+#include "secure_layer.h"
+#include "socket_factory.h"
+#include "sync/server.h"
+#include "sync/uring_impl.h"
+#include "tls_context.h"
+
+using namespace bandit;
+
+using namespace coda::net;
+
+using namespace std;
+
+using namespace snowhouse;
+
+namespace test
+{
+    // a self-signed certificate for a name, on disk for as long as it lives
+    struct certificate {
+        certificate(const string &name)
+        {
+            auto prefix = "/tmp/coda_net_" + to_string(getpid()) + "_" + name;
+
+            certificate_file = prefix + ".pem";
+            private_key_file = prefix + ".key";
+
+            EVP_PKEY *key = NULL;
+
+            auto ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+
+            EVP_PKEY_keygen_init(ctx);
+            EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1);
+            EVP_PKEY_keygen(ctx, &key);
+            EVP_PKEY_CTX_free(ctx);
+
+            auto cert = X509_new();
+
+            X509_set_version(cert, 2);
+            ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+            X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+            X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+            X509_set_pubkey(cert, key);
+
+            auto subject = X509_get_subject_name(cert);
+
+            X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC,
+                                       reinterpret_cast<const unsigned char *>(name.c_str()), -1, -1, 0);
+
+            X509_set_issuer_name(cert, subject);
+            X509_sign(cert, key, EVP_sha256());
+
+            if (auto file = fopen(certificate_file.c_str(), "w")) {
+                PEM_write_X509(file, cert);
+                fclose(file);
+            }
+
+            if (auto file = fopen(private_key_file.c_str(), "w")) {
+                PEM_write_PrivateKey(file, key, NULL, NULL, 0, NULL, NULL);
+                fclose(file);
+            }
+
+            X509_free(cert);
+            EVP_PKEY_free(key);
+        }
+
+        ~certificate()
+        {
+            unlink(certificate_file.c_str());
+            unlink(private_key_file.c_str());
+        }
+
+        // a server context presenting the certificate
+        shared_ptr<tls_context> server() const
+        {
+            tls_context::options opts;
+
+            opts.server = true;
+            opts.certificate_file = certificate_file;
+            opts.private_key_file = private_key_file;
+
+            return tls_context::get(opts);
+        }
+
+        // a client context trusting only the certificate
+        shared_ptr<tls_context> client(bool kernel_tls = true) const
+        {
+            tls_context::options opts;
+
+            opts.verify_peer = true;
+            opts.ca_file = certificate_file;
+            opts.kernel_tls = kernel_tls;
+
+            return tls_context::get(opts);
+        }
+
+        string certificate_file;
+        string private_key_file;
+    };
+
+    // sends back whatever arrives
+    class echo_socket : public buffered_socket
+    {
+       public:
+        echo_socket(SOCKET sock, const sockaddr_storage &addr) : buffered_socket(sock, addr)
+        {
+        }
+
+       protected:
+        void on_did_read()
+        {
+            auto input = inBuffer_.readable();
+
+            write(string(input.begin(), input.end()));
+
+            inBuffer_.consume(input.size());
+        }
+    };
+
+    class echo_factory : public socket_factory
+    {
+       public:
+        socket_type create_socket(const server_type &server, SOCKET sock, const sockaddr_storage &addr)
+        {
+            auto socket = make_shared<echo_socket>(sock, addr);
+
+            socket->set_non_blocking(server->is_non_blocking());
+
+            return socket;
+        }
+    };
+
+    // starts an echo server whose connections are secured by a layer
+    void start_echo(sync::server &server, sync::poller_type poller, const shared_ptr<secure_layer> &layer, int port)
+    {
+        server.set_poller(poller);
+
+        server.set_secure(layer);
+
+        server.start_in_background(port);
+    }
+
+    // has a secure session with a name echo data back, empty if it failed
+    string echo(int port, const shared_ptr<secure_layer> &layer, const string &data, const string &name = "localhost")
+    {
+        coda::net::socket sock;
+
+        if (!sock.connect("localhost", port)) {
+            return string();
+        }
+
+        try {
+            layer->attach(sock.raw_socket(), name, port);
+        } catch (const socket_exception &) {
+            return string();
+        }
+
+        sock.set_secure(layer);
+
+        for (size_t sent = 0; sent < data.size();) {
+            int status = sock.send(data.data() + sent, data.size() - sent);
+
+            if (status <= 0) {
+                return string();
+            }
+
+            sent += status;
+        }
+
+        string response;
+
+        socket::data_buffer chunk;
+
+        while (response.size() < data.size() && sock.recv(chunk) > 0) {
+            response.append(chunk.begin(), chunk.end());
+        }
+
+        return response;
+    }
+
+    // the number of threads in the process
+    size_t thread_count()
+    {
+        size_t count = 0;
+
+        auto dir = opendir("/proc/self/task");
+
+        if (dir == nullptr) {
+            return 0;
+        }
+
+        while (auto entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') {
+                count++;
+            }
+        }
+
+        closedir(dir);
+
+        return count;
+    }
+}
+
+go_bandit([]() {
+
+    test::certificate localhost("localhost");
+
+    test::certificate other("other.test");
+
+    describe("a tls context", [&]() {
+
+        it("is shared while held and freed once not", [&]() {
+            weak_ptr<tls_context> released = localhost.client(false);
+
+            Assert::That(released.expired(), IsTrue());
+
+            auto held = localhost.client(false);
+
+            Assert::That(localhost.client(false) == held, IsTrue());
+
+            weak_ptr<tls_context> weak = held;
+
+            held = nullptr;
+
+            Assert::That(weak.expired(), IsTrue());
+        });
+
+        it("is kept by the connections using it", [&]() {
+            auto layer = make_shared<openssl_layer>(localhost.client(false));
+
+            weak_ptr<tls_context> weak = localhost.client(false);
+
+            Assert::That(weak.expired(), IsFalse());
+
+            layer = nullptr;
+
+            Assert::That(weak.expired(), IsTrue());
+        });
+    });
+
+    describe("a secure sync server", [&]() {
+
+        it("handshakes with epoll", [&]() {
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_EPOLL, make_shared<openssl_layer>(localhost.server()), 9881);
+
+            auto client = make_shared<openssl_layer>(localhost.client());
+
+            Assert::That(test::echo(9881, client, "hello"), Equals("hello"));
+
+            Assert::That(client->is_handshake_done(), IsTrue());
+
+            server.stop();
+        });
+
+        it("handshakes with poll", [&]() {
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_POLL, make_shared<openssl_layer>(localhost.server()), 9882);
+
+            Assert::That(test::echo(9882, make_shared<openssl_layer>(localhost.client()), "hello"), Equals("hello"));
+
+            server.stop();
+        });
+
+#ifdef URING_FOUND
+        it("handshakes with io_uring", [&]() {
+            if (!sync::uring_impl::is_supported()) {
+                return;
+            }
+
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_URING, make_shared<openssl_layer>(localhost.server()), 9894);
+
+            Assert::That(test::echo(9894, make_shared<openssl_layer>(localhost.client()), "hello"), Equals("hello"));
+
+            server.stop();
+        });
+#endif
+
+        it("presents the certificate for the name asked for", [&]() {
+            auto context = localhost.server();
+
+            context->add_server_name("other.test", other.server());
+
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_EPOLL, make_shared<openssl_layer>(context), 9883);
+
+            // each client trusts only the certificate for the name it asks
+            Assert::That(test::echo(9883, make_shared<openssl_layer>(other.client()), "hello", "other.test"),
+                         Equals("hello"));
+
+            Assert::That(test::echo(9883, make_shared<openssl_layer>(localhost.client()), "hello"), Equals("hello"));
+
+            Assert::That(test::echo(9883, make_shared<openssl_layer>(other.client()), "hello").empty(), IsTrue());
+
+            server.stop();
+        });
+
+        it("resumes sessions on repeated connects", [&]() {
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_EPOLL, make_shared<openssl_layer>(localhost.server()), 9884);
+
+            auto context = localhost.client();
+
+            auto before = context->stats();
+
+            auto served = localhost.server()->stats();
+
+            for (int i = 0; i < 4; i++) {
+                Assert::That(test::echo(9884, make_shared<openssl_layer>(context), "hello"), Equals("hello"));
+            }
+
+            auto after = context->stats();
+
+            Assert::That(after.full - before.full, Equals(1U));
+
+            Assert::That(after.resumed - before.resumed, Equals(3U));
+
+            Assert::That(localhost.server()->stats().resumed - served.resumed, Equals(3U));
+
+            server.stop();
+        });
+
+        it("counts the handshakes the kernel took sends over from", [&]() {
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_EPOLL, make_shared<openssl_layer>(localhost.server()), 9885);
+
+            auto context = localhost.client();
+
+            auto before = context->stats();
+
+            size_t kernel = 0;
+
+            for (int i = 0; i < 2; i++) {
+                auto client = make_shared<openssl_layer>(context);
+
+                Assert::That(test::echo(9885, client, "hello"), Equals("hello"));
+
+                if (client->is_kernel_send()) {
+                    kernel++;
+                }
+            }
+
+            // the kernel may or may not help here, but the count must agree
+            Assert::That(context->stats().kernel_send - before.kernel_send, Equals(kernel));
+
+            // and never where it wasn't asked to
+            auto user_space = localhost.client(false);
+
+            before = user_space->stats();
+
+            auto client = make_shared<openssl_layer>(user_space);
+
+            Assert::That(test::echo(9885, client, "hello"), Equals("hello"));
+
+            Assert::That(client->is_kernel_send(), IsFalse());
+
+            auto after = user_space->stats();
+
+            Assert::That(after.kernel_send - before.kernel_send, Equals(0U));
+
+            Assert::That(after.full + after.resumed - before.full - before.resumed, Equals(1U));
+
+            server.stop();
+        });
+    });
+
+    describe("a memory layer", [&]() {
+
+        string data(4 * 1024 * 1024, 'x');
+
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<char>('a' + i % 26);
+        }
+
+        it("carries a large transfer with epoll", [&]() {
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_EPOLL, make_shared<openssl_memory_layer>(localhost.server()), 9886);
+
+            Assert::That(test::echo(9886, make_shared<openssl_layer>(localhost.client()), data) == data, IsTrue());
+
+            server.stop();
+        });
+
+        it("carries a large transfer with poll", [&]() {
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_POLL, make_shared<openssl_memory_layer>(localhost.server()), 9887);
+
+            Assert::That(test::echo(9887, make_shared<openssl_layer>(localhost.client()), data) == data, IsTrue());
+
+            server.stop();
+        });
+
+#ifdef URING_FOUND
+        it("carries a large transfer with io_uring", [&]() {
+            if (!sync::uring_impl::is_supported()) {
+                return;
+            }
+
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_URING, make_shared<openssl_memory_layer>(localhost.server()), 9893);
+
+            Assert::That(test::echo(9893, make_shared<openssl_layer>(localhost.client()), data) == data, IsTrue());
+
+            server.stop();
+        });
+#endif
+
+        it("handshakes as a client", [&]() {
+            sync::server server(make_shared<test::echo_factory>());
+
+            test::start_echo(server, sync::POLLER_EPOLL, make_shared<openssl_layer>(localhost.server()), 9888);
+
+            Assert::That(test::echo(9888, make_shared<openssl_memory_layer>(localhost.client()), data) == data,
+                         IsTrue());
+
+            server.stop();
+        });
+    });
+
+    describe("an https server on a memory layer", [&]() {
+
+        it("sends all of a large body before closing", [&]() {
+            string body(8 * 1024 * 1024, 'x');
+
+            http::server server;
+
+            server.routes().get("/big", [&body](const http::server_request &, http::server_response &response) {
+                response.write(body);
+            });
+
+            server.set_secure(make_shared<openssl_memory_layer>(localhost.server()));
+
+            server.start_in_background(9890);
+
+            coda::net::socket sock;
+
+            sock.set_secure(make_shared<openssl_layer>(localhost.client()));
+
+            Assert::That(sock.connect("localhost", 9890), IsTrue());
+
+            string request = "GET /big HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+
+            sock.send(request.data(), request.size());
+
+            string response;
+
+            socket::data_buffer chunk;
+
+            while (sock.recv(chunk) > 0) {
+                response.append(chunk.begin(), chunk.end());
+            }
+
+            auto head = response.find("\r\n\r\n");
+
+            Assert::That(head != string::npos, IsTrue());
+
+            Assert::That(response.size() - head - 4, Equals(body.size()));
+
+            server.stop();
+        });
+    });
+
+    describe("an https request", [&]() {
+
+        it("runs on the client's background thread", [&]() {
+            http::server server;
+
+            server.routes().get("/hello", [](const http::server_request &, http::server_response &response) {
+                response.write("hello");
+            });
+
+            server.set_secure(make_shared<openssl_layer>(localhost.server()));
+
+            server.start_in_background(9889);
+
+            http::client client("https://localhost:9889/hello");
+
+            // the first request starts the thread
+            Assert::That(client.request_async(http::GET, "/hello").get().code(), Equals(200));
+
+            auto before = test::thread_count();
+
+            vector<future<http::response>> responses;
+
+            for (int i = 0; i < 20; i++) {
+                responses.push_back(client.request_async(http::GET, "/hello"));
+            }
+
+            Assert::That(test::thread_count(), Equals(before));
+
+            for (auto &response : responses) {
+                Assert::That(response.get().content(), Equals("hello"));
+            }
+
+            server.stop();
+        });
+    });
+});
+
+#endif